@@ -0,0 +1,85 @@
+#ifndef LTM_DB_COLLECTION_COUNTER_H
+#define LTM_DB_COLLECTION_COUNTER_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ltm/db/db_lock.h>
+
+namespace ltm {
+    namespace db {
+
+        // Number of documents in a collection, maintained in process, so logging and status
+        // never run a count query.
+        //
+        // Writers add() and sub() what they insert and remove, while holding db_mutex(). The value is
+        // replaced by the DB count on reconcile(): when attached, and periodically through the CounterRegistry.
+        class CollectionCounter {
+        public:
+            // DB count, called with db_mutex() held.
+            typedef boost::function<int()> Source;
+
+            CollectionCounter();
+            virtual ~CollectionCounter();
+
+            // Registers the counter and reconciles it. Can be called again, e.g., after switching databases.
+            void attach(const std::string &name, const Source &source);
+            void detach();
+
+            void add(int n = 1);
+            void sub(int n = 1);
+            int get() const;
+            std::string name() const;
+
+            // Replaces the value by the DB count. Returns false when the DB could not be counted.
+            bool reconcile();
+
+        private:
+            std::string _name;
+            Source _source;
+            boost::atomic<int> _value;
+            bool _attached;
+
+            // sets the name
+            friend class CounterRegistry;
+
+            // non-copyable, the registry holds its address
+            CollectionCounter(const CollectionCounter &);
+            CollectionCounter &operator=(const CollectionCounter &);
+        };
+
+        // Attached counters of the server and every loaded plugin.
+        //
+        // The set has its own mutex, so the counts are read without waiting for db_mutex(). Counters are
+        // attached and detached with db_mutex() held, so they are not destroyed while being reconciled.
+        class CounterRegistry {
+        private:
+            std::set<CollectionCounter *> _counters;
+            size_t _drifted;
+            boost::mutex _mutex;
+
+            CounterRegistry();
+
+            friend class CollectionCounter;
+            void add(CollectionCounter *counter, const std::string &name);
+            void remove(CollectionCounter *counter);
+
+        public:
+            static CounterRegistry &instance();
+            virtual ~CounterRegistry();
+
+            // Reconciles every counter with the DB. Returns the number of counters that drifted.
+            size_t reconcile_all();
+            // (name, value) of every counter, sorted by name
+            void get_counts(std::vector<std::pair<std::string, int> > &counts);
+            void append_status(std::stringstream &status);
+        };
+
+    }
+}
+
+#endif //LTM_DB_COLLECTION_COUNTER_H
@@ -0,0 +1,81 @@
+#ifndef LTM_DB_CURSOR_REGISTRY_H
+#define LTM_DB_CURSOR_REGISTRY_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <ltm/QueryServer.h>
+
+namespace ltm {
+    namespace db {
+
+        // Paged query results. Pages are produced on demand, e.g., from a live DB cursor.
+        class QueryCursor {
+        public:
+            virtual ~QueryCursor() {}
+
+            // Fills res with up to 'limit' matches (0: every remaining match).
+            // Returns true while more matches remain.
+            virtual bool next(size_t limit, ltm::QueryServer::Response &res) = 0;
+        };
+        typedef boost::shared_ptr<QueryCursor> QueryCursorPtr;
+
+        // Pages an already materialized response. Every uid list advances by 'limit' on each page.
+        // Used for sources that cannot keep a DB cursor alive (e.g., plugin queries).
+        class ResultCursor : public QueryCursor {
+        private:
+            ltm::QueryServer::Response _res;
+            size_t _offset;
+
+            bool page(const std::vector<uint32_t> &source, size_t limit, std::vector<uint32_t> &uids);
+            bool page(const std::vector<ltm::QueryResult> &source, size_t limit, std::vector<ltm::QueryResult> &results);
+
+        public:
+            // sorted: sort every uid list in ascending (or descending) order first.
+            ResultCursor(const ltm::QueryServer::Response &res, bool sorted = false, bool ascending = true);
+            bool next(size_t limit, ltm::QueryServer::Response &res);
+        };
+
+        // Open cursors by continuation token.
+        //
+        // Tokens are single use: each page returns a new token for the rest of the results. Cursors not
+        // continued within the TTL are dropped, as well as the oldest ones when too many are open.
+        class CursorRegistry {
+        private:
+            struct Entry {
+                QueryCursorPtr cursor;
+                ros::WallTime expires;
+            };
+            std::map<std::string, Entry> _cursors;
+            boost::mutex _mutex;
+            double _ttl;
+            size_t _max_cursors;
+            boost::uuids::random_generator _tokens;
+
+            // requires _mutex. Expired cursors are moved to 'dropped', so they are closed without the lock.
+            void expire(std::vector<QueryCursorPtr> &dropped);
+
+        public:
+            CursorRegistry(double ttl = 60.0, size_t max_cursors = 64);
+            virtual ~CursorRegistry();
+
+            void set_options(double ttl, size_t max_cursors);
+
+            // Stores the cursor and returns its continuation token.
+            std::string put(const QueryCursorPtr &cursor);
+
+            // Removes and returns the cursor of a token. Null for unknown or expired tokens.
+            QueryCursorPtr take(const std::string &token);
+
+            void clear();
+            size_t size();
+        };
+
+    }
+}
+
+#endif //LTM_DB_CURSOR_REGISTRY_H
@@ -0,0 +1,19 @@
+#ifndef LTM_DB_LOCK_H
+#define LTM_DB_LOCK_H
+
+#include <boost/thread/recursive_mutex.hpp>
+
+namespace ltm {
+    namespace db {
+
+        typedef boost::recursive_mutex DBMutex;
+        typedef boost::recursive_mutex::scoped_lock DBLock;
+
+        // Guards the ltm_db connection shared by the episode writer and every plugin collection.
+        // The legacy MongoDB client is not thread-safe. Recursive, as collection managers call each other.
+        DBMutex &db_mutex();
+
+    }
+}
+
+#endif //LTM_DB_LOCK_H
@@ -3,6 +3,11 @@
 
 #include <ros/ros.h>
 #include <ltm/db/types.h>
+#include <ltm/db/metered_collection.h>
+#include <ltm/db/index_provisioner.h>
+#include <ltm/db/db_lock.h>
+#include <ltm/db/collection_counter.h>
+#include <ltm/db/query_cache.h>
 #include <ltm/Episode.h>
 #include <ltm/EntityLog.h>
 #include <ltm/EntityMetadata.h>
@@ -29,11 +34,11 @@ namespace ltm {
             typedef boost::shared_ptr<const LogWithMetadata> LogWithMetadataPtr;
 
             // Entity Collection
-            typedef ltm_db::MessageCollection<EntityMsg> EntityCollection;
+            typedef MeteredCollection<EntityMsg> EntityCollection;
             typedef boost::shared_ptr<EntityCollection> EntityCollectionPtr;
 
             // Log Message Collection
-            typedef ltm_db::MessageCollection<LogType> LogCollection;
+            typedef MeteredCollection<LogType> LogCollection;
             typedef boost::shared_ptr<LogCollection> LogCollectionPtr;
 
             // database connection
@@ -54,6 +59,18 @@ namespace ltm {
             std::set<int> _reserved_log_uids;
             std::set<int> _log_uids_cache;
 
+            // document counts, see CollectionCounter
+            CollectionCounter _counter;
+            CollectionCounter _log_counter;
+            CollectionCounter _diff_counter;
+            int db_count();
+            int db_log_count();
+            int db_diff_count();
+
+            // query cache scopes, "<db>.<collection>"
+            std::string _scope;
+            std::string _log_scope;
+            std::string _diff_scope;
 
             MetadataPtr ltm_make_log_metadata(const ltm::EntityLog &log);
             bool ltm_query_log(const std::string& json, ltm::QueryServer::Response &res);
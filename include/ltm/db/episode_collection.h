@@ -1,17 +1,42 @@
 #ifndef LTM_DB_EPISODE_H
 #define LTM_DB_EPISODE_H
 
+#include <map>
 #include <set>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <ltm/db/types.h>
 #include <ltm/Episode.h>
 #include <ltm/QueryServer.h>
+#include <ltm/QueryTags.h>
+#include <ltm/QueryWhen.h>
+#include <ltm/QueryWhere.h>
 #include <ltm/db/episode_metadata.h>
 #include <ltm/db/episode_updater.h>
-
-typedef ltm_db::MessageCollection<ltm::Episode> EpisodeCollection;
+#include <ltm/db/query_aggregator.h>
+#include <ltm/db/index_provisioner.h>
+#include <ltm/db/cursor_registry.h>
+#include <ltm/db/query_cache.h>
+#include <ltm/db/collection_counter.h>
+#include <ltm/db/storage_backend.h>
+#include <ltm/db/episode_query.h>
+#include <ltm/util/thread_pool.h>
+#include <ltm/util/lru_cache.h>
+#include <ltm/util/interval_tree.h>
+#include <ltm/util/spatial_index.h>
+#include <ltm/util/tag_index.h>
+#include <ltm/util/shared_mutex.h>
+#include <ltm/db/db_lock.h>
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/thread/mutex.hpp>
+
+typedef ltm::db::MeteredCollection<ltm::Episode> EpisodeCollection;
 typedef boost::shared_ptr<EpisodeCollection> EpisodeCollectionPtr;
 
 typedef ltm_db::MessageWithMetadata<ltm::Episode> EpisodeWithMetadata;
@@ -34,12 +59,99 @@ namespace ltm {
             // db handlers
             EpisodeCollectionPtr _coll;
 
+            // query cache scope, "<db>.<collection>"
+            std::string _scope;
+
+            // Guards the manager state. Reads run concurrently, writes are exclusive and
+            // also hold db_mutex(), as the shared connection is used by the plugins too.
+            ltm::util::ReentrantSharedMutex _mutex;
+
+            // per-thread read connections, reopened when the generation changes (setup)
+            struct ReadHandle {
+                size_t generation;
+                DBConnectionPtr conn;
+                EpisodeCollectionPtr coll;
+            };
+            boost::thread_specific_ptr<ReadHandle> _read_handle;
+            boost::atomic<size_t> _generation;
+            EpisodeCollectionPtr read_collection();
+
+            // bumped by every write (under the write lock), so readers can tell the episodes changed
+            size_t _version;
+
+            // stored documents, see CollectionCounter
+            CollectionCounter _counter;
+            int db_count();
+
             // reserved uid
             std::set<int> _reserved_uids;
             std::set<int> _db_uids;
-
-
-            bool update_tree_node(int uid, Episode &updated_episode);
+            // uid 0 is never handed out, it is the parent_id of root episodes
+            int _next_uid;
+            // false when the high-water mark could not be read: random uids are probed on the DB
+            bool _sequential_uids;
+
+            // document revisions
+            double _last_revision;
+            double next_revision();
+            void insert_revision(const Episode &episode, double revision);
+            void remove_older_revisions(const std::vector<uint32_t> &uids, double revision);
+
+            // episode cache, by uid
+            ltm::util::LRUCache<uint32_t, EpisodeWithMetadataPtr> _cache;
+            void cache_episode(const EpisodeWithMetadataPtr &episode_ptr);
+
+            // in-memory indexes, rebuilt on setup
+            // when: [when.start, when.end]. where: leaf positions and parent hulls, by map and frame.
+            // tags: tags and children_tags.
+            ltm::util::IntervalTree _when_index;
+            ltm::util::SpatialIndex _where_index;
+            ltm::util::TagIndex _tag_index;
+            void index_episode(const Episode &episode);
+            bool index_metadata(const EpisodeWithMetadata &doc);
+            void unindex_episode(uint32_t uid);
+            void rebuild_indexes();
+            // every stored uid is on the time index, so has() needs no DB read
+            bool _indexes_complete;
+
+            // query options
+            bool _query_sorted;
+            size_t _query_max_results;
+
+            // query results, paged from a DB cursor
+            class Cursor;
+            friend class Cursor;
+
+            // connections of closed cursors, reused by the next ones
+            boost::mutex _cursor_conns_mutex;
+            std::vector<std::pair<size_t, DBConnectionPtr> > _cursor_conns;
+            DBConnectionPtr take_cursor_connection();
+            void release_cursor_connection(const DBConnectionPtr &conn, size_t generation);
+            bool fill_page(ltm_db::QueryResults<Episode>::range_t &range, size_t limit, ltm::QueryServer::Response &res,
+                           bool logging, bool *failed = NULL);
+
+            void reset_uid_allocator();
+            int reserve_random_uid();
+
+            // in-memory subtree, as loaded by load_subtree()
+            struct EpisodeTree {
+                typedef boost::unordered_map<uint32_t, Episode> NodeMap;
+                NodeMap nodes;
+                std::set<uint32_t> missing;
+            };
+            bool load_subtree(uint32_t root, EpisodeTree &tree);
+            // ancestors: the nodes on the current branch, to stop on cycles
+            bool update_tree_node(uint32_t uid, EpisodeTree &tree, std::vector<Episode> &changed,
+                                  boost::unordered_set<uint32_t> &ancestors);
+
+            // parallel tree update
+            boost::scoped_ptr<ltm::util::WorkStealingPool> _tree_pool;
+            size_t _tree_grain;
+            struct ParallelTreeContext;
+            bool update_tree_parallel(uint32_t root, EpisodeTree &tree, std::vector<Episode> &changed);
+            void parallel_node_task(ParallelTreeContext *ctx, uint32_t uid);
+            void parallel_chunk_task(ParallelTreeContext *ctx, uint32_t uid, size_t chunk);
+            void parallel_finish_node(ParallelTreeContext *ctx, uint32_t uid, const Episode &updated, bool result);
 
         public:
             EpisodeCollectionManager (const std::string &name, const std::string &collection, const std::string &host, uint port, float timeout);
@@ -47,21 +159,44 @@ namespace ltm {
 
             std::string to_short_string(const Episode &episode);
             void setup();
+            void set_query_options(bool sorted, int max_results);
+            void set_tree_options(int threads, int grain);
+            void set_cache_options(int max_bytes);
+            void append_status(std::stringstream &status);
 
             // CRUD API
             bool insert(const Episode &episode);
+            bool insert_many(const std::vector<Episode> &episodes);
             bool query(const std::string& json, ltm::QueryServer::Response &res, bool logging=true);
+            bool query(const EpisodeQuery &query, ltm::QueryServer::Response &res, bool logging=true);
+            // Paged query, sorted by a metadata field (e.g., "uid", "when.start"). Null on DB errors.
+            QueryCursorPtr open_cursor(const std::string &json, const std::string &sort_by, bool ascending);
+            QueryCursorPtr open_cursor(const EpisodeQuery &query, const std::string &sort_by, bool ascending);
+            bool query_when(uint8_t mode, const ros::Time &start, const ros::Time &end, std::vector<uint32_t> &uids);
+            bool query_where(const ltm::QueryWhere::Request &req, std::vector<uint32_t> &uids);
+            bool query_tags(const std::string &expression, bool include_children, std::vector<uint32_t> &uids);
             bool get(int uid, EpisodeWithMetadataPtr &episode_ptr);
+            // Episodes in the requested order (once each) and the missing uids. False on DB errors.
+            bool get_many(const std::vector<uint32_t> &uids, std::vector<EpisodeWithMetadataPtr> &episodes, std::vector<uint32_t> &not_found);
             bool update(const Episode &episode);
+            bool update_many(const std::vector<Episode> &episodes);
             bool remove(int uid);
+            bool remove_many(const std::vector<uint32_t> &uids);
 
             // queries
             int reserve_uid();
+            void reserve_fixed_uid(int uid);
             int count();
+            // From the in-memory indexes, the DB is only read when they could not be rebuilt.
             bool has(int uid);
+            // Stored uids among the given ones. False on DB errors.
+            bool has_many(const std::vector<uint32_t> &uids, std::set<uint32_t> &found);
             bool is_reserved(int uid);
             bool update_tree(int uid);
             bool update_from_children(Episode &episode);
+            // Refreshes the parent chain of an added or updated episode. Roots have parent_id 0 (or their own
+            // uid). False when a stored parent does not list the episode in its children_ids, or on cycles.
+            bool update_ancestors(const Episode &episode, bool replaced);
             bool drop_db();
             bool switch_db(const std::string &db_name);
         };
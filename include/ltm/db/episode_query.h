@@ -0,0 +1,72 @@
+#ifndef LTM_DB_EPISODE_QUERY_H
+#define LTM_DB_EPISODE_QUERY_H
+
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <ltm/db/types.h>
+#include <ltm/EpisodeFilter.h>
+
+namespace ltm {
+    namespace db {
+
+        // Typed episode query, as an alternative to raw JSON strings.
+        //
+        // Scalar predicates are appended to the driver query with its typed methods. Set predicates have
+        // no typed counterpart in ltm_db, so they are formatted once into a single JSON fragment, which is
+        // kept until the query changes. A prepared query can be compiled into any number of driver queries,
+        // also concurrently once key() or compile() was called.
+        class EpisodeQuery {
+        public:
+            EpisodeQuery();
+            explicit EpisodeQuery(const ltm::EpisodeFilter &filter);
+
+            // raw MongoDB JSON, ANDed with the typed predicates
+            EpisodeQuery &json(const std::string &json);
+
+            EpisodeQuery &uids(const std::vector<uint32_t> &uids);
+            // overlapping [start, end], zero stamps leave that bound open
+            EpisodeQuery &when(const ros::Time &start, const ros::Time &end);
+            EpisodeQuery &all_tags(const std::vector<std::string> &tags);
+            EpisodeQuery &any_tags(const std::vector<std::string> &tags);
+            EpisodeQuery &location(const std::string &location);
+            EpisodeQuery &area(const std::string &area);
+            EpisodeQuery &emotions(const std::vector<int32_t> &emotions, double min_value);
+            EpisodeQuery &streams(const std::string &type, const std::vector<uint32_t> &uids);
+            EpisodeQuery &entities(const std::string &type, const std::vector<uint32_t> &uids);
+
+            bool empty() const;
+
+            // Appends every predicate to a driver query.
+            void compile(QueryPtr query) const;
+
+            // Canonical text of the query, e.g., as a cache key.
+            const std::string &key() const;
+
+        private:
+            std::string _json;
+            std::vector<uint32_t> _uids;
+            double _start;
+            double _end;
+            std::vector<std::string> _all_tags;
+            std::vector<std::string> _any_tags;
+            std::string _location;
+            std::string _area;
+            std::vector<int32_t> _emotions;
+            double _min_emotion_value;
+            std::string _stream_type;
+            std::vector<uint32_t> _stream_uids;
+            std::string _entity_type;
+            std::vector<uint32_t> _entity_uids;
+
+            // prepared set predicates and key, rebuilt after changes
+            mutable bool _prepared;
+            mutable std::string _sets;
+            mutable std::string _key;
+            void prepare() const;
+        };
+
+    }
+}
+
+#endif //LTM_DB_EPISODE_QUERY_H
@@ -43,6 +43,8 @@ namespace ltm {
             void update_tree_init(Episode &node, EpisodeUpdateHelper &helper);
             bool update_tree_last(Episode &node, EpisodeUpdateHelper &helper);
             bool update_from_child(Episode &node, const Episode &child, EpisodeUpdateHelper &helper);
+            bool update_from_delta(Episode &node, const Episode &child, int n_usages_delta);
+            bool update_from_partial(Episode &node, const Episode &partial, EpisodeUpdateHelper &helper, const EpisodeUpdateHelper &partial_helper);
         };
     }
 }
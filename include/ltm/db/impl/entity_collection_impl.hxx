@@ -3,6 +3,7 @@
 
 #include <ltm/db/entity_collection.h>
 #include <ltm/util/util.h>
+#include <boost/bind.hpp>
 
 namespace ltm {
     namespace db {
@@ -34,6 +35,7 @@ namespace ltm {
 
         template<class EntityMsg>
         std::string EntityCollectionManager<EntityMsg>::ltm_get_status() {
+            DBLock lock(db_mutex());
             std::stringstream ss;
             ss << "Entity '" << _type << "' has (" << ltm_count()
                << ") instances in collection '" << _collection_name
@@ -43,11 +45,22 @@ namespace ltm {
 
         template<class EntityMsg>
         void EntityCollectionManager<EntityMsg>::ltm_resetup_db(const std::string &db_name) {
+            DBLock lock(db_mutex());
             _db_name = db_name;
+            _scope = _db_name + "." + _collection_name;
+            _log_scope = _db_name + "." + _log_collection_name;
+            _diff_scope = _db_name + "." + _diff_collection_name;
+            QueryCache::instance().invalidate(_scope);
+            QueryCache::instance().invalidate(_log_scope);
+            QueryCache::instance().invalidate(_diff_scope);
 
             try {
                 // host, port, timeout
-                _coll = _conn->openCollectionPtr<EntityMsg>(_db_name, _collection_name);
+                _coll = open_collection<EntityMsg>(_conn, _db_name, _collection_name);
+
+                static const char *indexes[] = {"uid", "log_uid"};
+                IndexProvisioner::instance().provision(_db_name, _collection_name, "entities",
+                        std::vector<std::string>(indexes, indexes + sizeof(indexes) / sizeof(indexes[0])));
             }
             catch (const ltm_db::DbConnectException &exception) {
                 // Connection timeout
@@ -56,7 +69,11 @@ namespace ltm {
             }
             try {
                 // host, port, timeout
-                _diff_coll = _conn->openCollectionPtr<EntityMsg>(_db_name, _diff_collection_name);
+                _diff_coll = open_collection<EntityMsg>(_conn, _db_name, _diff_collection_name);
+
+                static const char *indexes[] = {"uid", "log_uid"};
+                IndexProvisioner::instance().provision(_db_name, _diff_collection_name, "entities_trail",
+                        std::vector<std::string>(indexes, indexes + sizeof(indexes) / sizeof(indexes[0])));
             }
             catch (const ltm_db::DbConnectException &exception) {
                 // Connection timeout
@@ -65,7 +82,11 @@ namespace ltm {
             }
             try {
                 // host, port, timeout
-                _log_coll = _conn->openCollectionPtr<LogType>(_db_name, _log_collection_name);
+                _log_coll = open_collection<LogType>(_conn, _db_name, _log_collection_name);
+
+                static const char *indexes[] = {"log_uid", "entity_uid,timestamp", "episode_uids"};
+                IndexProvisioner::instance().provision(_db_name, _log_collection_name, "entities_meta",
+                        std::vector<std::string>(indexes, indexes + sizeof(indexes) / sizeof(indexes[0])));
             }
             catch (const ltm_db::DbConnectException &exception) {
                 // Connection timeout
@@ -78,6 +99,19 @@ namespace ltm {
             }
             // TODO: return value and effect for this.
 
+            if (_coll) {
+                _counter.attach(_scope,
+                                boost::bind(&EntityCollectionManager<EntityMsg>::db_count, this));
+            }
+            if (_log_coll) {
+                _log_counter.attach(_log_scope,
+                                    boost::bind(&EntityCollectionManager<EntityMsg>::db_log_count, this));
+            }
+            if (_diff_coll) {
+                _diff_counter.attach(_diff_scope,
+                                     boost::bind(&EntityCollectionManager<EntityMsg>::db_diff_count, this));
+            }
+
             _registry.clear();
             _log_uids_cache.clear();
             _reserved_log_uids.clear();
@@ -95,6 +129,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_register_episode(uint32_t uid) {
+            DBLock lock(db_mutex());
             // subscribe on demand
             bool subscribe = false;
             if (_registry.empty()) subscribe = true;
@@ -108,6 +143,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_unregister_episode(uint32_t uid) {
+            DBLock lock(db_mutex());
             // unregister from cache
             std::vector<uint32_t>::iterator it = std::find(_registry.begin(), _registry.end(), uid);
             if (it != _registry.end()) _registry.erase(it);
@@ -120,6 +156,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_is_reserved(int uid) {
+            DBLock lock(db_mutex());
             // value is in registry
             std::vector<uint32_t>::iterator it = std::find(_registry.begin(), _registry.end(), uid);
             if (it != _registry.end()) return true;
@@ -132,11 +169,13 @@ namespace ltm {
 
         template<class EntityMsg>
         void EntityCollectionManager<EntityMsg>::ltm_get_registry(std::vector<uint32_t> &registry) {
+            DBLock lock(db_mutex());
             registry = this->_registry;
         }
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_generate_uid() {
+            DBLock lock(db_mutex());
             // TODO: find better way, maybe select the max_uid+1
             // Returns a pseudo-random integral number in the range between 0 and RAND_MAX.
             uint32_t max_int32 = std::numeric_limits<uint32_t>::max();
@@ -148,6 +187,7 @@ namespace ltm {
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_reserve_log_uid() {
+            DBLock lock(db_mutex());
             // TODO: find better way, maybe select the max_uid+1
             // Returns a pseudo-random integral number in the range between 0 and RAND_MAX.
             uint32_t max_int32 = std::numeric_limits<uint32_t>::max();
@@ -192,6 +232,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_remove(uint32_t uid) {
+            DBLock lock(db_mutex());
             // value is already reserved
             std::vector<uint32_t>::iterator it = std::find(_registry.begin(), _registry.end(), uid);
             if (it != _registry.end()) _registry.erase(it);
@@ -202,12 +243,14 @@ namespace ltm {
             // remove from DB
             QueryPtr query = _coll->createQuery();
             query->append("uid", (int) uid);
-            _coll->removeMessages(query);
+            _counter.sub((int) _coll->removeMessages(query));
+            QueryCache::instance().invalidate(_scope);
             return true;
         }
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_has(int uid) {
+            DBLock lock(db_mutex());
             // TODO: doc, no revisa por uids ya registradas
             QueryPtr query = _coll->createQuery();
             query->append("uid", uid);
@@ -222,6 +265,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_log_has(int uid) {
+            DBLock lock(db_mutex());
             // TODO: doc, no revisa por uids ya registradas
             QueryPtr query = _log_coll->createQuery();
             query->append("log_uid", uid);
@@ -236,6 +280,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_diff_has(int uid) {
+            DBLock lock(db_mutex());
             // TODO: doc, no revisa por uids ya registradas
             QueryPtr query = _diff_coll->createQuery();
             query->append("log_uid", uid);
@@ -250,21 +295,40 @@ namespace ltm {
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_count() {
-            return _coll->count();
+            return _counter.get();
         }
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_log_count() {
-            return _log_coll->count();
+            return _log_counter.get();
         }
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_diff_count() {
-            return _diff_coll->count();
+            return _diff_counter.get();
+        }
+
+        template<class EntityMsg>
+        int EntityCollectionManager<EntityMsg>::db_count() {
+            DBLock lock(db_mutex());
+            return _coll ? (int) _coll->count() : 0;
+        }
+
+        template<class EntityMsg>
+        int EntityCollectionManager<EntityMsg>::db_log_count() {
+            DBLock lock(db_mutex());
+            return _log_coll ? (int) _log_coll->count() : 0;
+        }
+
+        template<class EntityMsg>
+        int EntityCollectionManager<EntityMsg>::db_diff_count() {
+            DBLock lock(db_mutex());
+            return _diff_coll ? (int) _diff_coll->count() : 0;
         }
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_drop_db() {
+            DBLock lock(db_mutex());
             ROS_WARN_STREAM("Dropping database for '" << ltm_get_type() << "'. Collections: " << _collection_name << " and {.meta, .trail}.");
             QueryPtr query = _coll->createQuery();
             query->appendGT("uid", -1);
@@ -284,6 +348,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_get_last(uint32_t uid, EntityWithMetadataPtr &entity_ptr) {
+            DBLock lock(db_mutex());
             QueryPtr query = _coll->createQuery();
             query->append("uid", (int) uid);
             try {
@@ -298,6 +363,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_get_diff(uint32_t log_uid, EntityWithMetadataPtr &entity_ptr) {
+            DBLock lock(db_mutex());
             QueryPtr query = _diff_coll->createQuery();
             query->append("log_uid", (int) log_uid);
             try {
@@ -312,6 +378,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_retrace(uint32_t uid, const ros::Time &stamp, EntityMsg &entity) {
+            DBLock lock(db_mutex());
             EntityWithMetadataPtr last_entity_ptr;
             // lookup last information
             if (!this->ltm_get_last(uid, last_entity_ptr)) {
@@ -328,30 +395,27 @@ namespace ltm {
             }
 
             // RETRACE!
-            // Get nearest log (descent order by timestamp)
-            ltm::QueryServer::Response log_resp;
+            // Get the logs up to the stamp, latest first (typed query, sorted by the driver)
+            std::vector<uint32_t> logs;
             double stamp_secs = stamp.sec + stamp.nsec * pow10(-9);
-            std::stringstream log_query_ss;
-            log_query_ss << "{ $query: { entity_uid: " << uid 
-                        << ", timestamp: { $lte: " << std::setprecision(17) << stamp_secs 
-                        << "}}, $orderby: { timestamp: -1}}";
-            // ROS_WARN_STREAM("JSON: " << log_query_ss.str());
-            if(!this->ltm_query_log(log_query_ss.str(), log_resp)) {
-                ROS_ERROR_STREAM("Missing log files for entity (" << uid << ").");
-                return false;
-            }
-            
-            if (log_resp.entities_trail.size() != 1) {
-                ROS_ERROR_STREAM("THIS SHOULD NOT HAPPEN");
+            try {
+                QueryPtr query = _log_coll->createQuery();
+                query->append("entity_uid", (int) uid);
+                query->appendLTE("timestamp", stamp_secs);
+                typename ltm_db::QueryResults<LogType>::range_t range = _log_coll->query(query, true, "timestamp", false);
+                for (; range.first != range.second; ++range.first) {
+                    CostContext::read(1);
+                    logs.push_back((uint32_t) (*range.first)->lookupInt("log_uid"));
+                }
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Error while quering MongoDB for entries in '" << _log_collection_name << "' collection. " << ex.what());
                 return false;
             }
-            if (log_resp.entities_trail[0].uids.empty()) {
-                ROS_ERROR_STREAM("THIS SHOULD NOT HAPPEN");
+            if (logs.empty()) {
+                ROS_ERROR_STREAM("Missing log files for entity (" << uid << ").");
                 return false;
             }
-            // TODO: THIS ASSUMES LOGS ARE ORDERED BY DATE!
-            std::vector<uint32_t> logs = log_resp.entities_trail[0].uids;
-    
+
             // get last log
             ltm::EntityLog recall;
             uint32_t recall_uid = logs.back();
@@ -371,6 +435,7 @@ namespace ltm {
 
         template<class EntityMsg>
         void EntityCollectionManager<EntityMsg>::ltm_retrace_join(EntityMsg &entity, const std::vector<uint32_t> &logs) {
+            DBLock lock(db_mutex());
             // ROS_WARN_STREAM("...RETRACING FROM PLUGIN...");
             entity = this->_null_e;
 
@@ -462,6 +527,7 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_get_log(uint32_t uid, LogType &log) {
+            DBLock lock(db_mutex());
             QueryPtr query = _log_coll->createQuery();
             LogWithMetadataPtr log_ptr;
             query->append("log_uid", (int) uid);
@@ -477,6 +543,7 @@ namespace ltm {
 
         template<class EntityMsg>
         int EntityCollectionManager<EntityMsg>::ltm_get_last_log_uid(uint32_t entity_uid) {
+            DBLock lock(db_mutex());
             QueryPtr query = _coll->createQuery();
             EntityWithMetadataPtr entity_ptr;
             query->append("uid", (int) entity_uid);
@@ -492,86 +559,92 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_query_log(const std::string &json, ltm::QueryServer::Response &res) {
-            // generate query and collect documents.
-            std::vector<LogWithMetadataPtr> result;
+            DBLock lock(db_mutex());
+            // generate query and collect uids, documents are pulled from the cursor one by one.
+            ltm::QueryResult qr, qre;
+            qr.type = this->ltm_get_type();
+            qre.type = this->ltm_get_type();
+            bool failed = false;
             try {
                 QueryPtr query = _log_coll->createQuery();
                 query->append(json);
-                result = _log_coll->queryList(query, true);
+                typename ltm_db::QueryResults<LogType>::range_t range = _log_coll->query(query, true);
+                std::vector<uint32_t> episodes;
+                for (; range.first != range.second; ++range.first) {
+                    LogWithMetadataPtr doc = *range.first;
+                    CostContext::read(1);
+                    qr.uids.push_back((uint32_t) doc->lookupInt("log_uid"));
+                    qre.uids.push_back((uint32_t) doc->lookupInt("entity_uid"));
+
+                    episodes.clear();
+                    doc->lookupUInt32Array("episode_uids", episodes);
+                    res.episodes.insert(res.episodes.end(), episodes.begin(), episodes.end());
+                }
             } catch (const ltm_db::NoMatchingMessageException &exception) {
                 return false;
             } catch (const mongo::exception &ex) {
                 ROS_ERROR_STREAM("Error while quering MongoDB for entries in '" << _log_collection_name << "' collection. " << ex.what());
+                failed = true;
             }
-
-            // fill uids
-            ltm::QueryResult qr, qre;
-            qr.type = this->ltm_get_type();
-            qre.type = this->ltm_get_type();
-            typename std::vector<LogWithMetadataPtr>::const_iterator it;
-            for (it = result.begin(); it != result.end(); ++it) {
-                uint32_t uid = (uint32_t) (*it)->lookupInt("log_uid");
-                uint32_t e_uid = (uint32_t) (*it)->lookupInt("entity_uid");
-
-                // do not repeat entities
-                if (std::find(qre.uids.begin(), qre.uids.end(), e_uid) == qre.uids.end()) {
-                    qre.uids.push_back(e_uid);
-                }
-                qr.uids.push_back(uid);
-
-                std::vector<uint32_t> episodes;
-                (*it)->lookupUInt32Array("episode_uids", episodes);
-                ltm::util::uid_vector_merge(res.episodes, episodes);
-            }
+            // do not repeat entities nor episodes, sorted once instead of merging on every log
+            ltm::util::uid_vector_sort(qre.uids);
+            ltm::util::uid_vector_sort(res.episodes);
             res.entities.push_back(qre);
             res.entities_trail.push_back(qr);
-            ROS_INFO_STREAM("Found (" << result.size() << ") matches, with (" << qr.uids.size()
-                                      << ") entity logs.");
+            if (!failed) QueryCache::instance().put("entity_trail", _type, json, _log_scope, res);
+            ROS_INFO_STREAM("Found (" << qr.uids.size() << ") entity logs of (" << qre.uids.size() << ") entities.");
             return true;
         }
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_query_actual(const std::string &json, ltm::QueryServer::Response &res) {
-            // generate query and collect documents.
-            std::vector<EntityWithMetadataPtr> result;
+            DBLock lock(db_mutex());
+            // generate query and collect uids, documents are pulled from the cursor one by one.
+            ltm::QueryResult qr;
+            qr.type = this->ltm_get_type();
             try {
                 QueryPtr query = _coll->createQuery();
                 query->append(json);
-                result = _coll->queryList(query, true);
+                typename ltm_db::QueryResults<EntityMsg>::range_t range = _coll->query(query, true);
+                for (; range.first != range.second; ++range.first) {
+                    CostContext::read(1);
+                    qr.uids.push_back((uint32_t) (*range.first)->lookupInt("uid"));
+                }
             } catch (const ltm_db::NoMatchingMessageException &exception) {
                 return false;
             } catch (const mongo::exception &ex) {
                 ROS_ERROR_STREAM("Error while quering MongoDB for '" << _type << "' entities. " << ex.what());
-            }
-
-            // fill uids
-            ltm::QueryResult qr;
-            qr.type = this->ltm_get_type();
-            typename std::vector<EntityWithMetadataPtr>::const_iterator it;
-            for (it = result.begin(); it != result.end(); ++it) {
-                uint32_t uid = (uint32_t) (*it)->lookupInt("uid");
-                qr.uids.push_back(uid);
+                res.entities.push_back(qr);
+                return true;
             }
             res.entities.push_back(qr);
-            ROS_INFO_STREAM("Found (" << result.size() << ") matches, with (" << qr.uids.size()
-                                      << ") entities.");
+            QueryCache::instance().put("entity", _type, json, _scope, res);
+            ROS_INFO_STREAM("Found (" << qr.uids.size() << ") entities.");
             return true;
         }
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_query(const std::string &json, ltm::QueryServer::Response &res, bool trail) {
+            DBLock lock(db_mutex());
             res.episodes.clear();
             res.streams.clear();
             res.entities.clear();
             res.entities_trail.clear();
+            if (QueryCache::instance().get(trail ? "entity_trail" : "entity", _type, json, trail ? _log_scope : _scope, res)) {
+                ROS_DEBUG_STREAM("Found cached matches for '" << _type << "' entities.");
+                return true;
+            }
             if (trail) return ltm_query_log(json, res);
             return ltm_query_actual(json, res);
         }
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_insert(const EntityMsg &entity) {
+            DBLock lock(db_mutex());
             // insert
             _coll->insert(entity, this->make_metadata(entity));
+            _counter.add();
+            QueryCache::instance().invalidate(_scope);
             // todo: insert into cache
             ROS_INFO_STREAM(_log_prefix << "Inserting entity (" << entity.meta.uid << ") into collection "
                                         << "'" << _collection_name << "'. (" << ltm_count() << ") entries."
@@ -581,7 +654,10 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_log_insert(const LogType &log) {
+            DBLock lock(db_mutex());
             _log_coll->insert(log, ltm_make_log_metadata(log));
+            _log_counter.add();
+            QueryCache::instance().invalidate(_log_scope);
             // todo: insert into cache
             ROS_DEBUG_STREAM(_log_prefix << "Inserting LOG (" << log.log_uid << ") for entity (" << log.entity_uid
                                         << ") into collection " << "'" << _log_collection_name
@@ -592,7 +668,10 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_diff_insert(const EntityMsg &diff) {
+            DBLock lock(db_mutex());
             _diff_coll->insert(diff, this->make_metadata(diff));
+            _diff_counter.add();
+            QueryCache::instance().invalidate(_diff_scope);
             // todo: insert into cache
             ROS_DEBUG_STREAM(_log_prefix << "Inserting LOG DIFF (" << diff.meta.log_uid << ") for entity (" << diff.meta.uid
                                         << ") into collection " << "'" << _diff_collection_name
@@ -647,11 +726,14 @@ namespace ltm {
 
         template<class EntityMsg>
         bool EntityCollectionManager<EntityMsg>::ltm_update(uint32_t uid, const EntityMsg &entity) {
+            DBLock lock(db_mutex());
             if (!ltm_has(uid)) {
                 ltm_insert(entity);
             }
             ltm_remove(uid);
             _coll->insert(entity, this->make_metadata(entity));
+            _counter.add();
+            QueryCache::instance().invalidate(_scope);
             // todo: insert into cache
             ROS_INFO_STREAM(_log_prefix << "Updating entity (" << entity.meta.uid << ") from collection "
                                         << "'" << _collection_name << "'. (" << ltm_count() << ") entries."
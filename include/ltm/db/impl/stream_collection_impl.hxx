@@ -2,10 +2,17 @@
 #define LTM_PLUGIN_STREAM_COLLECTION_IMPL_HXX
 
 #include <ltm/db/stream_collection.h>
+#include <ltm/util/parameter_server_wrapper.h>
 
 namespace ltm {
     namespace db {
 
+        template<class StreamMsg>
+        StreamCollectionManager<StreamMsg>::~StreamCollectionManager() {
+            // write pending streams while the collection is still open
+            _write_queue.reset();
+        }
+
         template<class StreamMsg>
         std::string StreamCollectionManager<StreamMsg>::ltm_get_type() {
             return _type;
@@ -23,18 +30,31 @@ namespace ltm {
 
         template<class StreamMsg>
         std::string StreamCollectionManager<StreamMsg>::ltm_get_status() {
+            DBLock lock(db_mutex());
             std::stringstream ss;
             ss << "Stream '" << _type << "' has (" << ltm_count() << ") entries in collection '" << _collection_name << "'.";
+            if (_write_queue) ss << " (" << _write_queue->size() << ") pending writes.";
             return ss.str();
         }
 
         template<class StreamMsg>
         void StreamCollectionManager<StreamMsg>::ltm_resetup_db(const std::string &db_name) {
+            DBLock lock(db_mutex());
+            // pending streams belong to the previous database
+            ltm_flush();
             _db_name = db_name;
+            _scope = _db_name + "." + _collection_name;
+            QueryCache::instance().invalidate(_scope);
 
             try {
                 // host, port, timeout
-                _coll = _conn->openCollectionPtr<StreamMsg>(_db_name, _collection_name);
+                _coll = open_collection<StreamMsg>(_conn, _db_name, _collection_name);
+
+                static const char *indexes[] = {"uid", "episode_uid", "start"};
+                IndexProvisioner::instance().provision(_db_name, _collection_name, "streams",
+                        std::vector<std::string>(indexes, indexes + sizeof(indexes) / sizeof(indexes[0])));
+                _counter.attach(_scope,
+                                boost::bind(&StreamCollectionManager<StreamMsg>::db_count, this));
             }
             catch (const ltm_db::DbConnectException &exception) {
                 // Connection timeout
@@ -57,10 +77,23 @@ namespace ltm {
             _type = type;
             _conn = db_ptr;
             this->ltm_resetup_db(db_name);
+
+            ltm::util::ParameterServerWrapper psw;
+            bool write_behind;
+            int capacity, batch;
+            psw.getParameter("write_behind/enabled", write_behind, false);
+            psw.getParameter("write_behind/capacity", capacity, 1000);
+            psw.getParameter("write_behind/batch", batch, 100);
+            if (write_behind) {
+                // the writer holds the DB mutex per batch, so ltm_flush() works from any ltm_* method
+                _write_queue.reset(new StreamQueue(boost::bind(&StreamCollectionManager<StreamMsg>::write_queued, this, _1),
+                                                   (size_t) std::max(capacity, 1), (size_t) std::max(batch, 1), &db_mutex()));
+            }
         }
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_register_episode(uint32_t uid) {
+            DBLock lock(db_mutex());
             ROS_DEBUG_STREAM(_log_prefix << "Registering episode " << uid);
 
             // subscribe on demand
@@ -76,6 +109,7 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_unregister_episode(uint32_t uid) {
+            DBLock lock(db_mutex());
             ROS_DEBUG_STREAM(_log_prefix << "Unregistering episode " << uid);
 
             // unregister from cache
@@ -90,6 +124,7 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_is_reserved(int uid) {
+            DBLock lock(db_mutex());
             // value is in registry
             std::vector<uint32_t>::iterator it = std::find(_registry.begin(), _registry.end(), uid);
             if (it != _registry.end()) return true;
@@ -102,6 +137,8 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_remove(uint32_t uid) {
+            DBLock lock(db_mutex());
+            ltm_flush();
             // value is already reserved
             std::vector<uint32_t>::iterator it = std::find(_registry.begin(), _registry.end(), uid);
             if (it != _registry.end()) _registry.erase(it);
@@ -112,12 +149,17 @@ namespace ltm {
             // remove from DB
             QueryPtr query = _coll->createQuery();
             query->append("uid", (int) uid);
-            _coll->removeMessages(query);
+            _counter.sub((int) _coll->removeMessages(query));
+            QueryCache::instance().invalidate(_scope);
             return true;
         }
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_has(int uid) {
+            DBLock lock(db_mutex());
+            QueuedStream pending;
+            if (_write_queue && _write_queue->find((uint32_t) uid, pending)) return true;
+
             // TODO: doc, no revisa por uids ya registradas
             QueryPtr query = _coll->createQuery();
             query->append("uid", uid);
@@ -132,12 +174,20 @@ namespace ltm {
 
         template<class StreamMsg>
         int StreamCollectionManager<StreamMsg>::ltm_count() {
-            return _coll->count();
+            return _counter.get();
+        }
+
+        template<class StreamMsg>
+        int StreamCollectionManager<StreamMsg>::db_count() {
+            DBLock lock(db_mutex());
+            return _coll ? (int) _coll->count() : 0;
         }
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_drop_db() {
+            DBLock lock(db_mutex());
             ROS_WARN_STREAM("Dropping database for '" << ltm_get_type() << "'. Collection " << _collection_name << ".");
+            ltm_flush();
             QueryPtr query = _coll->createQuery();
             query->appendGT("uid", -1);
             _coll->removeMessages(query);
@@ -148,6 +198,13 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_get(uint32_t uid, StreamWithMetadataPtr &stream_ptr) {
+            DBLock lock(db_mutex());
+            QueuedStream pending;
+            if (_write_queue && _write_queue->find(uid, pending)) {
+                stream_ptr.reset(new StreamWithMetadata(pending.first, pending.second));
+                return true;
+            }
+
             QueryPtr query = _coll->createQuery();
             query->append("uid", (int) uid);
             try {
@@ -162,58 +219,98 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_query(const std::string &json, ltm::QueryServer::Response &res) {
-            std::vector<StreamWithMetadataPtr> result;
+            DBLock lock(db_mutex());
+            ltm_flush();
             res.episodes.clear();
             res.streams.clear();
             res.entities.clear();
+            if (QueryCache::instance().get("stream", _type, json, _scope, res)) {
+                ROS_DEBUG_STREAM("Found (" << res.streams[0].uids.size() << ") cached matches for '" << _type << "' streams.");
+                return true;
+            }
 
-            // generate query and collect documents.
+            // generate query and collect uids, documents are pulled from the cursor one by one.
+            QueryResult qr;
+            qr.type = this->ltm_get_type();
             try {
                 QueryPtr query = _coll->createQuery();
                 query->append(json);
-                result = _coll->queryList(query, true);
+                typename ltm_db::QueryResults<StreamMsg>::range_t range = _coll->query(query, true);
+                for (; range.first != range.second; ++range.first) {
+                    StreamWithMetadataPtr doc = *range.first;
+                    CostContext::read(1);
+                    qr.uids.push_back((uint32_t) doc->lookupInt("uid"));
+                    res.episodes.push_back((uint32_t) doc->lookupInt("episode_uid"));
+                }
             } catch (const ltm_db::NoMatchingMessageException &exception) {
                 return false;
             } catch (const mongo::exception &ex) {
                 ROS_ERROR_STREAM("Error while quering MongoDB for '" << _type << "' streams. " << ex.what());
-            }
-
-            // fill uids
-            QueryResult qr;
-            qr.type = this->ltm_get_type();
-            typename std::vector<StreamWithMetadataPtr>::const_iterator it;
-            for (it = result.begin(); it != result.end(); ++it) {
-                uint32_t uid = (uint32_t) (*it)->lookupInt("uid");
-                uint32_t episode_uid = (uint32_t) (*it)->lookupInt("episode_uid");
-
-                qr.uids.push_back(uid);
-                res.episodes.push_back(episode_uid);
+                res.streams.push_back(qr);
+                return true;
             }
             res.streams.push_back(qr);
-            ROS_INFO_STREAM("Found (" << result.size() << ") matches, with (" << qr.uids.size()
-                                      << ") streams and (" << res.episodes.size() << ") episodes.");
+            QueryCache::instance().put("stream", _type, json, _scope, res);
+            ROS_INFO_STREAM("Found (" << qr.uids.size() << ") streams on (" << res.episodes.size() << ") episodes.");
             return true;
         }
 
         template<class StreamMsg>
-        bool StreamCollectionManager<StreamMsg>::ltm_insert(const StreamMsg &stream, MetadataPtr metadata) {
-            // add common metadata for streams
+        void StreamCollectionManager<StreamMsg>::append_common_metadata(const StreamMsg &stream, MetadataPtr metadata) {
             metadata->append("uid", (int) stream.meta.uid);
             metadata->append("episode_uid", (int) stream.meta.episode);
             double _start = stream.meta.start.sec + stream.meta.start.nsec * pow10(-9);
             double _end = stream.meta.end.sec + stream.meta.end.nsec * pow10(-9);
             metadata->append("start", _start);
             metadata->append("end", _end);
+        }
+
+        template<class StreamMsg>
+        bool StreamCollectionManager<StreamMsg>::ltm_insert(const StreamMsg &stream, MetadataPtr metadata) {
+            DBLock lock(db_mutex());
+            // add common metadata for streams
+            append_common_metadata(stream, metadata);
 
             // insert
             _coll->insert(stream, metadata);
+            _counter.add();
+            QueryCache::instance().invalidate(_scope);
             // todo: insert into cache
-            ROS_INFO_STREAM(_log_prefix << "Inserting stream (" << stream.meta.uid << ") into collection "
-                                        << "'" << _collection_name << "'. (" << ltm_count() << ") entries."
-            );
+            ROS_DEBUG_STREAM(_log_prefix << "Inserting stream (" << stream.meta.uid << ") into collection "
+                                         << "'" << _collection_name << "'.");
+            return true;
+        }
+
+        template<class StreamMsg>
+        bool StreamCollectionManager<StreamMsg>::ltm_enqueue(const StreamMsg &stream, MetadataPtr metadata) {
+            if (!_write_queue) return ltm_insert(stream, metadata);
+
+            // metadata is completed now, so pending streams can be served by ltm_get()
+            append_common_metadata(stream, metadata);
+            _write_queue->push(stream.meta.uid, QueuedStream(stream, metadata));
             return true;
         }
 
+        template<class StreamMsg>
+        void StreamCollectionManager<StreamMsg>::ltm_flush() {
+            if (_write_queue) _write_queue->flush();
+        }
+
+        template<class StreamMsg>
+        void StreamCollectionManager<StreamMsg>::write_queued(const std::vector<typename StreamQueue::Entry> &entries) {
+            DBLock lock(db_mutex());
+            // a request of its own on the queue thread, nested in the flushing one otherwise
+            RequestScope request(ltm::util::MetricsRegistry::instance().service(_collection_name + "/write_behind"));
+            typename std::vector<typename StreamQueue::Entry>::const_iterator it;
+            for (it = entries.begin(); it != entries.end(); ++it) {
+                _coll->insert(it->second.first, it->second.second);
+                _counter.add();
+            }
+            QueryCache::instance().invalidate(_scope);
+            ROS_DEBUG_STREAM(_log_prefix << "Inserted (" << entries.size() << ") queued streams into collection "
+                                         << "'" << _collection_name << "'.");
+        }
+
         template<class StreamMsg>
         MetadataPtr StreamCollectionManager<StreamMsg>::ltm_create_metadata() {
             return _coll->createMetadata();
@@ -221,6 +318,7 @@ namespace ltm {
 
         template<class StreamMsg>
         bool StreamCollectionManager<StreamMsg>::ltm_update(uint32_t uid, const StreamMsg &stream) {
+            DBLock lock(db_mutex());
             ROS_WARN("UPDATE: Method not implemented");
             return false;
         }
@@ -0,0 +1,52 @@
+#ifndef LTM_DB_INDEX_PROVISIONER_H
+#define LTM_DB_INDEX_PROVISIONER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <mongo/client/dbclient.h>
+
+namespace ltm {
+    namespace db {
+
+        // Creates secondary indexes for the LTM collections.
+        //
+        // Indexes are declared per collection kind under the "~indexes/<key>" parameter, as a list of
+        // specs. Each spec is a comma separated list of fields, e.g., "entity_uid,timestamp". A leading
+        // '-' makes a field descending. When the parameter is missing, the collection defaults are used.
+        //
+        // ltm_db does not expose index management, so a dedicated MongoDB connection is used for this.
+        class IndexProvisioner {
+        private:
+            boost::scoped_ptr<mongo::DBClientConnection> _client;
+            std::string _host;
+            int _port;
+            bool _connected;
+            boost::mutex _mutex;
+
+            // provisioned namespaces, by collection name
+            std::map<std::string, std::string> _namespaces;
+
+            IndexProvisioner();
+            bool connect();
+            mongo::BSONObj parse_spec(const std::string &spec);
+
+        public:
+            static IndexProvisioner &instance();
+            virtual ~IndexProvisioner();
+
+            // Ensures the indexes for "<db_name>.<collection>". Existing indexes are left untouched.
+            bool provision(const std::string &db_name, const std::string &collection, const std::string &key,
+                           const std::vector<std::string> &defaults);
+
+            // Lists the indexes that exist on every provisioned collection.
+            void append_status(std::stringstream &status);
+        };
+
+    }
+}
+
+#endif //LTM_DB_INDEX_PROVISIONER_H
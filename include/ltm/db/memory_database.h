@@ -0,0 +1,194 @@
+#ifndef LTM_DB_MEMORY_DATABASE_H
+#define LTM_DB_MEMORY_DATABASE_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <ltm_db/interface/database_connection.h>
+#include <ltm/util/json_value.h>
+
+namespace ltm {
+    namespace db {
+
+        // In-process implementation of the ltm_db interface, see StorageBackend.
+        //
+        // Messages are kept serialized, next to their metadata document. Queries scan the collection with
+        // the MongoDB query subset LTM uses: equality, $lt, $lte, $gt, $gte, $ne, $in, $nin, $all, $exists,
+        // $size, $elemMatch, $not, $and, $or and $nor, over dotted paths and arrays.
+
+        class MemoryQuery : public ltm_db::Query {
+        private:
+            // ANDed query documents
+            std::vector<ltm::util::JsonValue> _clauses;
+            bool _valid;
+
+            void append_condition(const std::string &name, const std::string &op, const ltm::util::JsonValue &value);
+
+        public:
+            MemoryQuery();
+            virtual ~MemoryQuery();
+
+            void append(const std::string &json);
+            void append(const std::string &name, const std::string &val);
+            void append(const std::string &name, const double val);
+            void append(const std::string &name, const int val);
+            void append(const std::string &name, const bool val);
+            void appendLT(const std::string &name, const double val);
+            void appendLT(const std::string &name, const int val);
+            void appendLTE(const std::string &name, const double val);
+            void appendLTE(const std::string &name, const int val);
+            void appendGT(const std::string &name, const double val);
+            void appendGT(const std::string &name, const int val);
+            void appendGTE(const std::string &name, const double val);
+            void appendGTE(const std::string &name, const int val);
+            void appendRange(const std::string &name, const double lower, const double upper);
+            void appendRangeInclusive(const std::string &name, const double lower, const double upper);
+
+            // false for queries with invalid JSON, which match nothing
+            bool matches(const ltm::util::JsonValue &document) const;
+            std::string to_string() const;
+
+            // Matches a single query document.
+            static bool matches(const ltm::util::JsonValue &document, const ltm::util::JsonValue &query);
+        };
+
+        class MemoryMetadata : public ltm_db::Metadata {
+        private:
+            ltm::util::JsonValue _doc;
+
+        public:
+            MemoryMetadata();
+            explicit MemoryMetadata(const ltm::util::JsonValue &doc);
+            virtual ~MemoryMetadata();
+
+            const ltm::util::JsonValue &document() const;
+            ltm::util::JsonValue &document();
+
+            void append(const std::string &name, const std::string &val);
+            void append(const std::string &name, const double val);
+            void append(const std::string &name, const int val);
+            void append(const std::string &name, const bool val);
+            void append(const std::string &name, const std::vector<std::string> &val);
+            void append(const std::string &name, const std::vector<uint32_t> &val);
+            void append(const std::string &name, const std::vector<int32_t> &val);
+            void append(const std::string &name, const std::vector<float> &val);
+            void appendMeta(const std::string &name, ltm_db::Metadata::ConstPtr val);
+            void appendMeta(const std::string &name, const std::vector<ltm_db::Metadata::ConstPtr> &val);
+
+            std::string lookupString(const std::string &name) const;
+            double lookupDouble(const std::string &name) const;
+            int lookupInt(const std::string &name) const;
+            bool lookupBool(const std::string &name) const;
+            bool lookupField(const std::string &name) const;
+            std::set<std::string> lookupFieldNames() const;
+            void lookupUInt32Array(const std::string &name, std::vector<uint32_t> &val) const;
+            void lookupStringArray(const std::string &name, std::vector<std::string> &val) const;
+        };
+        typedef boost::shared_ptr<const MemoryMetadata> MemoryMetadataConstPtr;
+
+        struct MemoryDocument {
+            MemoryMetadataConstPtr metadata;
+            std::string message;
+        };
+        typedef boost::shared_ptr<const MemoryDocument> MemoryDocumentPtr;
+
+        // Documents of a single collection, shared by every connection.
+        struct MemoryCollectionData {
+            std::string datatype;
+            std::string md5;
+            std::vector<MemoryDocumentPtr> documents;
+            boost::shared_mutex mutex;
+        };
+        typedef boost::shared_ptr<MemoryCollectionData> MemoryCollectionDataPtr;
+
+        // Query results, a snapshot taken when the query runs.
+        class MemoryResultIterator : public ltm_db::ResultIteratorHelper {
+        private:
+            std::vector<MemoryDocumentPtr> _documents;
+            size_t _current;
+
+        public:
+            explicit MemoryResultIterator(const std::vector<MemoryDocumentPtr> &documents);
+            virtual ~MemoryResultIterator();
+
+            bool next();
+            bool hasData() const;
+            ltm_db::Metadata::ConstPtr metadata() const;
+            std::string message() const;
+        };
+
+        class MemoryMessageCollection : public ltm_db::MessageCollectionHelper {
+        private:
+            std::string _name;
+            MemoryCollectionDataPtr _data;
+
+            // NULL for queries of other backends
+            static const MemoryQuery *cast_query(ltm_db::Query::ConstPtr query);
+            void find(ltm_db::Query::ConstPtr query, std::vector<MemoryDocumentPtr> &found) const;
+
+        public:
+            MemoryMessageCollection(const std::string &name, MemoryCollectionDataPtr data);
+            virtual ~MemoryMessageCollection();
+
+            bool initialize(const std::string &datatype, const std::string &md5);
+            void insert(char *msg, size_t msg_size, ltm_db::Metadata::ConstPtr metadata);
+            ltm_db::ResultIteratorHelper::Ptr query(ltm_db::Query::ConstPtr query, const std::string &sort_by = "",
+                                                    bool ascending = true) const;
+            unsigned removeMessages(ltm_db::Query::ConstPtr query);
+            void modifyMetadata(ltm_db::Query::ConstPtr query, ltm_db::Metadata::ConstPtr metadata);
+            unsigned count();
+            std::string collectionName() const;
+            ltm_db::Query::Ptr createQuery() const;
+            ltm_db::Metadata::Ptr createMetadata() const;
+            ltm_db::Metadata::Ptr createNestedMetadata() const;
+        };
+
+        // Every in-memory database of the process. Thread-safe.
+        class MemoryStore {
+        private:
+            // collections by database and name
+            typedef std::map<std::string, MemoryCollectionDataPtr> CollectionMap;
+            std::map<std::string, CollectionMap> _databases;
+            boost::mutex _mutex;
+
+            MemoryStore();
+
+        public:
+            static MemoryStore &instance();
+            virtual ~MemoryStore();
+
+            MemoryCollectionDataPtr collection(const std::string &db_name, const std::string &collection_name);
+            // Removes every document. Open collections stay valid, as they do on MongoDB.
+            void drop(const std::string &db_name);
+            void append_status(std::stringstream &status);
+        };
+
+        class MemoryDatabaseConnection : public ltm_db::DatabaseConnection {
+        private:
+            bool _connected;
+
+        public:
+            MemoryDatabaseConnection();
+            virtual ~MemoryDatabaseConnection();
+
+            bool setParams(const std::string &host, unsigned port, float timeout = 60.0);
+            bool setTimeout(float timeout);
+            bool connect();
+            bool isConnected();
+            void dropDatabase(const std::string &db_name);
+            std::string messageType(const std::string &db_name, const std::string &collection_name);
+
+        protected:
+            ltm_db::MessageCollectionHelper::Ptr openCollectionHelper(const std::string &db_name,
+                                                                      const std::string &collection_name);
+        };
+
+    }
+}
+
+#endif //LTM_DB_MEMORY_DATABASE_H
@@ -0,0 +1,148 @@
+#ifndef LTM_DB_METERED_COLLECTION_H
+#define LTM_DB_METERED_COLLECTION_H
+
+#include <string>
+#include <vector>
+#include <ros/serialization.h>
+#include <ltm/db/types.h>
+#include <ltm/db/request_cost.h>
+#include <ltm/util/metrics.h>
+
+namespace ltm {
+    namespace db {
+
+        // ltm_db::MessageCollection that records the latency of every DB operation on the
+        // MetricsRegistry ("findOne", "queryList", "query", "insert", "remove", "count", "modifyMetadata"),
+        // and accounts it on the current CostContext, with the documents it returns.
+        //
+        // query() results are read lazily, so its latency only covers running the query.
+        template<class M>
+        class MeteredCollection {
+        public:
+            typedef ltm_db::MessageCollection<M> Collection;
+            typedef boost::shared_ptr<Collection> CollectionPtr;
+            typedef boost::shared_ptr<const ltm_db::MessageWithMetadata<M> > MessagePtr;
+            typedef typename ltm_db::QueryResults<M>::range_t Range;
+
+        private:
+            CollectionPtr _coll;
+            ltm::util::LatencyHistogram *_histograms[CostContext::OPERATIONS];
+
+            // a single DB call
+            class Call {
+            private:
+                ltm::util::LatencyHistogram &_histogram;
+                CostContext::Operation _operation;
+                ros::WallTime _start;
+            public:
+                Call(const MeteredCollection &coll, CostContext::Operation operation)
+                        : _histogram(*coll._histograms[operation]), _operation(operation),
+                          _start(ros::WallTime::now()) {}
+                ~Call() {
+                    ros::WallDuration elapsed = ros::WallTime::now() - _start;
+                    _histogram.record(elapsed);
+                    CostContext *cost = CostContext::current();
+                    if (cost) cost->add_call(_operation, elapsed);
+                }
+            };
+
+            // Metadata-only reads return a default message, only their document is counted.
+            static void read(const MessagePtr &msg, bool metadata_only) {
+                CostContext *cost = CostContext::current();
+                if (!cost || !msg) return;
+                size_t bytes = metadata_only ? 0 : ros::serialization::serializationLength(static_cast<const M &>(*msg));
+                cost->add_read(1, bytes);
+            }
+
+        public:
+            explicit MeteredCollection(CollectionPtr coll) : _coll(coll) {
+                ltm::util::MetricsRegistry &metrics = ltm::util::MetricsRegistry::instance();
+                _histograms[CostContext::FIND_ONE] = &metrics.db("findOne");
+                _histograms[CostContext::QUERY_LIST] = &metrics.db("queryList");
+                _histograms[CostContext::QUERY] = &metrics.db("query");
+                _histograms[CostContext::INSERT] = &metrics.db("insert");
+                _histograms[CostContext::REMOVE] = &metrics.db("remove");
+                _histograms[CostContext::COUNT] = &metrics.db("count");
+                _histograms[CostContext::MODIFY] = &metrics.db("modifyMetadata");
+            }
+
+            void insert(const M &msg, Metadata::ConstPtr metadata = Metadata::ConstPtr()) {
+                Call call(*this, CostContext::INSERT);
+                if (metadata) _coll->insert(msg, metadata);
+                else _coll->insert(msg);
+            }
+
+            Range query(Query::ConstPtr query, bool metadata_only = false, const std::string &sort_by = "",
+                        bool ascending = true) const {
+                Call call(*this, CostContext::QUERY);
+                return _coll->query(query, metadata_only, sort_by, ascending);
+            }
+
+            std::vector<MessagePtr> queryList(Query::ConstPtr query, bool metadata_only = false,
+                                              const std::string &sort_by = "", bool ascending = true) const {
+                std::vector<MessagePtr> msgs;
+                {
+                    Call call(*this, CostContext::QUERY_LIST);
+                    msgs = _coll->queryList(query, metadata_only, sort_by, ascending);
+                }
+                if (CostContext::current()) {
+                    typename std::vector<MessagePtr>::const_iterator it;
+                    for (it = msgs.begin(); it != msgs.end(); ++it) read(*it, metadata_only);
+                }
+                return msgs;
+            }
+
+            MessagePtr findOne(Query::ConstPtr query, bool metadata_only = false) const {
+                MessagePtr msg;
+                {
+                    Call call(*this, CostContext::FIND_ONE);
+                    msg = _coll->findOne(query, metadata_only);
+                }
+                read(msg, metadata_only);
+                return msg;
+            }
+
+            unsigned removeMessages(Query::ConstPtr query) {
+                Call call(*this, CostContext::REMOVE);
+                return _coll->removeMessages(query);
+            }
+
+            void modifyMetadata(Query::ConstPtr query, Metadata::ConstPtr metadata) {
+                Call call(*this, CostContext::MODIFY);
+                _coll->modifyMetadata(query, metadata);
+            }
+
+            unsigned count() {
+                Call call(*this, CostContext::COUNT);
+                return _coll->count();
+            }
+
+            QueryPtr createQuery() const {
+                return _coll->createQuery();
+            }
+
+            MetadataPtr createMetadata() const {
+                return _coll->createMetadata();
+            }
+
+            MetadataPtr createNestedMetadata() const {
+                return _coll->createNestedMetadata();
+            }
+
+            std::string collectionName() const {
+                return _coll->collectionName();
+            }
+        };
+
+        // Opens a metered collection on the connection.
+        template<class M>
+        boost::shared_ptr<MeteredCollection<M> > open_collection(DBConnectionPtr conn, const std::string &db_name,
+                                                                 const std::string &collection_name) {
+            return boost::shared_ptr<MeteredCollection<M> >(
+                    new MeteredCollection<M>(conn->openCollectionPtr<M>(db_name, collection_name)));
+        }
+
+    }
+}
+
+#endif //LTM_DB_METERED_COLLECTION_H
@@ -0,0 +1,61 @@
+#ifndef LTM_DB_QUERY_AGGREGATOR_H
+#define LTM_DB_QUERY_AGGREGATOR_H
+
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <ltm/QueryServer.h>
+
+namespace ltm {
+    namespace db {
+
+        // Collects the uids matched by a query, keeping unique values for each semantic type.
+        // Lookups are O(1), so the aggregation is linear on the number of registers.
+        class QueryAggregator {
+        private:
+            typedef boost::unordered_set<uint32_t> UidSet;
+
+            struct UidList {
+                std::vector<uint32_t> uids;
+                UidSet visited;
+                bool add(uint32_t uid);
+            };
+            typedef boost::unordered_map<std::string, UidList> TypeMap;
+
+            // options
+            bool _sorted;
+            size_t _max_results;
+
+            // results
+            UidList _episodes;
+            TypeMap _streams;
+            TypeMap _entities;
+            size_t _stream_cnt;
+            size_t _entity_cnt;
+
+            void fill_list(const UidList &list, std::vector<uint32_t> &uids);
+            void fill_types(const TypeMap &types, std::vector<ltm::QueryResult> &results);
+
+        public:
+            // sorted: uids are returned in ascending order, instead of the insertion order.
+            // max_results: max number of uids for each list. 0 means no limit.
+            QueryAggregator(bool sorted = false, size_t max_results = 0);
+
+            void add_episode(uint32_t uid);
+            void add_stream(const std::string &type, uint32_t uid);
+            void add_entity(const std::string &type, uint32_t uid);
+
+            // number of unique instances, before applying the limits
+            size_t episodes_count() const;
+            size_t streams_count() const;
+            size_t entities_count() const;
+            size_t stream_types_count() const;
+            size_t entity_types_count() const;
+
+            void fill(ltm::QueryServer::Response &res);
+        };
+    }
+}
+
+#endif //LTM_DB_QUERY_AGGREGATOR_H
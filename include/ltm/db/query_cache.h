@@ -0,0 +1,71 @@
+#ifndef LTM_DB_QUERY_CACHE_H
+#define LTM_DB_QUERY_CACHE_H
+
+#include <string>
+#include <sstream>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ltm/QueryServer.h>
+#include <ltm/util/lru_cache.h>
+
+namespace ltm {
+    namespace db {
+
+        // Results of repeated db/query requests, keyed by (target, semantic type, normalized json).
+        //
+        // Each entry belongs to the collection it was read from (its scope, e.g., "ltm_db.episodes").
+        // Writes on a collection invalidate every entry of its scope, so results are never stale.
+        // Only the matches are cached, per request fields (continuation, cost) are left untouched.
+        // Disabled until the Server sets its options. All methods are thread-safe.
+        class QueryCache {
+        private:
+            struct Entry {
+                std::vector<uint32_t> episodes;
+                std::vector<ltm::QueryResult> streams;
+                std::vector<ltm::QueryResult> entities;
+                std::vector<ltm::QueryResult> entities_trail;
+                std::string scope;
+                size_t generation;
+            };
+            ltm::util::LRUCache<std::string, Entry> _cache;
+
+            // bumped by invalidate()
+            boost::unordered_map<std::string, size_t> _generations;
+            size_t _hits;
+            size_t _misses;
+            size_t _invalidations;
+            boost::mutex _mutex;
+
+            QueryCache();
+            static std::string make_key(const std::string &target, const std::string &type, const std::string &json);
+            static size_t cost(const std::string &key, const Entry &entry);
+
+        public:
+            static QueryCache &instance();
+            virtual ~QueryCache();
+
+            // max_bytes <= 0: disabled
+            void set_options(int max_bytes);
+            bool enabled() const;
+
+            // Callers must hold the lock the scope writers take, so no write can run between
+            // reading the results and put().
+            bool get(const std::string &target, const std::string &type, const std::string &json,
+                     const std::string &scope, ltm::QueryServer::Response &res);
+            void put(const std::string &target, const std::string &type, const std::string &json,
+                     const std::string &scope, const ltm::QueryServer::Response &res);
+
+            // Drops the results read from a collection. Called on every write to it.
+            void invalidate(const std::string &scope);
+            void clear();
+
+            void append_status(std::stringstream &status);
+
+            // Removes the whitespace outside of quoted strings.
+            static std::string normalize(const std::string &json);
+        };
+
+    }
+}
+
+#endif //LTM_DB_QUERY_CACHE_H
@@ -0,0 +1,104 @@
+#ifndef LTM_DB_REQUEST_COST_H
+#define LTM_DB_REQUEST_COST_H
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <ros/time.h>
+#include <ltm/RequestCost.h>
+#include <ltm/util/metrics.h>
+
+namespace ltm {
+    namespace db {
+
+        // DB work done on behalf of a request: calls by operation, documents read, bytes of the messages
+        // and time spent in the driver. Filled by MeteredCollection for the context current on the thread.
+        //
+        // Documents pulled lazily from query() cursors are added by the code iterating them (see read()).
+        // Counters are atomic, so tasks run on other threads for the request can share it (see CostScope).
+        class CostContext : boost::noncopyable {
+        public:
+            enum Operation {
+                FIND_ONE = 0,
+                QUERY_LIST,
+                QUERY,
+                INSERT,
+                REMOVE,
+                COUNT,
+                MODIFY,
+                OPERATIONS
+            };
+
+            CostContext();
+
+            void add_call(Operation operation, const ros::WallDuration &elapsed);
+            void add_read(size_t documents, size_t bytes);
+            void add(const CostContext &other);
+
+            size_t calls() const;
+            size_t documents() const;
+            size_t bytes() const;
+            ros::WallDuration db_time() const;
+
+            // e.g., "12 DB calls (findOne: 11, query: 1), 40 documents, 2048 bytes, 3.2 ms in DB"
+            std::string to_string() const;
+            void to_msg(ltm::RequestCost &msg) const;
+
+            // NULL when no request is being served by this thread
+            static CostContext *current();
+            // Adds documents to the current context, if any.
+            static void read(size_t documents, size_t bytes = 0);
+
+        private:
+            friend class RequestScope;
+            friend class CostScope;
+            boost::atomic<size_t> _calls[OPERATIONS];
+            boost::atomic<size_t> _documents;
+            boost::atomic<size_t> _bytes;
+            boost::atomic<int64_t> _db_time_ns;
+
+            static void set_current(CostContext *cost);
+        };
+
+        // Installs a context on this thread while in scope, e.g., on pool tasks working for a request.
+        // The one current when the task was submitted is passed in, NULL for none.
+        class CostScope : boost::noncopyable {
+        private:
+            CostContext *_outer;
+
+        public:
+            explicit CostScope(CostContext *cost);
+            ~CostScope();
+        };
+
+        // A ROS service request. Records its latency on the histogram and accounts the DB work it runs on this
+        // thread on its own CostContext. Nested requests (e.g., plugin services called by the server) add their
+        // cost to the outer one. Requests slower than the threshold log their cost.
+        class RequestScope : boost::noncopyable {
+        private:
+            ltm::util::LatencyHistogram &_histogram;
+            ros::WallTime _start;
+            CostContext *_outer;
+            CostContext _cost;
+            ltm::RequestCost *_report;
+
+            // microseconds, 0: disabled
+            static boost::atomic<uint64_t> _slow_threshold;
+
+        public:
+            explicit RequestScope(ltm::util::LatencyHistogram &histogram);
+            ~RequestScope();
+
+            const CostContext &cost() const;
+
+            // Fills the message when the request ends, e.g., a service response field.
+            void report(ltm::RequestCost &msg);
+
+            static void set_slow_threshold(double seconds);
+        };
+
+    }
+}
+
+#endif //LTM_DB_REQUEST_COST_H
@@ -0,0 +1,41 @@
+#ifndef LTM_DB_STORAGE_BACKEND_H
+#define LTM_DB_STORAGE_BACKEND_H
+
+#include <string>
+#include <sstream>
+#include <ltm/db/types.h>
+
+namespace ltm {
+    namespace db {
+
+        // Selects where the LTM collections are stored, through the "~backend" parameter:
+        // - "mongo": a MongoDB server (default).
+        // - "memory": in-process collections, shared by every connection and lost on exit. No server is
+        //   required, e.g., for benchmarks or an offline robot.
+        //
+        // Both backends are compiled in: the package still builds and links against the MongoDB driver, as
+        // the collection managers catch mongo::exception and the IndexProvisioner talks to the server.
+        class StorageBackend {
+        private:
+            std::string _name;
+            bool _memory;
+
+            StorageBackend();
+
+        public:
+            static StorageBackend &instance();
+            virtual ~StorageBackend();
+
+            const std::string &name() const;
+            bool is_memory() const;
+
+            // New connection, still to be connected with setParams() and connect().
+            DBConnectionPtr create_connection() const;
+
+            void append_status(std::stringstream &status);
+        };
+
+    }
+}
+
+#endif //LTM_DB_STORAGE_BACKEND_H
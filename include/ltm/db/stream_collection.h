@@ -3,6 +3,12 @@
 
 #include <ros/ros.h>
 #include <ltm/db/types.h>
+#include <ltm/db/metered_collection.h>
+#include <ltm/db/index_provisioner.h>
+#include <ltm/db/db_lock.h>
+#include <ltm/db/collection_counter.h>
+#include <ltm/db/query_cache.h>
+#include <ltm/util/write_behind_queue.h>
 #include <ltm/Episode.h>
 #include <ltm/QueryServer.h>
 
@@ -12,12 +18,15 @@ namespace ltm {
         template<class StreamMsg>
         class StreamCollectionManager {
         private:
-            typedef ltm_db::MessageCollection<StreamMsg> StreamCollection;
+            typedef MeteredCollection<StreamMsg> StreamCollection;
             typedef boost::shared_ptr<StreamCollection> StreamCollectionPtr;
 
             typedef ltm_db::MessageWithMetadata<StreamMsg> StreamWithMetadata;
             typedef boost::shared_ptr<const StreamWithMetadata> StreamWithMetadataPtr;
 
+            typedef std::pair<StreamMsg, MetadataPtr> QueuedStream;
+            typedef ltm::util::WriteBehindQueue<uint32_t, QueuedStream> StreamQueue;
+
             // database connection
             StreamCollectionPtr _coll;
             DBConnectionPtr _conn;
@@ -29,6 +38,17 @@ namespace ltm {
 
             // control
             std::vector<uint32_t> _registry;
+            CollectionCounter _counter;
+
+            // query cache scope, "<db>.<collection>"
+            std::string _scope;
+
+            // optional write-behind queue for inserts, see ltm_enqueue()
+            boost::shared_ptr<StreamQueue> _write_queue;
+
+            void append_common_metadata(const StreamMsg &stream, MetadataPtr metadata);
+            void write_queued(const std::vector<typename StreamQueue::Entry> &entries);
+            int db_count();
 
         public:
             std::string _log_prefix;
@@ -38,6 +58,8 @@ namespace ltm {
             std::string ltm_get_status();
             std::string ltm_get_db_name();
 
+            virtual ~StreamCollectionManager();
+
             void ltm_setup_db(DBConnectionPtr db_ptr, std::string db_name, std::string collection_name, std::string type);
             void ltm_resetup_db(const std::string &db_name);
             bool ltm_register_episode(uint32_t uid);
@@ -49,6 +71,9 @@ namespace ltm {
             bool ltm_drop_db();
             bool ltm_get(uint32_t uid, StreamWithMetadataPtr &stream_ptr);
             bool ltm_insert(const StreamMsg &stream, MetadataPtr metadata);
+            // Inserts through the write-behind queue when "~write_behind/enabled" is set.
+            bool ltm_enqueue(const StreamMsg &stream, MetadataPtr metadata);
+            void ltm_flush();
             bool ltm_query(const std::string& json, ltm::QueryServer::Response &res);
             MetadataPtr ltm_create_metadata();
             bool ltm_update(uint32_t uid, const StreamMsg &stream);
@@ -2,15 +2,19 @@
 #define LTM_DB_TYPES_H
 
 #include <ltm_db/interface/message_with_metadata.h>
+#include <ltm_db/interface/database_connection.h>
+// The MongoDB backend is always built, see StorageBackend. Its errors are caught as mongo::exception.
 #include <ltm_db/mongo/database_connection.h>
 
-typedef ltm_db_mongo::Query Query;
-typedef ltm_db_mongo::Query::Ptr QueryPtr;
+// Backend independent, see StorageBackend. ltm_db_mongo::Query is the same ltm_db::Query interface (the
+// collections' createQuery() returns it), so append(json) stays available to both backends.
+typedef ltm_db::Query Query;
+typedef ltm_db::Query::Ptr QueryPtr;
 
 typedef ltm_db::Metadata Metadata;
 typedef ltm_db::Metadata::Ptr MetadataPtr;
 
-typedef boost::shared_ptr<ltm_db_mongo::MongoDatabaseConnection> DBConnectionPtr;
+typedef boost::shared_ptr<ltm_db::DatabaseConnection> DBConnectionPtr;
 
 
 #endif //LTM_DB_TYPES_H
@@ -8,6 +8,7 @@
 #include <ltm/EntityLog.h>
 #include <ltm/GetEntityLogs.h>
 #include <ltm/db/entity_collection.h>
+#include <ltm/db/request_cost.h>
 #include <ltm/util/parameter_server_wrapper.h>
 
 namespace ltm {
@@ -36,6 +37,11 @@ namespace ltm {
             ros::ServiceServer _get_entity_trail_service;
             ros::ServiceServer _delete_entity_service;
 
+            // service latencies, set on ltm_init()
+            ltm::util::LatencyHistogram *_add_latency;
+            ltm::util::LatencyHistogram *_get_latency;
+            ltm::util::LatencyHistogram *_get_trail_latency;
+
         public:
             void ltm_setup(const std::string &param_ns, DBConnectionPtr db_ptr, std::string db_name);
 
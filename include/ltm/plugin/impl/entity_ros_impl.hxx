@@ -23,6 +23,10 @@ namespace ltm {
         void EntityROS<EntityMsg, EntitySrv>::ltm_init() {
             ros::NodeHandle priv("~");
             std::string ns = "entity/" + this->ltm_get_type() + "/";
+            ltm::util::MetricsRegistry &metrics = ltm::util::MetricsRegistry::instance();
+            _add_latency = &metrics.service(ns + "add");
+            _get_latency = &metrics.service(ns + "get");
+            _get_trail_latency = &metrics.service(ns + "get_trail");
             _status_service = priv.advertiseService(ns + "status", &EntityROS<EntityMsg, EntitySrv>::status_service, this);
             _drop_db_service = priv.advertiseService(ns + "drop_db", &EntityROS<EntityMsg, EntitySrv>::drop_db_service, this);
             _add_entity_service = priv.advertiseService(ns + "add", &EntityROS<EntityMsg, EntitySrv>::add_service, this);
@@ -56,6 +60,7 @@ namespace ltm {
 
         template<class EntityMsg, class EntitySrv>
         bool EntityROS<EntityMsg, EntitySrv>::add_service(EntitySrvRequest &req, EntitySrvResponse &res) {
+            ltm::db::RequestScope request(*_add_latency);
             typename std::vector<EntityMsg>::const_iterator it;
             for (it = req.msgs.begin(); it != req.msgs.end(); ++it) {
                 this->update(*it);
@@ -65,6 +70,7 @@ namespace ltm {
 
         template<class EntityMsg, class EntitySrv>
         bool EntityROS<EntityMsg, EntitySrv>::get_service(EntitySrvRequest &req, EntitySrvResponse &res) {
+            ltm::db::RequestScope request(*_get_latency);
             ROS_INFO_STREAM(this->_log_prefix << "Retrieving entities from collection '" << this->ltm_get_collection_name() << "': " << ltm::util::vector_to_str(req.uids));
             res.msgs.clear();
 
@@ -148,6 +154,7 @@ namespace ltm {
 
         template<class EntityMsg, class EntitySrv>
         bool EntityROS<EntityMsg, EntitySrv>::get_trail_service(EntitySrvRequest &req, EntitySrvResponse &res) {
+            ltm::db::RequestScope request(*_get_trail_latency);
             ROS_INFO_STREAM(this->_log_prefix << "Retrieving entity trails from collection '" << this->ltm_get_diff_collection_name() << "': " << ltm::util::vector_to_str(req.uids));
             res.msgs.clear();
 
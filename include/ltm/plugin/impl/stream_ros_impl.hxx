@@ -23,6 +23,9 @@ namespace ltm {
         void StreamROS<StreamMsg, StreamSrv>::ltm_init() {
             ros::NodeHandle priv("~");
             std::string ns = "stream/" + this->ltm_get_type() + "/";
+            ltm::util::MetricsRegistry &metrics = ltm::util::MetricsRegistry::instance();
+            _add_latency = &metrics.service(ns + "add");
+            _get_latency = &metrics.service(ns + "get");
             _status_service = priv.advertiseService(ns + "status", &StreamROS<StreamMsg, StreamSrv>::status_service, this);
             _drop_db_service = priv.advertiseService(ns + "drop_db", &StreamROS<StreamMsg, StreamSrv>::drop_db_service, this);
             _add_stream_service = priv.advertiseService(ns + "add", &StreamROS<StreamMsg, StreamSrv>::add_service, this);
@@ -54,15 +57,17 @@ namespace ltm {
 
         template<class StreamMsg, class StreamSrv>
         bool StreamROS<StreamMsg, StreamSrv>::add_service(StreamSrvRequest &req, StreamSrvResponse &res) {
+            ltm::db::RequestScope request(*_add_latency);
             typename std::vector<StreamMsg>::const_iterator it;
             for (it = req.msgs.begin(); it != req.msgs.end(); ++it) {
-                this->ltm_insert(*it, this->make_metadata(*it));
+                this->ltm_enqueue(*it, this->make_metadata(*it));
             }
             return true;
         }
 
         template<class StreamMsg, class StreamSrv>
         bool StreamROS<StreamMsg, StreamSrv>::get_service(StreamSrvRequest &req, StreamSrvResponse &res) {
+            ltm::db::RequestScope request(*_get_latency);
             ROS_INFO_STREAM(this->_log_prefix << "Retrieving streams from collection '" << this->ltm_get_collection_name() << "': " << ltm::util::vector_to_str(req.uids));
             res.msgs.clear();
 
@@ -2,6 +2,7 @@
 #define LTM_PLUGINS_MANAGER_H
 
 #include <ltm/QueryServer.h>
+#include <ltm/db/db_lock.h>
 #include <ltm/plugin/location_manager.h>
 #include <ltm/plugin/emotion_manager.h>
 #include <ltm/plugin/streams_manager.h>
@@ -54,8 +55,8 @@ namespace ltm {
             void drop_db();
             bool switch_db(const std::string &db_name);
             void append_status(std::stringstream &status);
-            void query_stream(std::string type, const std::string &json, ltm::QueryServer::Response &res);
-            void query_entity(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail);
+            bool query_stream(std::string type, const std::string &json, ltm::QueryServer::Response &res);
+            bool query_entity(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail);
         };
     }
 }
@@ -20,7 +20,8 @@ namespace ltm {
             virtual void register_episode(uint32_t uid) = 0;
             virtual void unregister_episode(uint32_t uid) = 0;
             virtual void collect(uint32_t uid, ltm::What &msg, ros::Time _start, ros::Time _end) = 0;
-            virtual void query(const std::string &json, ltm::QueryServer::Response &res) = 0;
+            // false when the query fails
+            virtual bool query(const std::string &json, ltm::QueryServer::Response &res) = 0;
             virtual void drop_db() = 0;
             virtual void reset(const std::string &db_name) = 0;
             virtual void append_status(std::stringstream &status) = 0;
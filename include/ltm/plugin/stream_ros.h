@@ -6,6 +6,7 @@
 #include <std_srvs/Empty.h>
 #include <ltm/DropDB.h>
 #include <ltm/db/stream_collection.h>
+#include <ltm/db/request_cost.h>
 #include <ltm/util/parameter_server_wrapper.h>
 
 namespace ltm {
@@ -25,6 +26,10 @@ namespace ltm {
             ros::ServiceServer _get_stream_service;
             ros::ServiceServer _delete_stream_service;
 
+            // service latencies, set on ltm_init()
+            ltm::util::LatencyHistogram *_add_latency;
+            ltm::util::LatencyHistogram *_get_latency;
+
         public:
             void ltm_setup(const std::string &param_ns, DBConnectionPtr db_ptr, std::string db_name);
 
@@ -7,23 +7,40 @@
 
 // ROS
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <std_srvs/Empty.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 
 // ROS LTM services
 #include <ltm/AddEpisode.h>
+#include <ltm/AddEpisodes.h>
 #include <ltm/GetEpisodes.h>
+#include <ltm/QueryJoin.h>
 #include <ltm/QueryServer.h>
+#include <ltm/QueryTags.h>
+#include <ltm/QueryWhen.h>
+#include <ltm/QueryWhere.h>
 #include <ltm/RegisterEpisode.h>
 #include <ltm/UpdateTree.h>
+#include <ltm/UpdateEpisode.h>
 #include <ltm/DropDB.h>
+#include <ltm/GetMetrics.h>
+#include <ltm/Metrics.h>
 #include <ltm/SwitchDB.h>
 
 // LTM
 #include <ltm/db/episode_collection.h>
+#include <ltm/db/collection_counter.h>
+#include <ltm/db/storage_backend.h>
+#include <ltm/db/request_cost.h>
 #include <ltm/plugin/plugins_manager.h>
+#include <ltm/util/metrics.h>
+#include <ltm/util/write_behind_queue.h>
 
 typedef boost::scoped_ptr<ltm::db::EpisodeCollectionManager> EpisodeCollectionManagerPtr;
 typedef boost::scoped_ptr<ltm::plugin::PluginsManager> PluginsManagerPtr;
+typedef ltm::util::WriteBehindQueue<uint32_t, ltm::Episode> EpisodeQueue;
 
 namespace ltm {
 
@@ -36,17 +53,59 @@ namespace ltm {
         std::string _db_host;
         int _db_port;
         float _db_timeout;
+        bool _query_sorted;
+        int _query_max_results;
+        double _query_cursor_ttl;
+        int _query_max_cursors;
+        int _tree_threads;
+        int _tree_grain;
+        int _cache_max_bytes;
+        int _query_cache_max_bytes;
+        int _service_threads;
+        int _heavy_threads;
+        bool _write_behind;
+        int _write_behind_capacity;
+        int _write_behind_batch;
+        double _counters_period;
+        double _metrics_period;
+        double _slow_request_ms;
         std::string _log_prefix;
 
         // servers
         ros::ServiceServer _status_service;
+        ros::ServiceServer _metrics_service;
         ros::ServiceServer _drop_db_service;
         ros::ServiceServer _switch_db_service;
         ros::ServiceServer _add_episode_service;
+        ros::ServiceServer _add_episodes_service;
         ros::ServiceServer _get_episodes_service;
         ros::ServiceServer _query_server_service;
+        ros::ServiceServer _query_join_service;
+        ros::ServiceServer _query_when_service;
+        ros::ServiceServer _query_where_service;
+        ros::ServiceServer _query_tags_service;
         ros::ServiceServer _register_episode_service;
         ros::ServiceServer _update_tree_service;
+        ros::ServiceServer _update_episode_service;
+
+        // periodic reconciliation of the collection counters with the DB
+        ros::WallTimer _counters_timer;
+
+        // latched status and latencies, see fill_metrics()
+        ros::Publisher _metrics_pub;
+        ros::WallTimer _metrics_timer;
+
+        // threading: episode writes are serialized, reads run concurrently.
+        // The write mutex also guards the write-behind queue, so its holder can flush it.
+        ros::CallbackQueue _heavy_queue;
+        boost::recursive_mutex _write_mutex;
+        boost::mutex _params_mutex;
+
+        // open query cursors, by continuation token
+        ltm::db::CursorRegistry _cursors;
+
+        // optional write-behind queue for added episodes, written by write_episodes()
+        boost::scoped_ptr<EpisodeQueue> _episode_queue;
 
         // DB
         EpisodeCollectionManagerPtr _db;
@@ -56,6 +115,15 @@ namespace ltm {
 
         // internal methods
         void show_status();
+        std::string db_name();
+        bool collect_episode(ltm::Episode &episode);
+        void flush_episodes();
+        bool next_page(ltm::db::QueryCursorPtr cursor, uint32_t limit, ltm::QueryServer::Response &res);
+        bool enqueue_episode(ltm::AddEpisode::Request &req, ltm::AddEpisode::Response &res);
+        void write_episodes(const std::vector<EpisodeQueue::Entry> &entries);
+        void reconcile_counters(const ros::WallTimerEvent &event);
+        void fill_metrics(ltm::Metrics &metrics);
+        void publish_metrics(const ros::WallTimerEvent &event);
 
     public:
 
@@ -63,6 +131,8 @@ namespace ltm {
 
         virtual ~Server();
 
+        void spin();
+
         // ==========================================================
         // ROS Services
         // ==========================================================
@@ -70,21 +140,42 @@ namespace ltm {
         /**/
         bool add_episode_service(ltm::AddEpisode::Request  &req, ltm::AddEpisode::Response &res);
 
+        /**/
+        bool add_episodes_service(ltm::AddEpisodes::Request  &req, ltm::AddEpisodes::Response &res);
+
         /**/
         bool get_episodes_service(ltm::GetEpisodes::Request  &req, ltm::GetEpisodes::Response &res);
 
         /**/
         bool query_server_service(ltm::QueryServer::Request  &req, ltm::QueryServer::Response &res);
 
+        /**/
+        bool query_join_service(ltm::QueryJoin::Request  &req, ltm::QueryJoin::Response &res);
+
+        /**/
+        bool query_when_service(ltm::QueryWhen::Request  &req, ltm::QueryWhen::Response &res);
+
+        /**/
+        bool query_where_service(ltm::QueryWhere::Request  &req, ltm::QueryWhere::Response &res);
+
+        /**/
+        bool query_tags_service(ltm::QueryTags::Request  &req, ltm::QueryTags::Response &res);
+
         /**/
         bool register_episode_service(ltm::RegisterEpisode::Request  &req, ltm::RegisterEpisode::Response &res);
 
         /**/
         bool update_tree_service(ltm::UpdateTree::Request &req, ltm::UpdateTree::Response &res);
 
+        /**/
+        bool update_episode_service(ltm::UpdateEpisode::Request &req, ltm::UpdateEpisode::Response &res);
+
         /**/
         bool status_service(std_srvs::Empty::Request  &req, std_srvs::Empty::Response &res);
 
+        /**/
+        bool metrics_service(ltm::GetMetrics::Request  &req, ltm::GetMetrics::Response &res);
+
         /**/
         bool drop_db_service(ltm::DropDB::Request  &req, ltm::DropDB::Response &res);
 
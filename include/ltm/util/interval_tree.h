@@ -0,0 +1,77 @@
+#ifndef LTM_INTERVAL_TREE_H
+#define LTM_INTERVAL_TREE_H
+
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+
+namespace ltm {
+    namespace util {
+
+        // Set of closed intervals [start, end] identified by uid.
+        //
+        // Balanced (treap) search tree ordered by start, augmented with the max and min end of each
+        // subtree, so queries only visit the subtrees that can contain matches. Results are given in
+        // ascending start order. Not thread-safe: const methods can run concurrently.
+        class IntervalTree {
+        public:
+            IntervalTree();
+            virtual ~IntervalTree();
+
+            // Replaces the interval of an existing uid.
+            void insert(uint32_t uid, double start, double end);
+            bool remove(uint32_t uid);
+            void clear();
+            size_t size() const;
+            bool contains(uint32_t uid) const;
+
+            // intervals intersecting [start, end]
+            void query_overlap(double start, double end, std::vector<uint32_t> &uids) const;
+
+            // intervals within [start, end]
+            void query_contained(double start, double end, std::vector<uint32_t> &uids) const;
+
+            // intervals ending before time
+            void query_before(double time, std::vector<uint32_t> &uids) const;
+
+            // intervals starting after time
+            void query_after(double time, std::vector<uint32_t> &uids) const;
+
+        private:
+            struct Node {
+                uint32_t uid;
+                double start;
+                double end;
+                double max_end;
+                double min_end;
+                uint32_t priority;
+                int left;
+                int right;
+            };
+
+            // nodes are kept on a pool, free slots are reused
+            std::vector<Node> _nodes;
+            std::vector<int> _free;
+            int _root;
+            uint32_t _seed;
+
+            // current interval of each uid
+            boost::unordered_map<uint32_t, int> _by_uid;
+
+            bool less(int a, double start, uint32_t uid) const;
+            int new_node(uint32_t uid, double start, double end);
+            void pull(int n);
+            void split(int n, double start, uint32_t uid, bool inclusive, int &left, int &right);
+            int merge(int left, int right);
+
+            void overlap(int n, double start, double end, std::vector<uint32_t> &uids) const;
+            void contained(int n, double start, double end, std::vector<uint32_t> &uids) const;
+            void before(int n, double time, std::vector<uint32_t> &uids) const;
+            void after(int n, double time, std::vector<uint32_t> &uids) const;
+            void all(int n, std::vector<uint32_t> &uids) const;
+        };
+
+    }
+}
+
+#endif //LTM_INTERVAL_TREE_H
@@ -0,0 +1,86 @@
+#ifndef LTM_UTIL_JSON_VALUE_H
+#define LTM_UTIL_JSON_VALUE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ltm {
+    namespace util {
+
+        // JSON document value: null, bool, number, string, array or object.
+        //
+        // Values own their children, copies are deep. parse() accepts the relaxed JSON MongoDB takes for
+        // queries: unquoted keys and single quoted strings.
+        class JsonValue {
+        public:
+            enum Type {
+                NUL = 0,
+                BOOL,
+                NUMBER,
+                STRING,
+                ARRAY,
+                OBJECT
+            };
+            typedef std::vector<JsonValue> Array;
+            typedef std::map<std::string, JsonValue> Object;
+
+            JsonValue();
+            JsonValue(bool value);
+            JsonValue(int value);
+            JsonValue(double value);
+            JsonValue(const char *value);
+            JsonValue(const std::string &value);
+            JsonValue(const JsonValue &other);
+            JsonValue &operator=(const JsonValue &other);
+            virtual ~JsonValue();
+
+            static JsonValue make_array();
+            static JsonValue make_object();
+
+            Type type() const;
+            bool is_null() const;
+            bool is_array() const;
+            bool is_object() const;
+
+            // default values (false, 0, "", empty) on other types
+            bool as_bool() const;
+            double as_number() const;
+            const std::string &as_string() const;
+            const Array &as_array() const;
+            const Object &as_object() const;
+
+            // converts the value to an array or object first
+            Array &array();
+            Object &object();
+            JsonValue &operator[](const std::string &key);
+            void push_back(const JsonValue &value);
+
+            // object member or NULL. "a.b" walks through nested objects.
+            const JsonValue *find(const std::string &key) const;
+            const JsonValue *find_path(const std::string &path) const;
+
+            // Total order: by type, then by value, as MongoDB sorts values.
+            static int compare(const JsonValue &a, const JsonValue &b);
+            bool operator==(const JsonValue &other) const;
+            bool operator!=(const JsonValue &other) const;
+
+            std::string to_string() const;
+            static bool parse(const std::string &text, JsonValue &value, std::string &error);
+
+        private:
+            Type _type;
+            bool _bool;
+            double _number;
+            std::string _string;
+            Array *_array;
+            Object *_object;
+
+            void reset();
+            void write(std::string &out) const;
+        };
+
+    }
+}
+
+#endif //LTM_UTIL_JSON_VALUE_H
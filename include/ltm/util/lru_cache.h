@@ -0,0 +1,130 @@
+#ifndef LTM_LRU_CACHE_H
+#define LTM_LRU_CACHE_H
+
+#include <list>
+#include <utility>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace ltm {
+    namespace util {
+
+        struct LRUCacheStats {
+            size_t hits;
+            size_t misses;
+            size_t evictions;
+            size_t entries;
+            size_t bytes;
+            size_t max_bytes;
+            LRUCacheStats() : hits(0), misses(0), evictions(0), entries(0), bytes(0), max_bytes(0) {}
+        };
+
+        // Least recently used cache, bounded by the sum of the entry costs (e.g., serialized bytes).
+        // A zero capacity disables it. All methods are thread-safe.
+        template<class K, class V>
+        class LRUCache {
+        private:
+            struct Entry {
+                K key;
+                V value;
+                size_t cost;
+            };
+            typedef std::list<Entry> EntryList;
+            typedef boost::unordered_map<K, typename EntryList::iterator> EntryMap;
+
+            // most recently used entries first
+            EntryList _entries;
+            EntryMap _index;
+            LRUCacheStats _stats;
+            mutable boost::mutex _mutex;
+
+            void erase_entry(typename EntryMap::iterator it) {
+                _stats.bytes -= it->second->cost;
+                _entries.erase(it->second);
+                _index.erase(it);
+            }
+
+            void evict() {
+                while (_stats.bytes > _stats.max_bytes && !_entries.empty()) {
+                    erase_entry(_index.find(_entries.back().key));
+                    ++_stats.evictions;
+                }
+            }
+
+        public:
+            explicit LRUCache(size_t max_bytes = 0) {
+                _stats.max_bytes = max_bytes;
+            }
+
+            bool enabled() const {
+                boost::mutex::scoped_lock lock(_mutex);
+                return _stats.max_bytes > 0;
+            }
+
+            void set_capacity(size_t max_bytes) {
+                boost::mutex::scoped_lock lock(_mutex);
+                _stats.max_bytes = max_bytes;
+                evict();
+            }
+
+            bool get(const K &key, V &value) {
+                boost::mutex::scoped_lock lock(_mutex);
+                typename EntryMap::iterator it = _index.find(key);
+                if (it == _index.end()) {
+                    ++_stats.misses;
+                    return false;
+                }
+                // move to front
+                _entries.splice(_entries.begin(), _entries, it->second);
+                value = it->second->value;
+                ++_stats.hits;
+                return true;
+            }
+
+            bool contains(const K &key) const {
+                boost::mutex::scoped_lock lock(_mutex);
+                return _index.find(key) != _index.end();
+            }
+
+            void put(const K &key, const V &value, size_t cost) {
+                boost::mutex::scoped_lock lock(_mutex);
+                typename EntryMap::iterator it = _index.find(key);
+                if (it != _index.end()) erase_entry(it);
+
+                // entries larger than the whole cache are never kept
+                if (cost > _stats.max_bytes) return;
+                Entry entry;
+                entry.key = key;
+                entry.value = value;
+                entry.cost = cost;
+                _entries.push_front(entry);
+                _index[key] = _entries.begin();
+                _stats.bytes += cost;
+                evict();
+            }
+
+            void erase(const K &key) {
+                boost::mutex::scoped_lock lock(_mutex);
+                typename EntryMap::iterator it = _index.find(key);
+                if (it != _index.end()) erase_entry(it);
+            }
+
+            void clear() {
+                boost::mutex::scoped_lock lock(_mutex);
+                _entries.clear();
+                _index.clear();
+                _stats.bytes = 0;
+            }
+
+            LRUCacheStats stats() const {
+                boost::mutex::scoped_lock lock(_mutex);
+                LRUCacheStats stats = _stats;
+                stats.entries = _index.size();
+                return stats;
+            }
+        };
+
+    }
+}
+
+#endif //LTM_LRU_CACHE_H
@@ -0,0 +1,85 @@
+#ifndef LTM_UTIL_METRICS_H
+#define LTM_UTIL_METRICS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <ros/time.h>
+
+namespace ltm {
+    namespace util {
+
+        // Latency summary, in microseconds. Percentiles are the upper bound of their bucket, capped by the max.
+        struct LatencySnapshot {
+            uint64_t count;
+            double mean_us;
+            double p50_us;
+            double p95_us;
+            double p99_us;
+            double max_us;
+        };
+
+        // Latency distribution over power of two microsecond buckets: [0, 2), [2, 4), ... up to ~1 hour.
+        //
+        // record() only does atomic increments (and a CAS loop for the max), so it can run on every call
+        // of the service handlers and DB operations. snapshot() may see a record() half done.
+        class LatencyHistogram : boost::noncopyable {
+        public:
+            static const size_t BUCKETS = 32;
+
+            explicit LatencyHistogram(const std::string &name);
+            virtual ~LatencyHistogram();
+
+            const std::string &name() const;
+
+            void record(uint64_t us);
+            void record(const ros::WallDuration &elapsed);
+            LatencySnapshot snapshot() const;
+
+        private:
+            std::string _name;
+            boost::atomic<uint64_t> _buckets[BUCKETS];
+            boost::atomic<uint64_t> _sum_us;
+            boost::atomic<uint64_t> _max_us;
+
+            static size_t bucket(uint64_t us);
+        };
+
+        // Process-wide histograms, by ROS service (e.g., "episode/add") and by DB operation (e.g., "findOne").
+        //
+        // Histograms are created on first use and never removed, so callers can keep the returned
+        // reference. Lookups take a shared lock, recording takes none.
+        class MetricsRegistry {
+        public:
+            typedef std::vector<std::pair<std::string, LatencySnapshot> > Snapshots;
+
+            static MetricsRegistry &instance();
+            virtual ~MetricsRegistry();
+
+            LatencyHistogram &service(const std::string &name);
+            LatencyHistogram &db(const std::string &operation);
+
+            // sorted by name
+            void snapshot_services(Snapshots &snapshots);
+            void snapshot_db(Snapshots &snapshots);
+
+        private:
+            typedef std::map<std::string, boost::shared_ptr<LatencyHistogram> > HistogramMap;
+            HistogramMap _services;
+            HistogramMap _db;
+            boost::shared_mutex _mutex;
+
+            MetricsRegistry();
+            LatencyHistogram &histogram(HistogramMap &histograms, const std::string &name);
+            void snapshot(const HistogramMap &histograms, Snapshots &snapshots);
+        };
+
+    }
+}
+
+#endif //LTM_UTIL_METRICS_H
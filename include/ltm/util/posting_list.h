@@ -0,0 +1,57 @@
+#ifndef LTM_POSTING_LIST_H
+#define LTM_POSTING_LIST_H
+
+#include <map>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace ltm {
+    namespace util {
+
+        // Sorted set of uids, compressed as blocks of varint-encoded deltas.
+        //
+        // Blocks hold up to MAX_BLOCK uids and are keyed by their first uid. Inserts and removes only
+        // re-encode one block, so they cost O(log blocks + MAX_BLOCK) however long the list grows.
+        // Appending a uid above all others is encoded in place. Dense uid ranges take ~1 byte per uid.
+        class CompressedPostingList {
+        public:
+            static const uint32_t MAX_BLOCK = 128;
+
+            CompressedPostingList();
+            virtual ~CompressedPostingList();
+
+            // false when the uid was already (insert) or not (erase) in the list
+            bool insert(uint32_t uid);
+            bool erase(uint32_t uid);
+            bool contains(uint32_t uid) const;
+            void clear();
+            size_t size() const;
+            bool empty() const;
+            size_t blocks() const;
+
+            // Appends all uids in ascending order.
+            void decode(std::vector<uint32_t> &uids) const;
+
+        private:
+            struct Block {
+                uint32_t last;
+                uint32_t count;
+                // deltas from the first uid (the map key), one varint each
+                std::vector<uint8_t> deltas;
+            };
+            typedef std::map<uint32_t, Block> BlockMap;
+            BlockMap _blocks;
+            size_t _size;
+
+            BlockMap::iterator find_block(uint32_t uid);
+            static void decode_block(uint32_t first, const Block &block, std::vector<uint32_t> &uids);
+            static void append_varint(std::vector<uint8_t> &bytes, uint32_t value);
+            // stores sorted uids as one or two blocks
+            void store(const std::vector<uint32_t> &uids);
+        };
+
+    }
+}
+
+#endif //LTM_POSTING_LIST_H
@@ -0,0 +1,49 @@
+#ifndef LTM_SHARED_MUTEX_H
+#define LTM_SHARED_MUTEX_H
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace ltm {
+    namespace util {
+
+        // Readers/writer mutex that can be locked again by the thread that already owns it,
+        // so public methods can lock and still call each other. A thread holding the read lock
+        // cannot take the write lock (no upgrades), this throws a std::logic_error.
+        class ReentrantSharedMutex : boost::noncopyable {
+        private:
+            struct Owner {
+                int depth;
+                bool unique;
+                Owner() : depth(0), unique(false) {}
+            };
+            boost::shared_mutex _mutex;
+            boost::thread_specific_ptr<Owner> _owner;
+
+            Owner &owner();
+            bool lock(bool unique);
+            void unlock(bool owns);
+
+        public:
+            class ReadLock : boost::noncopyable {
+                ReentrantSharedMutex &_m;
+                bool _owns;
+            public:
+                explicit ReadLock(ReentrantSharedMutex &m) : _m(m), _owns(m.lock(false)) {}
+                ~ReadLock() { _m.unlock(_owns); }
+            };
+
+            class WriteLock : boost::noncopyable {
+                ReentrantSharedMutex &_m;
+                bool _owns;
+            public:
+                explicit WriteLock(ReentrantSharedMutex &m) : _m(m), _owns(m.lock(true)) {}
+                ~WriteLock() { _m.unlock(_owns); }
+            };
+        };
+
+    }
+}
+
+#endif //LTM_SHARED_MUTEX_H
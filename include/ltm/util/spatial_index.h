@@ -0,0 +1,50 @@
+#ifndef LTM_SPATIAL_INDEX_H
+#define LTM_SPATIAL_INDEX_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/scoped_ptr.hpp>
+#include <geometry_msgs/Point.h>
+
+namespace ltm {
+    namespace util {
+
+        // 2D R-trees of uid bounding boxes, one per (map_name, frame_id).
+        //
+        // Entries are points (e.g., leaf positions) or the envelope of a point set (e.g., a children hull).
+        // Boost.Geometry is kept out of this header. Not thread-safe: const methods can run concurrently.
+        class SpatialIndex {
+        public:
+            SpatialIndex();
+            virtual ~SpatialIndex();
+
+            // Replaces the entry of an existing uid. Empty point sets are not indexed.
+            void insert(uint32_t uid, const std::string &map_name, const std::string &frame_id,
+                        const std::vector<geometry_msgs::Point> &points);
+            bool remove(uint32_t uid);
+            void clear();
+            size_t size() const;
+            size_t trees() const;
+
+            // entries intersecting the circle
+            void query_radius(const std::string &map_name, const std::string &frame_id,
+                              const geometry_msgs::Point &center, double radius, std::vector<uint32_t> &uids) const;
+
+            // entries covered by the polygon, given as a closed or open ring
+            void query_polygon(const std::string &map_name, const std::string &frame_id,
+                               const std::vector<geometry_msgs::Point> &polygon, std::vector<uint32_t> &uids) const;
+
+            // k closest entries, closest first
+            void query_nearest(const std::string &map_name, const std::string &frame_id,
+                               const geometry_msgs::Point &point, size_t k, std::vector<uint32_t> &uids) const;
+
+        private:
+            struct Impl;
+            boost::scoped_ptr<Impl> _impl;
+        };
+
+    }
+}
+
+#endif //LTM_SPATIAL_INDEX_H
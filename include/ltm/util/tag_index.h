@@ -0,0 +1,61 @@
+#ifndef LTM_TAG_INDEX_H
+#define LTM_TAG_INDEX_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+#include <ltm/util/posting_list.h>
+
+namespace ltm {
+    namespace util {
+
+        // Inverted index from tag to the sorted list of uids holding it, on own tags and on children tags.
+        // Posting lists are compressed in blocks, so adding or removing an episode does not shift the
+        // whole list of a frequent tag.
+        //
+        // Queries are boolean expressions: '&' (and), '|' (or), '!' (not) and parentheses, with the usual
+        // precedence (! > & > |). Tags with spaces or operators are double quoted, e.g.,
+        // 'kitchen & ("living room" | !robot)'. Not thread-safe: const methods can run concurrently.
+        class TagIndex {
+        public:
+            typedef std::vector<uint32_t> PostingList;
+
+            TagIndex();
+            virtual ~TagIndex();
+
+            // Replaces the tags of an existing uid.
+            void insert(uint32_t uid, const std::vector<std::string> &tags, const std::vector<std::string> &children_tags);
+            bool remove(uint32_t uid);
+            void clear();
+            size_t size() const;
+            size_t tags() const;
+
+            // Matching uids in ascending order. With include_children, a tag also matches the uids holding
+            // it on their children tags. Returns false and fills error, when the expression is invalid.
+            bool query(const std::string &expression, bool include_children, PostingList &uids, std::string &error) const;
+
+        private:
+            typedef boost::unordered_map<std::string, CompressedPostingList> PostingMap;
+            PostingMap _tags;
+            PostingMap _children_tags;
+
+            // indexed uids, as the universe for '!'
+            CompressedPostingList _uids;
+            boost::unordered_map<uint32_t, std::pair<std::vector<std::string>, std::vector<std::string> > > _by_uid;
+
+            static void add(PostingMap &map, const std::vector<std::string> &tags, uint32_t uid);
+            static void erase(PostingMap &map, const std::vector<std::string> &tags, uint32_t uid);
+
+            // recursive descent evaluation
+            struct Parser;
+            bool parse_or(Parser &p, PostingList &out) const;
+            bool parse_and(Parser &p, PostingList &out) const;
+            bool parse_not(Parser &p, PostingList &out) const;
+            void lookup(const std::string &tag, bool include_children, PostingList &out) const;
+        };
+
+    }
+}
+
+#endif //LTM_TAG_INDEX_H
@@ -0,0 +1,61 @@
+#ifndef LTM_THREAD_POOL_H
+#define LTM_THREAD_POOL_H
+
+#include <deque>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace ltm {
+    namespace util {
+
+        // Fixed size work-stealing thread pool.
+        // Each worker owns a deque: it pops its own tasks LIFO and steals from the others FIFO,
+        // so forked subtasks stay on the worker that created them while idle workers take the older ones.
+        class WorkStealingPool {
+        public:
+            typedef boost::function<void()> Task;
+
+            explicit WorkStealingPool(size_t n_threads);
+            virtual ~WorkStealingPool();
+
+            // Tasks submitted from a worker go to its own deque, other tasks are distributed round-robin.
+            void submit(const Task &task);
+
+            // Blocks until every submitted task (and the tasks they submitted) has finished.
+            void wait();
+
+            size_t size() const;
+
+        private:
+            struct Worker {
+                boost::mutex mutex;
+                std::deque<Task> tasks;
+            };
+            typedef boost::shared_ptr<Worker> WorkerPtr;
+
+            std::vector<WorkerPtr> _workers;
+            boost::thread_group _threads;
+            boost::thread_specific_ptr<size_t> _worker_idx;
+
+            // pending: submitted but not finished tasks
+            boost::mutex _mutex;
+            boost::condition_variable _task_cv;
+            boost::condition_variable _done_cv;
+            size_t _pending;
+            size_t _queued;
+            size_t _next;
+            bool _stop;
+
+            void run(size_t idx);
+            bool pop(size_t idx, Task &task);
+        };
+
+    }
+}
+
+#endif //LTM_THREAD_POOL_H
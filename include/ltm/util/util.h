@@ -7,12 +7,20 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <cstring>
+#include <ros/serialization.h>
 
 namespace ltm {
     namespace util {
 
         void uid_vector_merge(std::vector<uint32_t> &result, const std::vector<uint32_t> &source);
 
+        // Sorts the uids and removes duplicates.
+        void uid_vector_sort(std::vector<uint32_t> &uids);
+
+        // Keeps the uids also in source. Both must be sorted, without duplicates.
+        void uid_vector_intersect(std::vector<uint32_t> &result, const std::vector<uint32_t> &source);
+
         void vector_merge(std::vector<std::string> &result, const std::vector<std::string> &source);
 
         std::string vector_to_str(const std::vector<std::string> &array);
@@ -21,6 +29,17 @@ namespace ltm {
 
         std::string vector_to_str(const std::vector<uint32_t> &array);
 
+        // Compares two ROS messages by their serialized representation.
+        template<class M>
+        bool equals_message(const M &a, const M &b) {
+            ros::SerializedMessage sa = ros::serialization::serializeMessage(a);
+            ros::SerializedMessage sb = ros::serialization::serializeMessage(b);
+            return sa.num_bytes == sb.num_bytes && std::memcmp(sa.buf.get(), sb.buf.get(), sa.num_bytes) == 0;
+        }
+
+        // MongoDB JSON query matching any of the values: "{field: {$in: [v1, v2, ...]}}"
+        std::string json_in(const std::string &field, const std::vector<uint32_t> &values);
+
     }
 }
 
@@ -0,0 +1,200 @@
+#ifndef LTM_WRITE_BEHIND_QUEUE_H
+#define LTM_WRITE_BEHIND_QUEUE_H
+
+#include <deque>
+#include <vector>
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <ros/ros.h>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace ltm {
+    namespace util {
+
+        // Bounded queue of pending writes, flushed in batches by a background thread.
+        //
+        // push() blocks while the queue is full (backpressure). Items stay visible through find()
+        // until they are written, so callers can read their own writes. The destructor writes
+        // every queued item before returning.
+        //
+        // When a guard mutex is given, the writer thread holds it while a batch is taken and written.
+        // flush() can then be called by a thread holding the guard: queued items are written by the
+        // caller itself, instead of waiting for the writer thread.
+        template<class K, class T>
+        class WriteBehindQueue : boost::noncopyable {
+        public:
+            typedef std::pair<K, T> Entry;
+            typedef boost::function<void(const std::vector<Entry> &)> Writer;
+
+        private:
+            struct Item {
+                size_t seq;
+                Entry entry;
+            };
+
+            Writer _writer;
+            size_t _capacity;
+            size_t _batch_size;
+            boost::recursive_mutex *_guard;
+
+            std::deque<Item> _queue;
+            // newest pending value by key, including the items being written
+            boost::unordered_map<K, std::pair<size_t, T> > _pending;
+            size_t _pushed;
+            size_t _done;
+            bool _stop;
+
+            mutable boost::mutex _mutex;
+            boost::condition_variable _not_empty;
+            boost::condition_variable _not_full;
+            boost::condition_variable _done_cv;
+            boost::thread _thread;
+
+            void write(const std::vector<Item> &items) {
+                if (items.empty()) return;
+                std::vector<Entry> batch;
+                batch.reserve(items.size());
+                typename std::vector<Item>::const_iterator it;
+                for (it = items.begin(); it != items.end(); ++it) {
+                    batch.push_back(it->entry);
+                }
+                try {
+                    _writer(batch);
+                } catch (const std::exception &ex) {
+                    ROS_ERROR_STREAM("Write-behind queue: (" << batch.size() << ") items could not be written. " << ex.what());
+                }
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    _done += items.size();
+                    for (it = items.begin(); it != items.end(); ++it) {
+                        typename boost::unordered_map<K, std::pair<size_t, T> >::iterator p_it = _pending.find(it->entry.first);
+                        if (p_it != _pending.end() && p_it->second.first == it->seq) _pending.erase(p_it);
+                    }
+                }
+                _done_cv.notify_all();
+            }
+
+            // takes and writes up to max_items queued items, returns the sequence of the last pushed item
+            size_t write_next(size_t max_items) {
+                std::vector<Item> items;
+                size_t pushed;
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    pushed = _pushed;
+                    size_t n = std::min(max_items, _queue.size());
+                    items.reserve(n);
+                    for (size_t i = 0; i < n; ++i) {
+                        items.push_back(_queue.front());
+                        _queue.pop_front();
+                    }
+                }
+                _not_full.notify_all();
+                write(items);
+                return pushed;
+            }
+
+            void run() {
+                while (true) {
+                    {
+                        boost::mutex::scoped_lock lock(_mutex);
+                        while (_queue.empty() && !_stop) {
+                            _not_empty.wait(lock);
+                        }
+                        if (_queue.empty()) return;
+                    }
+                    if (_guard) {
+                        boost::recursive_mutex::scoped_lock guard(*_guard);
+                        write_next(_batch_size);
+                    } else {
+                        write_next(_batch_size);
+                    }
+                }
+            }
+
+        public:
+            WriteBehindQueue(const Writer &writer, size_t capacity, size_t batch_size, boost::recursive_mutex *guard = NULL)
+                    : _writer(writer), _capacity(std::max(capacity, (size_t) 1)), _batch_size(std::max(batch_size, (size_t) 1)),
+                      _guard(guard), _pushed(0), _done(0), _stop(false) {
+                _thread = boost::thread(boost::bind(&WriteBehindQueue::run, this));
+            }
+
+            virtual ~WriteBehindQueue() {
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    _stop = true;
+                }
+                _not_empty.notify_all();
+                _thread.join();
+            }
+
+            void push(const K &key, const T &value) {
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    while (_queue.size() >= _capacity) {
+                        _not_full.wait(lock);
+                    }
+                    Item item;
+                    item.seq = ++_pushed;
+                    item.entry = Entry(key, value);
+                    _queue.push_back(item);
+                    _pending[key] = std::make_pair(item.seq, value);
+                }
+                _not_empty.notify_one();
+            }
+
+            bool find(const K &key, T &value) const {
+                boost::mutex::scoped_lock lock(_mutex);
+                typename boost::unordered_map<K, std::pair<size_t, T> >::const_iterator it = _pending.find(key);
+                if (it == _pending.end()) return false;
+                value = it->second.second;
+                return true;
+            }
+
+            // Blocks until everything pushed before this call has been written.
+            void flush() {
+                size_t target;
+                {
+                    // readers flush before every query, they must not wait for the guard for nothing
+                    boost::mutex::scoped_lock lock(_mutex);
+                    if (_done == _pushed) return;
+                }
+                if (_guard) {
+                    // write the queued items here, the writer thread cannot be holding a batch meanwhile
+                    boost::recursive_mutex::scoped_lock guard(*_guard);
+                    target = write_next(std::numeric_limits<size_t>::max());
+                } else {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    target = _pushed;
+                }
+                boost::mutex::scoped_lock lock(_mutex);
+                while (_done < target) {
+                    _done_cv.wait(lock);
+                }
+            }
+
+            // push() would block. With a guard, its holder should flush() instead of waiting.
+            bool full() const {
+                boost::mutex::scoped_lock lock(_mutex);
+                return _queue.size() >= _capacity;
+            }
+
+            // pending items, including the batch being written
+            size_t size() const {
+                boost::mutex::scoped_lock lock(_mutex);
+                return _pushed - _done;
+            }
+        };
+
+    }
+}
+
+#endif //LTM_WRITE_BEHIND_QUEUE_H
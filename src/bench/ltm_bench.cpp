@@ -0,0 +1,643 @@
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <ltm/BenchEntity.h>
+#include <ltm/BenchStream.h>
+#include <ltm/db/episode_collection.h>
+#include <ltm/db/entity_collection.h>
+#include <ltm/db/stream_collection.h>
+#include <ltm/plugin/entity_util.h>
+#include <ltm/util/parameter_server_wrapper.h>
+
+// Synthetic workload benchmark for the LTM collection managers.
+//
+// Builds episode trees, entity histories and stream payloads from a seeded generator, and drives the
+// managers directly, as the server and plugins do. Each operation is reported as a JSON line with its
+// throughput and latency percentiles, so runs can be compared across commits. See config/bench.yaml.
+
+namespace ltm {
+    namespace bench {
+
+        static void write_string(std::ostream &os, const std::string &value) {
+            os << '"';
+            for (size_t i = 0; i < value.size(); ++i) {
+                if (value[i] == '"' || value[i] == '\\') os << '\\';
+                os << value[i];
+            }
+            os << '"';
+        }
+
+        // =================================================================================================================
+        // Measurements
+        // =================================================================================================================
+
+        class OpStats {
+        private:
+            std::string _name;
+            std::vector<double> _samples; // microseconds
+            double _wall; // seconds of the phases running this op
+            size_t _phase_start;
+
+            static double percentile(const std::vector<double> &sorted, double p) {
+                // nearest rank
+                size_t rank = (size_t) std::ceil(p / 100.0 * sorted.size());
+                return sorted[rank > 0 ? rank - 1 : 0];
+            }
+
+        public:
+            explicit OpStats(const std::string &name) : _name(name), _wall(0), _phase_start(0) {}
+
+            const std::string &name() const {
+                return _name;
+            }
+
+            void add(const ros::WallDuration &latency) {
+                _samples.push_back(latency.toSec() * 1e6);
+            }
+
+            void begin_phase() {
+                _phase_start = _samples.size();
+            }
+
+            // ops interleave within a phase, so each one is charged the whole phase
+            void end_phase(const ros::WallDuration &elapsed) {
+                if (_samples.size() > _phase_start) _wall += elapsed.toSec();
+                _phase_start = _samples.size();
+            }
+
+            void write_json(std::ostream &os, const std::string &label) const {
+                std::vector<double> sorted(_samples);
+                std::sort(sorted.begin(), sorted.end());
+                double total = 0;
+                std::vector<double>::const_iterator it;
+                for (it = sorted.begin(); it != sorted.end(); ++it) total += *it;
+
+                os << "{\"type\": \"result\", \"label\": ";
+                write_string(os, label);
+                os << ", \"op\": ";
+                write_string(os, _name);
+                os << ", \"count\": " << sorted.size();
+                if (!sorted.empty()) {
+                    os << std::fixed << std::setprecision(3)
+                       << ", \"total_s\": " << total * 1e-6
+                       << ", \"wall_s\": " << _wall
+                       << ", \"ops_per_s\": " << (_wall > 0 ? sorted.size() / _wall : 0.0)
+                       << ", \"p50_us\": " << percentile(sorted, 50)
+                       << ", \"p95_us\": " << percentile(sorted, 95)
+                       << ", \"p99_us\": " << percentile(sorted, 99)
+                       << ", \"max_us\": " << sorted.back();
+                }
+                os << "}" << std::endl;
+            }
+        };
+
+        // =================================================================================================================
+        // Synthetic plugins
+        // =================================================================================================================
+
+        class BenchStreamManager : public ltm::db::StreamCollectionManager<ltm::BenchStream> {
+        public:
+            BenchStreamManager() {
+                _log_prefix = "[LTM][bench Stream]: ";
+            }
+
+            MetadataPtr make_metadata(const ltm::BenchStream &stream) {
+                MetadataPtr meta = ltm_create_metadata();
+                meta->append("bytes", (int) stream.data.size());
+                return meta;
+            }
+        };
+
+        // Same update scheme as the entity plugins: a log and a diff per update, then the latest state.
+        class BenchEntityManager : public ltm::db::EntityCollectionManager<ltm::BenchEntity> {
+        private:
+            typedef ltm_db::MessageWithMetadata<ltm::BenchEntity> EntityWithMetadata;
+            typedef boost::shared_ptr<const EntityWithMetadata> EntityWithMetadataPtr;
+
+        public:
+            // plugin API, as used by the server
+            using ltm::db::EntityCollectionManager<ltm::BenchEntity>::ltm_setup_db;
+            using ltm::db::EntityCollectionManager<ltm::BenchEntity>::ltm_retrace;
+            using ltm::db::EntityCollectionManager<ltm::BenchEntity>::ltm_count;
+
+            BenchEntityManager() {
+                _log_prefix = "[LTM][bench Entity]: ";
+                _field_names.insert("name");
+                _field_names.insert("location");
+                _field_names.insert("value");
+                _field_names.insert("features");
+            }
+
+            MetadataPtr make_metadata(const ltm::BenchEntity &entity) {
+                MetadataPtr meta = ltm_create_metadata(entity);
+                meta->append("name", entity.name);
+                meta->append("location", entity.location);
+                return meta;
+            }
+
+            void update(const ltm::BenchEntity &msg) {
+                using ltm::plugin::entity::update_field;
+                uint32_t uid = msg.meta.uid;
+                ltm::BenchEntity curr = _null_e;
+                ltm::BenchEntity diff = _null_e;
+
+                ltm::EntityLog log;
+                log.entity_uid = uid;
+                log.log_uid = (uint32_t) ltm_reserve_log_uid();
+                log.timestamp = msg.meta.stamp;
+                ltm_get_registry(log.episode_uids);
+
+                EntityWithMetadataPtr last;
+                if (ltm_get_last(uid, last)) {
+                    curr = *last;
+                } else {
+                    curr.meta.uid = uid;
+                    curr.meta.init_log = log.log_uid;
+                    curr.meta.init_stamp = log.timestamp;
+                }
+                update_field(log, "name", curr.name, diff.name, msg.name, _null_e.name);
+                update_field(log, "location", curr.location, diff.location, msg.location, _null_e.location);
+                update_field(log, "value", curr.value, diff.value, msg.value, _null_e.value);
+                update_field(log, "features", curr.features, diff.features, msg.features, _null_e.features);
+
+                curr.meta.log_uid = log.log_uid;
+                curr.meta.last_log = log.log_uid;
+                curr.meta.stamp = log.timestamp;
+                curr.meta.last_stamp = log.timestamp;
+                diff.meta = curr.meta;
+
+                ltm_diff_insert(diff);
+                ltm_log_insert(log);
+                ltm_update(uid, curr);
+            }
+
+            void copy_field(const std::string &field, EntityWithMetadataPtr &in, ltm::BenchEntity &out) {
+                if (field == "name") out.name = in->name;
+                else if (field == "location") out.location = in->location;
+                else if (field == "value") out.value = in->value;
+                else if (field == "features") out.features = in->features;
+            }
+        };
+
+        // =================================================================================================================
+        // Benchmark
+        // =================================================================================================================
+
+        class Bench {
+        private:
+            // params
+            std::string _db_name;
+            std::string _db_collection_name;
+            std::string _db_host;
+            int _db_port;
+            float _db_timeout;
+            int _seed;
+            std::string _label;
+            std::string _output;
+            bool _keep;
+            int _trees;
+            int _depth;
+            int _fanout;
+            int _tag_vocabulary;
+            int _tags_per_episode;
+            int _maps;
+            int _locations;
+            double _extent;
+            int _streams_per_leaf;
+            int _stream_payload;
+            int _entities;
+            int _entity_updates;
+            int _entity_features;
+            int _queries;
+            bool _query_sorted;
+            int _query_max_results;
+            int _tree_threads;
+            int _tree_grain;
+            int _cache_max_bytes;
+            int _query_cache_max_bytes;
+
+            // managers
+            boost::scoped_ptr<ltm::db::EpisodeCollectionManager> _db;
+            BenchStreamManager _streams;
+            BenchEntityManager _entity_manager;
+
+            // generated data
+            boost::random::mt19937 _rng;
+            std::vector<std::string> _tag_names;
+            std::vector<std::string> _location_names;
+            std::vector<uint32_t> _roots;
+            std::vector<uint32_t> _leaves;
+            std::vector<uint32_t> _episodes;
+            uint32_t _next_stream_uid;
+            ros::Time _t0;
+            double _span;
+
+            std::vector<OpStats> _stats;
+
+            OpStats &op(const std::string &name) {
+                std::vector<OpStats>::iterator it;
+                for (it = _stats.begin(); it != _stats.end(); ++it) {
+                    if (it->name() == name) return *it;
+                }
+                _stats.push_back(OpStats(name));
+                return _stats.back();
+            }
+
+            int random_int(int min, int max) {
+                boost::random::uniform_int_distribution<int> dist(min, max);
+                return dist(_rng);
+            }
+
+            double random_real(double min, double max) {
+                boost::random::uniform_real_distribution<double> dist(min, max);
+                return dist(_rng);
+            }
+
+            template<class T>
+            const T &pick(const std::vector<T> &values) {
+                return values[random_int(0, (int) values.size() - 1)];
+            }
+
+            std::string map_name(int map) {
+                std::stringstream ss;
+                ss << "map_" << map;
+                return ss.str();
+            }
+
+            void fill_leaf(ltm::Episode &episode, int map, double cx, double cy);
+            void add_streams(const ltm::Episode &episode);
+            uint32_t add_subtree(uint32_t parent, int level, const ros::Time &start, double span, int map, double cx, double cy);
+
+            void run_episodes();
+            void run_entities();
+            void run_update_tree();
+            void run_queries();
+            void run_phase(void (Bench::*phase)());
+
+            void write_config(std::ostream &os);
+
+        public:
+            Bench();
+            virtual ~Bench();
+
+            void run();
+            void report();
+        };
+
+        Bench::Bench() : _next_stream_uid(1), _t0(1500000000, 0), _span(0) {
+            ltm::util::ParameterServerWrapper psw;
+            psw.getParameter("db", _db_name, "ltm_bench");
+            psw.getParameter("collection", _db_collection_name, "episodes");
+            psw.getParameter("host", _db_host, "localhost");
+            psw.getParameter("port", _db_port, 27017);
+            psw.getParameter("timeout", _db_timeout, 60.0);
+            psw.getParameter("seed", _seed, 1);
+            psw.getParameter("label", _label, "");
+            psw.getParameter("output", _output, "");
+            psw.getParameter("keep", _keep, false);
+            psw.getParameter("tree/count", _trees, 4);
+            psw.getParameter("tree/depth", _depth, 3);
+            psw.getParameter("tree/fanout", _fanout, 4);
+            psw.getParameter("tags/vocabulary", _tag_vocabulary, 64);
+            psw.getParameter("tags/per_episode", _tags_per_episode, 3);
+            psw.getParameter("where/maps", _maps, 2);
+            psw.getParameter("where/locations", _locations, 16);
+            psw.getParameter("where/extent", _extent, 100.0);
+            psw.getParameter("streams/per_leaf", _streams_per_leaf, 1);
+            psw.getParameter("streams/payload", _stream_payload, 4096);
+            psw.getParameter("entities/count", _entities, 32);
+            psw.getParameter("entities/updates", _entity_updates, 16);
+            psw.getParameter("entities/features", _entity_features, 16);
+            psw.getParameter("queries", _queries, 200);
+            psw.getParameter("query/sorted", _query_sorted, false);
+            psw.getParameter("query/max_results", _query_max_results, 0);
+            psw.getParameter("tree/threads", _tree_threads, 0);
+            psw.getParameter("tree/grain", _tree_grain, 64);
+            psw.getParameter("cache/max_bytes", _cache_max_bytes, 16777216);
+            psw.getParameter("query_cache/max_bytes", _query_cache_max_bytes, 8388608);
+
+            _trees = std::max(_trees, 1);
+            _depth = std::max(_depth, 0);
+            _fanout = std::max(_fanout, 1);
+            _tag_vocabulary = std::max(_tag_vocabulary, 1);
+            _maps = std::max(_maps, 1);
+            _locations = std::max(_locations, 1);
+            _rng.seed((uint32_t) _seed);
+
+            for (int i = 0; i < _tag_vocabulary; ++i) {
+                std::stringstream ss;
+                ss << "tag_" << i;
+                _tag_names.push_back(ss.str());
+            }
+            for (int i = 0; i < _locations; ++i) {
+                std::stringstream ss;
+                ss << "location_" << i;
+                _location_names.push_back(ss.str());
+            }
+
+            // a fresh database, so every run starts from the same state
+            ROS_WARN_STREAM("[LTM][Bench]: Dropping database '" << _db_name << "'.");
+            _db.reset(new ltm::db::EpisodeCollectionManager(_db_name, _db_collection_name, _db_host, (uint) _db_port, _db_timeout));
+            _db->setup();
+            _db->drop_db();
+            _db->set_query_options(_query_sorted, _query_max_results);
+            _db->set_tree_options(_tree_threads, _tree_grain);
+            _db->set_cache_options(_cache_max_bytes);
+            ltm::db::QueryCache::instance().set_options(_query_cache_max_bytes);
+
+            _streams.ltm_setup_db(_db->_conn, _db_name, "bench", "bench");
+            _entity_manager.ltm_setup_db(_db->_conn, _db_name, "bench", "bench");
+
+            // entity log uids are drawn from rand()
+            std::srand((uint) _seed);
+        }
+
+        Bench::~Bench() {}
+
+        void Bench::fill_leaf(ltm::Episode &episode, int map, double cx, double cy) {
+            episode.type = ltm::Episode::LEAF;
+            for (int i = 0; i < _tags_per_episode; ++i) {
+                const std::string &tag = pick(_tag_names);
+                if (std::find(episode.tags.begin(), episode.tags.end(), tag) == episode.tags.end()) {
+                    episode.tags.push_back(tag);
+                }
+            }
+            episode.where.map_name = map_name(map);
+            episode.where.frame_id = "map";
+            episode.where.position.x = cx + random_real(-0.05, 0.05) * _extent;
+            episode.where.position.y = cy + random_real(-0.05, 0.05) * _extent;
+            episode.where.location = pick(_location_names);
+            episode.where.area = map_name(map);
+            episode.relevance.emotional.emotion = random_int(0, 7);
+            episode.relevance.emotional.value = (float) random_real(0.0, 1.0);
+            if (_entities > 0) {
+                ltm::EntityRegister entity;
+                entity.type = "bench";
+                entity.uid = (uint32_t) random_int(1, _entities);
+                episode.what.entities.push_back(entity);
+            }
+        }
+
+        void Bench::add_streams(const ltm::Episode &episode) {
+            for (int i = 0; i < _streams_per_leaf; ++i) {
+                ltm::BenchStream stream;
+                stream.meta.uid = _next_stream_uid++;
+                stream.meta.episode = episode.uid;
+                stream.meta.start = episode.when.start;
+                stream.meta.end = episode.when.end;
+                stream.data.resize((size_t) std::max(_stream_payload, 0));
+                for (size_t b = 0; b < stream.data.size(); ++b) {
+                    stream.data[b] = (uint8_t) random_int(0, 255);
+                }
+
+                ros::WallTime start = ros::WallTime::now();
+                _streams.ltm_enqueue(stream, _streams.make_metadata(stream));
+                op("stream_add").add(ros::WallTime::now() - start);
+            }
+        }
+
+        uint32_t Bench::add_subtree(uint32_t parent, int level, const ros::Time &start, double span,
+                                    int map, double cx, double cy) {
+            ros::WallTime t = ros::WallTime::now();
+            uint32_t uid = (uint32_t) _db->reserve_uid();
+            op("reserve_uid").add(ros::WallTime::now() - t);
+
+            ltm::Episode episode;
+            episode.uid = uid;
+            episode.parent_id = (level == 0) ? uid : parent;
+            episode.when.start = start;
+            episode.when.end = start + ros::Duration(span);
+
+            if (level == _depth) {
+                fill_leaf(episode, map, cx, cy);
+                if (_streams_per_leaf > 0) {
+                    ltm::StreamRegister reg;
+                    reg.type = "bench";
+                    for (int i = 0; i < _streams_per_leaf; ++i) {
+                        reg.uid = _next_stream_uid + i;
+                        episode.what.streams.push_back(reg);
+                    }
+                }
+                add_streams(episode);
+                _leaves.push_back(uid);
+            } else {
+                // children first, as episodes are added when they finish
+                episode.type = ltm::Episode::EPISODE;
+                double child_span = span / _fanout;
+                for (int i = 0; i < _fanout; ++i) {
+                    ros::Time child_start = start + ros::Duration(i * child_span);
+                    episode.children_ids.push_back(add_subtree(uid, level + 1, child_start, child_span, map, cx, cy));
+                }
+            }
+
+            // Same steps as the episode/add service. fill_leaf stands for the plugins collect of leaves.
+            // Children are added before their parent, so their update_ancestors stops at the missing
+            // parent, which aggregates them on update_from_children. Leaves and nodes are reported
+            // apart, as only nodes read their children.
+            bool leaf = (level == _depth);
+            t = ros::WallTime::now();
+            if (!leaf) _db->update_from_children(episode);
+            bool replace = _db->has(uid);
+            if (replace) {
+                _db->update(episode);
+            } else {
+                _db->insert(episode);
+            }
+            _db->update_ancestors(episode, replace);
+            op(leaf ? "episode_add_leaf" : "episode_add_node").add(ros::WallTime::now() - t);
+            _episodes.push_back(uid);
+            return uid;
+        }
+
+        void Bench::run_episodes() {
+            // one minute per leaf
+            double tree_span = 60.0 * std::pow((double) _fanout, _depth);
+            _span = tree_span * _trees;
+            for (int i = 0; i < _trees; ++i) {
+                int map = random_int(0, _maps - 1);
+                double cx = random_real(0, _extent);
+                double cy = random_real(0, _extent);
+                _roots.push_back(add_subtree(0, 0, _t0 + ros::Duration(i * tree_span), tree_span, map, cx, cy));
+            }
+
+            ros::WallTime t = ros::WallTime::now();
+            _streams.ltm_flush();
+            op("stream_flush").add(ros::WallTime::now() - t);
+        }
+
+        void Bench::run_entities() {
+            // rounds of updates over the whole time span, so histories interleave
+            for (int u = 0; u < _entity_updates; ++u) {
+                for (int e = 1; e <= _entities; ++e) {
+                    ltm::BenchEntity entity;
+                    entity.meta.uid = (uint32_t) e;
+                    entity.meta.stamp = _t0 + ros::Duration(_span * (u + random_real(0, 1)) / _entity_updates);
+                    std::stringstream name;
+                    name << "entity_" << e << "_" << random_int(0, 3);
+                    entity.name = name.str();
+                    entity.location = pick(_location_names);
+                    entity.value = random_real(1.0, 100.0);
+                    entity.features.resize((size_t) std::max(_entity_features, 0));
+                    for (size_t f = 0; f < entity.features.size(); ++f) {
+                        entity.features[f] = random_real(-1.0, 1.0);
+                    }
+
+                    ros::WallTime t = ros::WallTime::now();
+                    _entity_manager.update(entity);
+                    op("entity_add").add(ros::WallTime::now() - t);
+                }
+            }
+        }
+
+        void Bench::run_update_tree() {
+            std::vector<uint32_t>::const_iterator it;
+            for (it = _roots.begin(); it != _roots.end(); ++it) {
+                ros::WallTime t = ros::WallTime::now();
+                _db->update_tree(*it);
+                op("update_tree").add(ros::WallTime::now() - t);
+            }
+        }
+
+        void Bench::run_queries() {
+            if (_episodes.empty()) return;
+            for (int i = 0; i < _queries; ++i) {
+                ros::WallTime t;
+
+                // random time window, a tenth of the span
+                double window = _span * 0.1;
+                ros::Time start = _t0 + ros::Duration(random_real(0, _span - window));
+                ros::Time end = start + ros::Duration(window);
+
+                // db/query: alternates tag, location and time predicates
+                ltm::db::EpisodeQuery query;
+                std::vector<std::string> tags(1, pick(_tag_names));
+                switch (i % 3) {
+                    case 0: query.all_tags(tags); break;
+                    case 1: query.location(pick(_location_names)); break;
+                    default: query.when(start, end); break;
+                }
+                ltm::QueryServer::Response res;
+                t = ros::WallTime::now();
+                _db->query(query, res, false);
+                op("query").add(ros::WallTime::now() - t);
+
+                std::vector<uint32_t> uids;
+                t = ros::WallTime::now();
+                _db->query_when(ltm::QueryWhen::Request::OVERLAP, start, end, uids);
+                op("query_when").add(ros::WallTime::now() - t);
+
+                ltm::QueryWhere::Request where;
+                where.mode = ltm::QueryWhere::Request::RADIUS;
+                where.map_name = map_name(random_int(0, _maps - 1));
+                where.frame_id = "map";
+                where.center.x = random_real(0, _extent);
+                where.center.y = random_real(0, _extent);
+                where.radius = _extent * 0.1;
+                uids.clear();
+                t = ros::WallTime::now();
+                _db->query_where(where, uids);
+                op("query_where").add(ros::WallTime::now() - t);
+
+                std::string expression = pick(_tag_names) + " | (" + pick(_tag_names) + " & !" + pick(_tag_names) + ")";
+                uids.clear();
+                t = ros::WallTime::now();
+                _db->query_tags(expression, true, uids);
+                op("query_tags").add(ros::WallTime::now() - t);
+
+                EpisodeWithMetadataPtr episode_ptr;
+                t = ros::WallTime::now();
+                _db->get((int) pick(_episodes), episode_ptr);
+                op("get").add(ros::WallTime::now() - t);
+
+                if (!_leaves.empty() && _streams_per_leaf > 0) {
+                    std::stringstream json;
+                    json << "{\"episode_uid\": " << pick(_leaves) << "}";
+                    ltm::QueryServer::Response stream_res;
+                    t = ros::WallTime::now();
+                    _streams.ltm_query(json.str(), stream_res);
+                    op("stream_query").add(ros::WallTime::now() - t);
+                }
+
+                if (_entities > 0 && _entity_updates > 0) {
+                    ltm::BenchEntity entity;
+                    ros::Time stamp = _t0 + ros::Duration(random_real(0, _span));
+                    t = ros::WallTime::now();
+                    _entity_manager.ltm_retrace((uint32_t) random_int(1, _entities), stamp, entity);
+                    op("entity_retrace").add(ros::WallTime::now() - t);
+                }
+            }
+        }
+
+        void Bench::run_phase(void (Bench::*phase)()) {
+            // throughput is measured on wall time, so the time between ops is accounted too
+            std::vector<OpStats>::iterator it;
+            for (it = _stats.begin(); it != _stats.end(); ++it) it->begin_phase();
+            ros::WallTime start = ros::WallTime::now();
+            (this->*phase)();
+            ros::WallDuration elapsed = ros::WallTime::now() - start;
+            for (it = _stats.begin(); it != _stats.end(); ++it) it->end_phase(elapsed);
+        }
+
+        void Bench::run() {
+            ROS_INFO_STREAM("[LTM][Bench]: Running with seed (" << _seed << ").");
+            run_phase(&Bench::run_episodes);
+            run_phase(&Bench::run_entities);
+            run_phase(&Bench::run_update_tree);
+            run_phase(&Bench::run_queries);
+            ROS_INFO_STREAM("[LTM][Bench]: Finished with (" << _db->count() << ") episodes, ("
+                            << _streams.ltm_count() << ") streams and (" << _entity_manager.ltm_count() << ") entities.");
+            if (!_keep) _db->drop_db();
+        }
+
+        void Bench::write_config(std::ostream &os) {
+            os << "{\"type\": \"config\", \"label\": ";
+            write_string(os, _label);
+            os << ", \"seed\": " << _seed
+               << ", \"trees\": " << _trees << ", \"depth\": " << _depth << ", \"fanout\": " << _fanout
+               << ", \"episodes\": " << _episodes.size()
+               << ", \"tag_vocabulary\": " << _tag_vocabulary << ", \"tags_per_episode\": " << _tags_per_episode
+               << ", \"maps\": " << _maps << ", \"locations\": " << _locations << ", \"extent\": " << _extent
+               << ", \"streams_per_leaf\": " << _streams_per_leaf << ", \"stream_payload\": " << _stream_payload
+               << ", \"entities\": " << _entities << ", \"entity_updates\": " << _entity_updates
+               << ", \"entity_features\": " << _entity_features
+               << ", \"queries\": " << _queries << "}" << std::endl;
+        }
+
+        void Bench::report() {
+            std::ofstream file;
+            if (!_output.empty()) {
+                // appended, so runs for several commits can share a file
+                file.open(_output.c_str(), std::ios::out | std::ios::app);
+                if (!file.is_open()) {
+                    ROS_ERROR_STREAM("[LTM][Bench]: Could not open output file '" << _output << "'. Using stdout.");
+                }
+            }
+            std::ostream &os = file.is_open() ? file : std::cout;
+            write_config(os);
+            std::vector<OpStats>::const_iterator it;
+            for (it = _stats.begin(); it != _stats.end(); ++it) {
+                it->write_json(os, _label);
+            }
+        }
+
+    }
+}
+
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "ltm_bench");
+    ros::NodeHandle priv("~");
+
+    ltm::bench::Bench bench;
+    bench.run();
+    bench.report();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <ltm/db/collection_counter.h>
+#include <ltm/db/types.h>
+#include <ros/ros.h>
+#include <algorithm>
+
+namespace ltm {
+    namespace db {
+
+        // =================================================================================================================
+        // CollectionCounter
+        // =================================================================================================================
+
+        CollectionCounter::CollectionCounter() : _value(0), _attached(false) {}
+
+        CollectionCounter::~CollectionCounter() {
+            detach();
+        }
+
+        void CollectionCounter::attach(const std::string &name, const Source &source) {
+            DBLock lock(db_mutex());
+            _source = source;
+            CounterRegistry::instance().add(this, name);
+            _attached = true;
+            reconcile();
+        }
+
+        void CollectionCounter::detach() {
+            DBLock lock(db_mutex());
+            if (_attached) CounterRegistry::instance().remove(this);
+            _attached = false;
+        }
+
+        void CollectionCounter::add(int n) {
+            _value += n;
+        }
+
+        void CollectionCounter::sub(int n) {
+            _value -= n;
+        }
+
+        int CollectionCounter::get() const {
+            int value = _value;
+            return value > 0 ? value : 0;
+        }
+
+        std::string CollectionCounter::name() const {
+            return _name;
+        }
+
+        bool CollectionCounter::reconcile() {
+            // writers update the value under the same lock, so the DB count is not racing them
+            DBLock lock(db_mutex());
+            if (!_source) return false;
+            int db_count;
+            try {
+                db_count = _source();
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Could not count the documents of collection '" << _name << "'. " << ex.what());
+                return false;
+            } catch (const ltm_db::DbConnectException &ex) {
+                ROS_ERROR_STREAM("Could not count the documents of collection '" << _name << "'. " << ex.what());
+                return false;
+            }
+            int value = _value.exchange(db_count);
+            ROS_DEBUG_STREAM_COND(value != db_count, "Counter for collection '" << _name << "' drifted from ("
+                                                     << value << ") to (" << db_count << ") entries.");
+            return true;
+        }
+
+        // =================================================================================================================
+        // CounterRegistry
+        // =================================================================================================================
+
+        CounterRegistry::CounterRegistry() : _drifted(0) {}
+
+        CounterRegistry::~CounterRegistry() {}
+
+        CounterRegistry &CounterRegistry::instance() {
+            static CounterRegistry registry;
+            return registry;
+        }
+
+        void CounterRegistry::add(CollectionCounter *counter, const std::string &name) {
+            // names are read by get_counts() under this mutex only
+            boost::mutex::scoped_lock lock(_mutex);
+            counter->_name = name;
+            _counters.insert(counter);
+        }
+
+        void CounterRegistry::remove(CollectionCounter *counter) {
+            boost::mutex::scoped_lock lock(_mutex);
+            _counters.erase(counter);
+        }
+
+        size_t CounterRegistry::reconcile_all() {
+            // counters cannot be detached while db_mutex() is held
+            DBLock lock(db_mutex());
+            std::vector<CollectionCounter *> counters;
+            {
+                boost::mutex::scoped_lock registry_lock(_mutex);
+                counters.assign(_counters.begin(), _counters.end());
+            }
+            size_t drifted = 0;
+            std::vector<CollectionCounter *>::const_iterator it;
+            for (it = counters.begin(); it != counters.end(); ++it) {
+                int value = (*it)->get();
+                if ((*it)->reconcile() && (*it)->get() != value) ++drifted;
+            }
+            {
+                boost::mutex::scoped_lock registry_lock(_mutex);
+                _drifted += drifted;
+            }
+            ROS_DEBUG_STREAM("Reconciled (" << counters.size() << ") collection counters, ("
+                                            << drifted << ") drifted.");
+            return drifted;
+        }
+
+        void CounterRegistry::get_counts(std::vector<std::pair<std::string, int> > &counts) {
+            boost::mutex::scoped_lock lock(_mutex);
+            counts.clear();
+            std::set<CollectionCounter *>::const_iterator it;
+            for (it = _counters.begin(); it != _counters.end(); ++it) {
+                counts.push_back(std::make_pair((*it)->name(), (*it)->get()));
+            }
+            std::sort(counts.begin(), counts.end());
+        }
+
+        void CounterRegistry::append_status(std::stringstream &status) {
+            boost::mutex::scoped_lock lock(_mutex);
+            status << "Collection counters: " << _counters.size() << " (" << _drifted
+                   << " drifts corrected)" << std::endl;
+        }
+
+    }
+}
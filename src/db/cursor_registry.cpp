@@ -0,0 +1,145 @@
+#include <ltm/db/cursor_registry.h>
+#include <boost/uuid/uuid_io.hpp>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <limits>
+
+namespace ltm {
+    namespace db {
+
+        // =================================================================================================================
+        // ResultCursor
+        // =================================================================================================================
+
+        ResultCursor::ResultCursor(const ltm::QueryServer::Response &res, bool sorted, bool ascending) : _res(res), _offset(0) {
+            if (!sorted) return;
+            std::vector<std::vector<uint32_t> *> lists;
+            lists.push_back(&_res.episodes);
+            std::vector<ltm::QueryResult>::iterator it;
+            for (it = _res.streams.begin(); it != _res.streams.end(); ++it) lists.push_back(&it->uids);
+            for (it = _res.entities.begin(); it != _res.entities.end(); ++it) lists.push_back(&it->uids);
+            for (it = _res.entities_trail.begin(); it != _res.entities_trail.end(); ++it) lists.push_back(&it->uids);
+
+            std::vector<std::vector<uint32_t> *>::iterator l_it;
+            for (l_it = lists.begin(); l_it != lists.end(); ++l_it) {
+                if (ascending) {
+                    std::sort((*l_it)->begin(), (*l_it)->end());
+                } else {
+                    std::sort((*l_it)->begin(), (*l_it)->end(), std::greater<uint32_t>());
+                }
+            }
+        }
+
+        bool ResultCursor::page(const std::vector<uint32_t> &source, size_t limit, std::vector<uint32_t> &uids) {
+            uids.clear();
+            if (_offset >= source.size()) return false;
+            size_t end = (limit == 0) ? source.size() : std::min(source.size(), _offset + limit);
+            uids.assign(source.begin() + _offset, source.begin() + end);
+            return end < source.size();
+        }
+
+        bool ResultCursor::page(const std::vector<ltm::QueryResult> &source, size_t limit, std::vector<ltm::QueryResult> &results) {
+            bool more = false;
+            results.clear();
+            results.reserve(source.size());
+            std::vector<ltm::QueryResult>::const_iterator it;
+            for (it = source.begin(); it != source.end(); ++it) {
+                ltm::QueryResult qr;
+                qr.type = it->type;
+                more = page(it->uids, limit, qr.uids) || more;
+                results.push_back(qr);
+            }
+            return more;
+        }
+
+        bool ResultCursor::next(size_t limit, ltm::QueryServer::Response &res) {
+            bool more = page(_res.episodes, limit, res.episodes);
+            more = page(_res.streams, limit, res.streams) || more;
+            more = page(_res.entities, limit, res.entities) || more;
+            more = page(_res.entities_trail, limit, res.entities_trail) || more;
+            _offset = (limit == 0) ? std::numeric_limits<size_t>::max() : _offset + limit;
+            return more;
+        }
+
+        // =================================================================================================================
+        // CursorRegistry
+        // =================================================================================================================
+
+        CursorRegistry::CursorRegistry(double ttl, size_t max_cursors) : _ttl(ttl), _max_cursors(max_cursors) {}
+
+        CursorRegistry::~CursorRegistry() {}
+
+        void CursorRegistry::set_options(double ttl, size_t max_cursors) {
+            boost::mutex::scoped_lock lock(_mutex);
+            _ttl = ttl > 0 ? ttl : 60.0;
+            _max_cursors = max_cursors > 0 ? max_cursors : 1;
+        }
+
+        void CursorRegistry::expire(std::vector<QueryCursorPtr> &dropped) {
+            ros::WallTime now = ros::WallTime::now();
+            std::map<std::string, Entry>::iterator it = _cursors.begin();
+            while (it != _cursors.end()) {
+                if (it->second.expires < now) {
+                    dropped.push_back(it->second.cursor);
+                    _cursors.erase(it++);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        std::string CursorRegistry::put(const QueryCursorPtr &cursor) {
+            std::vector<QueryCursorPtr> dropped;
+            boost::mutex::scoped_lock lock(_mutex);
+            expire(dropped);
+
+            // make room, dropping the cursors closer to expire
+            while (_cursors.size() >= _max_cursors && !_cursors.empty()) {
+                std::map<std::string, Entry>::iterator oldest = _cursors.begin();
+                std::map<std::string, Entry>::iterator it;
+                for (it = _cursors.begin(); it != _cursors.end(); ++it) {
+                    if (it->second.expires < oldest->second.expires) oldest = it;
+                }
+                ROS_WARN_STREAM("Too many open query cursors (" << _max_cursors << "). Dropping cursor '" << oldest->first << "'.");
+                dropped.push_back(oldest->second.cursor);
+                _cursors.erase(oldest);
+            }
+
+            // random (version 4) UUID, so tokens cannot be guessed from previous ones
+            std::stringstream token;
+            token << _tokens();
+
+            Entry entry;
+            entry.cursor = cursor;
+            entry.expires = ros::WallTime::now() + ros::WallDuration(_ttl);
+            _cursors[token.str()] = entry;
+            return token.str();
+        }
+
+        QueryCursorPtr CursorRegistry::take(const std::string &token) {
+            std::vector<QueryCursorPtr> dropped;
+            boost::mutex::scoped_lock lock(_mutex);
+            expire(dropped);
+            std::map<std::string, Entry>::iterator it = _cursors.find(token);
+            if (it == _cursors.end()) return QueryCursorPtr();
+            QueryCursorPtr cursor = it->second.cursor;
+            _cursors.erase(it);
+            return cursor;
+        }
+
+        void CursorRegistry::clear() {
+            std::map<std::string, Entry> cursors;
+            boost::mutex::scoped_lock lock(_mutex);
+            _cursors.swap(cursors);
+        }
+
+        size_t CursorRegistry::size() {
+            std::vector<QueryCursorPtr> dropped;
+            boost::mutex::scoped_lock lock(_mutex);
+            expire(dropped);
+            return _cursors.size();
+        }
+
+    }
+}
@@ -0,0 +1,13 @@
+#include <ltm/db/db_lock.h>
+
+namespace ltm {
+    namespace db {
+
+        DBMutex &db_mutex() {
+            // single instance for the server and all loaded plugins
+            static DBMutex mutex;
+            return mutex;
+        }
+
+    }
+}
@@ -3,6 +3,13 @@
 #include <ltm/db/episode_collection.h>
 #include <algorithm>
 #include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
 
 // get random uid
 #include <time.h>
@@ -22,6 +29,16 @@ namespace ltm {
             // reserved uids are cleared on startup
             _reserved_uids.clear();
             _db_uids.clear();
+            _next_uid = 1;
+            _sequential_uids = false;
+            _scope = _db_name + "." + _db_collection_name;
+            _last_revision = 0;
+            _query_sorted = false;
+            _query_max_results = 0;
+            _tree_grain = 64;
+            _generation = 0;
+            _version = 0;
+            _indexes_complete = false;
             std::srand((uint) time(NULL));
         }
 
@@ -33,6 +50,245 @@ namespace ltm {
         // =================================================================================================================
         //
 
+        double EpisodeCollectionManager::next_revision() {
+            // Strictly increasing microseconds. Seeded with the last stored revision on setup, so revisions
+            // keep increasing across restarts even if the clock went back (e.g., booting before a time sync).
+            double now = std::floor(ros::WallTime::now().toSec() * 1e6);
+            _last_revision = std::max(now, _last_revision + 1);
+            return _last_revision;
+        }
+
+        void EpisodeCollectionManager::insert_revision(const ltm::Episode &episode, double revision) {
+            MetadataPtr meta = make_metadata(episode);
+            meta->append("revision", revision);
+            DBLock lock(db_mutex());
+            _coll->insert(episode, meta);
+            _counter.add();
+            ++_version;
+            _cache.erase(episode.uid);
+            index_episode(episode);
+            QueryCache::instance().invalidate(_scope);
+        }
+
+        void EpisodeCollectionManager::remove_older_revisions(const std::vector<uint32_t> &uids, double revision) {
+            // documents stored before revisions existed are also older.
+            std::stringstream json;
+            json << "{ $and: [" << ltm::util::json_in("uid", uids)
+                 << ", { $or: [ { revision: { $lt: " << std::setprecision(17) << revision << " } }"
+                 << ", { revision: { $exists: false } } ] } ] }";
+            DBLock lock(db_mutex());
+            QueryPtr query = _coll->createQuery();
+            query->append(json.str());
+            _counter.sub((int) _coll->removeMessages(query));
+        }
+
+        void EpisodeCollectionManager::reset_uid_allocator() {
+            // The high-water mark is persisted by the collection itself: the largest stored uid.
+            // This is a single sorted (index backed) read at setup time, reservations never touch the DB.
+            int max_uid = 0;
+            try {
+                DBLock lock(db_mutex());
+                QueryPtr query = _coll->createQuery();
+                ltm_db::QueryResults<Episode>::range_t range = _coll->query(query, true, "uid", false);
+                if (range.first != range.second) {
+                    CostContext::read(1);
+                    max_uid = (*range.first)->lookupInt("uid");
+                }
+            } catch (const mongo::exception &ex) {
+                // stored uids are unknown, counting from anywhere could hand them out again
+                ROS_ERROR_STREAM("Error while looking for the max episode uid. Using random uids. " << ex.what());
+                _sequential_uids = false;
+                _next_uid = 1;
+                return;
+            }
+            _sequential_uids = true;
+            _next_uid = std::max(max_uid, 0) + 1;
+            ROS_DEBUG_STREAM("Episode uid allocator starts at: " << _next_uid);
+        }
+
+        int EpisodeCollectionManager::reserve_random_uid() {
+            // Returns a pseudo-random integral number in the range between 1 and RAND_MAX.
+            uint32_t max_int32 = std::numeric_limits<uint32_t>::max();
+            int max_int = std::numeric_limits<int>::max();
+            int upper_bound = max_int32 > max_int ? max_int : max_int32;
+
+            int db_size = count();
+            int reserved_ids = (int) _reserved_uids.size();
+            if (upper_bound <= db_size + reserved_ids) {
+                ROS_WARN_STREAM(
+                        "There aren't any available uids. Max entries: "
+                                << upper_bound
+                                << ". LTM DB has (" << db_size << ") entries."
+                                << " There are (" << reserved_ids << ") reserved uids."
+                );
+                return -1;
+            }
+
+            int value;
+            std::set<int>::iterator it;
+            while (true) {
+                value = rand() % upper_bound;
+                if (value == 0) continue;
+
+                // value is already reserved
+                it = _reserved_uids.find(value);
+                if (it != _reserved_uids.end()) continue;
+
+                // value is in db cache
+                it = _db_uids.find(value);
+                if (it != _db_uids.end()) continue;
+
+                // value is already in DB
+                if (has(value)) {
+                    _db_uids.insert(value);
+                    continue;
+                }
+                break;
+            }
+            _reserved_uids.insert(value);
+            return value;
+        }
+
+        void EpisodeCollectionManager::index_episode(const ltm::Episode &episode) {
+            // same time representation as make_meta_when
+            double start = episode.when.start.sec + episode.when.start.nsec * pow10(-9);
+            double end = episode.when.end.sec + episode.when.end.nsec * pow10(-9);
+            _when_index.insert(episode.uid, start, end);
+
+            // parents cover their children hull, leaves (and parents without one) their position
+            const Where &where = episode.where;
+            if (episode.type == ltm::Episode::EPISODE && !where.children_hull.empty()) {
+                _where_index.insert(episode.uid, where.map_name, where.frame_id, where.children_hull);
+            } else {
+                _where_index.insert(episode.uid, where.map_name, where.frame_id,
+                                    std::vector<geometry_msgs::Point>(1, where.position));
+            }
+            _tag_index.insert(episode.uid, episode.tags, episode.children_tags);
+        }
+
+        bool EpisodeCollectionManager::index_metadata(const EpisodeWithMetadata &doc) {
+            // flat fields written by make_meta_when and make_meta_extent, documents stored before them must be read whole
+            if (!doc.lookupField("when_start") || !doc.lookupField("where_min_x")) return false;
+            uint32_t uid = (uint32_t) doc.lookupInt("uid");
+            _when_index.insert(uid, doc.lookupDouble("when_start"), doc.lookupDouble("when_end"));
+
+            // the location index only keeps the bounding box of the points
+            std::vector<geometry_msgs::Point> corners(2);
+            corners[0].x = doc.lookupDouble("where_min_x");
+            corners[0].y = doc.lookupDouble("where_min_y");
+            corners[1].x = doc.lookupDouble("where_max_x");
+            corners[1].y = doc.lookupDouble("where_max_y");
+            _where_index.insert(uid, doc.lookupString("where_map_name"), doc.lookupString("where_frame_id"), corners);
+
+            std::vector<std::string> tags, children_tags;
+            doc.lookupStringArray("tags", tags);
+            doc.lookupStringArray("children_tags", children_tags);
+            _tag_index.insert(uid, tags, children_tags);
+            return true;
+        }
+
+        void EpisodeCollectionManager::unindex_episode(uint32_t uid) {
+            _when_index.remove(uid);
+            _where_index.remove(uid);
+            _tag_index.remove(uid);
+        }
+
+        static double document_revision(const EpisodeWithMetadata &doc) {
+            // documents stored before revisions existed are older than any other
+            return doc.lookupField("revision") ? doc.lookupDouble("revision") : -1.0;
+        }
+
+        void EpisodeCollectionManager::rebuild_indexes() {
+            // Only the last revision of each uid is indexed. Older ones are left by a crash (or a failed
+            // remove) between writing a revision and removing the previous ones, and are removed here.
+            _when_index.clear();
+            _where_index.clear();
+            _tag_index.clear();
+            _indexes_complete = false;
+            boost::unordered_map<uint32_t, double> revisions;
+            boost::unordered_map<uint32_t, double>::iterator r_it;
+            std::set<uint32_t> stale;
+            std::set<uint32_t> legacy;
+            try {
+                DBLock lock(db_mutex());
+
+                // from the metadata only
+                QueryPtr query = _coll->createQuery();
+                ltm_db::QueryResults<Episode>::range_t range = _coll->query(query, true);
+                for (ltm_db::ResultIterator<Episode> it = range.first; it != range.second; ++it) {
+                    const EpisodeWithMetadata &doc = **it;
+                    CostContext::read(1);
+                    uint32_t uid = (uint32_t) doc.lookupInt("uid");
+                    double revision = document_revision(doc);
+                    _last_revision = std::max(_last_revision, revision);
+                    r_it = revisions.find(uid);
+                    if (r_it != revisions.end()) {
+                        stale.insert(uid);
+                        if (revision <= r_it->second) continue;
+                        r_it->second = revision;
+                    } else {
+                        revisions[uid] = revision;
+                    }
+                    if (index_metadata(doc)) {
+                        legacy.erase(uid);
+                    } else {
+                        legacy.insert(uid);
+                    }
+                }
+
+                // documents stored before the flat fields, from the whole episodes
+                if (!legacy.empty()) {
+                    query = _coll->createQuery();
+                    query->append(ltm::util::json_in("uid", std::vector<uint32_t>(legacy.begin(), legacy.end())));
+                    range = _coll->query(query, false);
+                    for (ltm_db::ResultIterator<Episode> it = range.first; it != range.second; ++it) {
+                        const EpisodeWithMetadata &episode = **it;
+                        CostContext::read(1);
+                        if (document_revision(episode) < revisions[episode.uid]) continue;
+                        index_episode(episode);
+                    }
+                    ROS_INFO_STREAM("(" << legacy.size() << ") episodes were indexed from their whole documents. "
+                                    << "Replace them to store their index fields.");
+                }
+                _indexes_complete = true;
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Error while building the episode indexes. " << ex.what());
+            }
+
+            std::set<uint32_t>::const_iterator s_it;
+            for (s_it = stale.begin(); s_it != stale.end(); ++s_it) {
+                double revision = revisions[*s_it];
+                if (revision < 0) {
+                    ROS_WARN_STREAM("Episode (" << *s_it << ") has several documents without a revision, keeping them all.");
+                    continue;
+                }
+                remove_older_revisions(std::vector<uint32_t>(1, *s_it), revision);
+            }
+            ROS_WARN_STREAM_COND(!stale.empty(), "Removed older revisions of (" << stale.size() << ") episodes.");
+            ROS_DEBUG_STREAM("Episode indexes have (" << _when_index.size() << ") intervals, ("
+                                                      << _where_index.size() << ") locations and ("
+                                                      << _tag_index.tags() << ") tags.");
+        }
+
+        EpisodeCollectionPtr EpisodeCollectionManager::read_collection() {
+            // Each thread reads through its own connection, the shared one is only used for writes.
+            ReadHandle *handle = _read_handle.get();
+            if (handle && handle->generation == _generation) return handle->coll;
+            try {
+                DBConnectionPtr conn = StorageBackend::instance().create_connection();
+                conn->setParams(_db_host, _db_port, _db_timeout);
+                conn->connect();
+                handle = new ReadHandle();
+                handle->generation = _generation;
+                handle->conn = conn;
+                handle->coll = open_collection<Episode>(conn, _db_name, _db_collection_name);
+                _read_handle.reset(handle);
+                return handle->coll;
+            } catch (const ltm_db::DbConnectException &exception) {
+                ROS_ERROR_STREAM("Could not open a read connection to DB '" << _db_name << "'. Using the shared one.");
+            }
+            return _coll;
+        }
 
         // =================================================================================================================
         // Public API
@@ -49,14 +305,29 @@ namespace ltm {
         }
 
         void EpisodeCollectionManager::setup() {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+
             // setup DB
             try {
+                DBLock lock(db_mutex());
                 // host, port, timeout
-                _conn.reset(new ltm_db_mongo::MongoDatabaseConnection());
+                _conn = StorageBackend::instance().create_connection();
                 _conn->setParams(_db_host, _db_port, _db_timeout);
                 _conn->connect();
-                _coll = _conn->openCollectionPtr<Episode>(_db_name, _db_collection_name);
+                _coll = open_collection<Episode>(_conn, _db_name, _db_collection_name);
                 EpisodeMetadataBuilder::setup(_coll);
+                _scope = _db_name + "." + _db_collection_name;
+                QueryCache::instance().invalidate(_scope);
+
+                static const char *indexes[] = {"uid", "parent_id", "when.start", "when.end"};
+                IndexProvisioner::instance().provision(_db_name, _db_collection_name, "episodes",
+                        std::vector<std::string>(indexes, indexes + sizeof(indexes) / sizeof(indexes[0])));
+                reset_uid_allocator();
+                rebuild_indexes();
+                _counter.attach(_scope, boost::bind(&EpisodeCollectionManager::db_count, this));
+                // drop per-thread read connections
+                ++_generation;
+                ++_version;
             }
             catch (const ltm_db::DbConnectException &exception) {
                 // Connection timeout
@@ -77,127 +348,452 @@ namespace ltm {
         // -----------------------------------------------------------------------------------------------------------------
 
         bool EpisodeCollectionManager::insert(const ltm::Episode &episode) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
             // insert into DB
-            _coll->insert(episode, make_metadata(episode));
+            insert_revision(episode, next_revision());
 
             // insert into cache
             _db_uids.insert(episode.uid);
+            if ((int) episode.uid >= _next_uid) _next_uid = episode.uid + 1;
             return true;
         }
 
-        bool EpisodeCollectionManager::query(const std::string &json, ltm::QueryServer::Response &res, bool logging) {
-            std::vector<EpisodeWithMetadataPtr> result;
+        bool EpisodeCollectionManager::insert_many(const std::vector<ltm::Episode> &episodes) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            // ltm_db does not provide a bulk insert: write documents back to back, without any lookup in between.
+            double revision = next_revision();
+            std::vector<ltm::Episode>::const_iterator it;
+            for (it = episodes.begin(); it != episodes.end(); ++it) {
+                insert_revision(*it, revision);
+            }
+
+            // insert into cache
+            for (it = episodes.begin(); it != episodes.end(); ++it) {
+                _db_uids.insert(it->uid);
+                if ((int) it->uid >= _next_uid) _next_uid = it->uid + 1;
+            }
+            return true;
+        }
+
+        // Pages an episode query from its own DB cursor. The connection is held by the cursor, as it
+        // outlives the request and can be continued from any thread, and is given back when it closes.
+        //
+        // Pages are read from the live DB cursor: episodes written after the query may or may not be
+        // returned. Only a drop or switch of the database invalidates the cursor.
+        class EpisodeCollectionManager::Cursor : public QueryCursor {
+        public:
+            EpisodeCollectionManager *manager;
+            DBConnectionPtr conn;
+            EpisodeCollectionPtr coll;
+            ltm_db::QueryResults<Episode>::range_t range;
+            size_t generation;
+
+            ~Cursor() {
+                // the DB cursor is closed before its connection is reused
+                range = ltm_db::QueryResults<Episode>::range_t();
+                coll.reset();
+                if (conn) manager->release_cursor_connection(conn, generation);
+            }
+
+            bool next(size_t limit, ltm::QueryServer::Response &res) {
+                ltm::util::ReentrantSharedMutex::ReadLock r_lock(manager->_mutex);
+                if (generation != manager->_generation) {
+                    // the database was dropped or switched
+                    ROS_WARN_STREAM("Query cursor is no longer valid, the episode collection was reset.");
+                    res.episodes.clear();
+                    res.streams.clear();
+                    res.entities.clear();
+                    res.entities_trail.clear();
+                    return false;
+                }
+                return manager->fill_page(range, limit, res, false);
+            }
+        };
+
+        DBConnectionPtr EpisodeCollectionManager::take_cursor_connection() {
+            {
+                boost::mutex::scoped_lock lock(_cursor_conns_mutex);
+                while (!_cursor_conns.empty()) {
+                    std::pair<size_t, DBConnectionPtr> idle = _cursor_conns.back();
+                    _cursor_conns.pop_back();
+                    // connections to a dropped or switched database are closed
+                    if (idle.first == _generation) return idle.second;
+                }
+            }
+            DBConnectionPtr conn = StorageBackend::instance().create_connection();
+            conn->setParams(_db_host, _db_port, _db_timeout);
+            conn->connect();
+            return conn;
+        }
+
+        void EpisodeCollectionManager::release_cursor_connection(const DBConnectionPtr &conn, size_t generation) {
+            // open cursors are bounded by the registry, idle connections by this
+            static const size_t max_idle = 4;
+            boost::mutex::scoped_lock lock(_cursor_conns_mutex);
+            if (generation != _generation || _cursor_conns.size() >= max_idle) return;
+            _cursor_conns.push_back(std::make_pair(generation, conn));
+        }
+
+        bool EpisodeCollectionManager::fill_page(ltm_db::QueryResults<Episode>::range_t &range, size_t limit,
+                                                 ltm::QueryServer::Response &res, bool logging, bool *failed) {
+            // requires a read lock
             res.episodes.clear();
             res.entities.clear();
             res.streams.clear();
 
-            // generate query and collect documents.
+            // Retrieve uids, documents are pulled from the cursor one by one (metadata only)
+            QueryAggregator aggregator(_query_sorted, _query_max_results);
+            std::vector<uint32_t> legacy_uids;
+            bool more = false;
             try {
-                QueryPtr query = _coll->createQuery();
-                query->append(json);
-                // TODO: solve this only using metadata!
-                // result = _coll->queryList(query, true);
-                result = _coll->queryList(query, false);
-            } catch (const ltm_db::NoMatchingMessageException &exception) {
-                return false;
-            } catch (const mongo::exception &ex) {
-                ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
-            }
+                for (size_t n = 0; range.first != range.second; ++range.first, ++n) {
+                    if (limit > 0 && n >= limit) {
+                        more = true;
+                        break;
+                    }
+                    EpisodeWithMetadataPtr doc = *range.first;
+                    CostContext::read(1);
+                    uint32_t uid = (uint32_t) doc->lookupInt("uid");
 
-            // Retrieve uids
-            int s_cnt = 0, e_cnt = 0;
-            std::map<std::string, ltm::QueryResult> stream_r;
-            std::map<std::string, ltm::QueryResult> entity_r;
-            std::map<std::string, ltm::QueryResult>::iterator q_it;
-            std::vector<EpisodeWithMetadataPtr>::const_iterator it;
-            for (it = result.begin(); it != result.end(); ++it) {
+                    // fill episode uids
+                    aggregator.add_episode(uid);
 
-                // fill episode uids
-                res.episodes.push_back((uint32_t)(*it)->lookupInt("uid"));
-
-                // retrieve stream QueryResults
-                std::vector<ltm::StreamRegister>::const_iterator s_cit;
-                for (s_cit = (*it)->what.streams.begin(); s_cit != (*it)->what.streams.end(); ++s_cit) {
-
-                    // create QueryResult if not exists
-                    q_it = stream_r.find(s_cit->type);
-                    if (q_it == stream_r.end()) {
-                        ltm::QueryResult qr;
-                        qr.type = s_cit->type;
-                        qr.uids.push_back(s_cit->uid);
-                        stream_r[s_cit->type] = qr;
-                        s_cnt++;
+                    // documents stored before the flat registers existed must be deserialized
+                    if (!doc->lookupField("what_streams_uid")) {
+                        legacy_uids.push_back(uid);
                         continue;
                     }
 
-                    // append unique uid
-                    std::vector<uint32_t>::const_iterator u_it;
-                    u_it = std::find(q_it->second.uids.begin(), q_it->second.uids.end(), s_cit->uid);
-                    if (u_it == q_it->second.uids.end()) {
-                        q_it->second.uids.push_back(s_cit->uid);
-                        s_cnt++;
+                    std::vector<std::string> types;
+                    std::vector<uint32_t> uids;
+                    doc->lookupStringArray("what_streams_type", types);
+                    doc->lookupUInt32Array("what_streams_uid", uids);
+                    for (size_t i = 0; i < types.size() && i < uids.size(); ++i) {
+                        aggregator.add_stream(types[i], uids[i]);
                     }
-                }
 
-                // retrieve entity QueryResults
-                std::vector<ltm::EntityRegister>::const_iterator e_cit;
-                for (e_cit = (*it)->what.entities.begin(); e_cit != (*it)->what.entities.end(); ++e_cit) {
-
-                    // create QueryResult if not exists
-                    q_it = entity_r.find(e_cit->type);
-                    if (q_it == entity_r.end()) {
-                        ltm::QueryResult qr;
-                        qr.type = e_cit->type;
-                        qr.uids.push_back(e_cit->uid);
-                        entity_r[e_cit->type] = qr;
-                        e_cnt++;
-                        continue;
+                    types.clear();
+                    uids.clear();
+                    doc->lookupStringArray("what_entities_type", types);
+                    doc->lookupUInt32Array("what_entities_uid", uids);
+                    for (size_t i = 0; i < types.size() && i < uids.size(); ++i) {
+                        aggregator.add_entity(types[i], uids[i]);
                     }
+                }
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
+                more = false;
+                if (failed) *failed = true;
+            }
 
-                    // append unique uid
-                    std::vector<uint32_t>::const_iterator u_it;
-                    u_it = std::find(q_it->second.uids.begin(), q_it->second.uids.end(), e_cit->uid);
-                    if (u_it == q_it->second.uids.end()) {
-                        q_it->second.uids.push_back(e_cit->uid);
-                        e_cnt++;
+            // fallback for legacy documents
+            if (!legacy_uids.empty()) {
+                std::vector<EpisodeWithMetadataPtr> legacy;
+                std::vector<uint32_t> not_found;
+                if (!get_many(legacy_uids, legacy, not_found) && failed) *failed = true;
+                std::vector<EpisodeWithMetadataPtr>::const_iterator it;
+                for (it = legacy.begin(); it != legacy.end(); ++it) {
+                    std::vector<ltm::StreamRegister>::const_iterator s_cit;
+                    for (s_cit = (*it)->what.streams.begin(); s_cit != (*it)->what.streams.end(); ++s_cit) {
+                        aggregator.add_stream(s_cit->type, s_cit->uid);
+                    }
+                    std::vector<ltm::EntityRegister>::const_iterator e_cit;
+                    for (e_cit = (*it)->what.entities.begin(); e_cit != (*it)->what.entities.end(); ++e_cit) {
+                        aggregator.add_entity(e_cit->type, e_cit->uid);
                     }
                 }
+            }
+
+            // Fill episode/stream/entity QueryResults
+            aggregator.fill(res);
+
+            ROS_INFO_STREAM_COND(logging, "Found (" << aggregator.episodes_count() << ") matches, with ("
+                                      << aggregator.streams_count() << ") instances of ("
+                                      << aggregator.stream_types_count() << ") streams, and ("
+                                      << aggregator.entities_count() << ") instances of ("
+                                      << aggregator.entity_types_count() << ") entities.");
+            return more;
+        }
 
+        bool EpisodeCollectionManager::query(const std::string &json, ltm::QueryServer::Response &res, bool logging) {
+            return query(EpisodeQuery().json(json), res, logging);
+        }
+
+        bool EpisodeCollectionManager::query(const EpisodeQuery &episode_query, ltm::QueryServer::Response &res, bool logging) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            // writers hold the write lock, so cached results cannot change under this one
+            if (QueryCache::instance().get("episode", "", episode_query.key(), _scope, res)) {
+                ROS_INFO_STREAM_COND(logging, "Found (" << res.episodes.size() << ") cached matches.");
+                return true;
             }
+            EpisodeCollectionPtr coll = read_collection();
+            ltm_db::QueryResults<Episode>::range_t range;
 
-            // Fill stream/entity QueryResults
-            for (q_it = stream_r.begin(); q_it != stream_r.end(); ++q_it) {
-                res.streams.push_back(q_it->second);
+            // generate query, documents are collected by fill_page
+            try {
+                QueryPtr query = coll->createQuery();
+                episode_query.compile(query);
+                range = coll->query(query, true);
+            } catch (const ltm_db::NoMatchingMessageException &exception) {
+                return false;
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
+                return false;
             }
-            for (q_it = entity_r.begin(); q_it != entity_r.end(); ++q_it) {
-                res.entities.push_back(q_it->second);
+            bool failed = false;
+            fill_page(range, 0, res, logging, &failed);
+            if (!failed) QueryCache::instance().put("episode", "", episode_query.key(), _scope, res);
+            return true;
+        }
+
+        QueryCursorPtr EpisodeCollectionManager::open_cursor(const std::string &json, const std::string &sort_by, bool ascending) {
+            return open_cursor(EpisodeQuery().json(json), sort_by, ascending);
+        }
+
+        QueryCursorPtr EpisodeCollectionManager::open_cursor(const EpisodeQuery &episode_query, const std::string &sort_by, bool ascending) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            boost::shared_ptr<Cursor> cursor(new Cursor());
+            cursor->manager = this;
+            cursor->generation = _generation;
+            try {
+                cursor->conn = take_cursor_connection();
+                cursor->coll = open_collection<Episode>(cursor->conn, _db_name, _db_collection_name);
+
+                QueryPtr query = cursor->coll->createQuery();
+                episode_query.compile(query);
+                cursor->range = cursor->coll->query(query, true, sort_by, ascending);
+            } catch (const ltm_db::DbConnectException &exception) {
+                ROS_ERROR_STREAM("Could not open a cursor connection to DB '" << _db_name << "'.");
+                return QueryCursorPtr();
+            } catch (const mongo::exception &ex) {
+                ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
+                return QueryCursorPtr();
             }
+            return cursor;
+        }
 
-            ROS_INFO_STREAM_COND(logging, "Found (" << result.size() << ") matches, with (" << s_cnt << ") instances of ("
-                                      << res.streams.size() << ") streams, and (" << e_cnt << ") instances of ("
-                                      << res.entities.size() << ") entities.");
+        bool EpisodeCollectionManager::query_when(uint8_t mode, const ros::Time &start, const ros::Time &end, std::vector<uint32_t> &uids) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            uids.clear();
+            double t_start = start.sec + start.nsec * pow10(-9);
+            double t_end = end.sec + end.nsec * pow10(-9);
+            switch (mode) {
+                case ltm::QueryWhen::Request::OVERLAP:
+                    _when_index.query_overlap(t_start, t_end, uids);
+                    break;
+                case ltm::QueryWhen::Request::CONTAINED:
+                    _when_index.query_contained(t_start, t_end, uids);
+                    break;
+                case ltm::QueryWhen::Request::BEFORE:
+                    _when_index.query_before(t_start, uids);
+                    break;
+                case ltm::QueryWhen::Request::AFTER:
+                    _when_index.query_after(t_start, uids);
+                    break;
+                default:
+                    ROS_WARN_STREAM("Unsupported time query mode: " << (int) mode);
+                    return false;
+            }
+            if (_query_max_results > 0 && uids.size() > _query_max_results) uids.resize(_query_max_results);
             return true;
         }
 
+        bool EpisodeCollectionManager::query_where(const ltm::QueryWhere::Request &req, std::vector<uint32_t> &uids) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            uids.clear();
+            switch (req.mode) {
+                case ltm::QueryWhere::Request::RADIUS:
+                    _where_index.query_radius(req.map_name, req.frame_id, req.center, req.radius, uids);
+                    break;
+                case ltm::QueryWhere::Request::POLYGON:
+                    _where_index.query_polygon(req.map_name, req.frame_id, req.polygon, uids);
+                    break;
+                case ltm::QueryWhere::Request::NEAREST:
+                    _where_index.query_nearest(req.map_name, req.frame_id, req.center, req.k, uids);
+                    break;
+                default:
+                    ROS_WARN_STREAM("Unsupported location query mode: " << (int) req.mode);
+                    return false;
+            }
+            if (_query_max_results > 0 && uids.size() > _query_max_results) uids.resize(_query_max_results);
+            return true;
+        }
+
+        bool EpisodeCollectionManager::query_tags(const std::string &expression, bool include_children, std::vector<uint32_t> &uids) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            std::string error;
+            if (!_tag_index.query(expression, include_children, uids, error)) {
+                ROS_WARN_STREAM("Invalid tag expression '" << expression << "': " << error);
+                return false;
+            }
+            if (_query_max_results > 0 && uids.size() > _query_max_results) uids.resize(_query_max_results);
+            return true;
+        }
+
+        void EpisodeCollectionManager::set_query_options(bool sorted, int max_results) {
+            _query_sorted = sorted;
+            _query_max_results = max_results > 0 ? (size_t) max_results : 0;
+            // cached results were aggregated with the previous options
+            QueryCache::instance().invalidate(_scope);
+        }
+
+        void EpisodeCollectionManager::set_tree_options(int threads, int grain) {
+            // threads <= 1: sequential updates
+            _tree_pool.reset(threads > 1 ? new ltm::util::WorkStealingPool((size_t) threads) : NULL);
+            _tree_grain = grain > 0 ? (size_t) grain : 64;
+        }
+
+        void EpisodeCollectionManager::set_cache_options(int max_bytes) {
+            // max_bytes <= 0: disabled
+            _cache.set_capacity(max_bytes > 0 ? (size_t) max_bytes : 0);
+            _cache.clear();
+        }
+
+        void EpisodeCollectionManager::cache_episode(const EpisodeWithMetadataPtr &episode_ptr) {
+            if (!_cache.enabled()) return;
+            const Episode &episode = *episode_ptr;
+            _cache.put(episode.uid, episode_ptr, ros::serialization::serializationLength(episode));
+        }
+
+        void EpisodeCollectionManager::append_status(std::stringstream &status) {
+            {
+                ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+                status << "Episode time index: " << _when_index.size() << " intervals" << std::endl;
+                status << "Episode location index: " << _where_index.size() << " entries in "
+                       << _where_index.trees() << " (map, frame) trees" << std::endl;
+                status << "Episode tag index: " << _tag_index.tags() << " tags over " << _tag_index.size() << " episodes" << std::endl;
+            }
+            ltm::util::LRUCacheStats stats = _cache.stats();
+            if (stats.max_bytes == 0) {
+                status << "Episode cache: disabled" << std::endl;
+                return;
+            }
+            status << "Episode cache: " << stats.entries << " entries, " << stats.bytes << "/" << stats.max_bytes << " bytes" << std::endl;
+            status << " - hits: " << stats.hits << ", misses: " << stats.misses << ", evictions: " << stats.evictions << std::endl;
+        }
+
         bool EpisodeCollectionManager::get(int uid, EpisodeWithMetadataPtr &episode_ptr) {
-            QueryPtr query = _coll->createQuery();
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            if (_cache.get((uint32_t) uid, episode_ptr)) return true;
+            EpisodeCollectionPtr coll = read_collection();
+            QueryPtr query = coll->createQuery();
             query->append("uid", uid);
             try {
-                episode_ptr = _coll->findOne(query, false);
+                // older revisions may be left until the next setup, the last one wins
+                std::vector<EpisodeWithMetadataPtr> result = coll->queryList(query, false, "revision", false);
+                if (result.empty()) {
+                    episode_ptr.reset();
+                    return false;
+                }
+                episode_ptr = result.front();
             }
             catch (const ltm_db::NoMatchingMessageException &exception) {
                 episode_ptr.reset();
                 return false;
             }
+            cache_episode(episode_ptr);
+            return true;
+        }
+
+        bool EpisodeCollectionManager::get_many(const std::vector<uint32_t> &uids, std::vector<EpisodeWithMetadataPtr> &episodes, std::vector<uint32_t> &not_found) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            EpisodeCollectionPtr coll = read_collection();
+            episodes.clear();
+            not_found.clear();
+
+            // unique uids, keeping the requested order
+            std::vector<uint32_t> unique_uids;
+            boost::unordered_set<uint32_t> visited;
+            std::vector<uint32_t>::const_iterator it;
+            for (it = uids.begin(); it != uids.end(); ++it) {
+                if (visited.insert(*it).second) unique_uids.push_back(*it);
+            }
+            if (unique_uids.empty()) return true;
+
+            // cached episodes first
+            boost::unordered_map<uint32_t, EpisodeWithMetadataPtr> found;
+            std::vector<uint32_t> missing;
+            for (it = unique_uids.begin(); it != unique_uids.end(); ++it) {
+                EpisodeWithMetadataPtr episode_ptr;
+                if (_cache.get(*it, episode_ptr)) {
+                    found[*it] = episode_ptr;
+                } else {
+                    missing.push_back(*it);
+                }
+            }
+
+            // single round trip for the remaining episodes, older revisions come first and are overwritten
+            std::vector<EpisodeWithMetadataPtr> result;
+            if (!missing.empty()) {
+                try {
+                    QueryPtr query = coll->createQuery();
+                    query->append(ltm::util::json_in("uid", missing));
+                    result = coll->queryList(query, false, "revision", true);
+                } catch (const ltm_db::NoMatchingMessageException &exception) {
+                    result.clear();
+                } catch (const mongo::exception &ex) {
+                    // the missing uids are unknown, not absent
+                    ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
+                    return false;
+                }
+            }
+
+            std::vector<EpisodeWithMetadataPtr>::const_iterator r_it;
+            for (r_it = result.begin(); r_it != result.end(); ++r_it) {
+                found[(*r_it)->uid] = *r_it;
+                cache_episode(*r_it);
+            }
+
+            // fill in requested order
+            episodes.reserve(found.size());
+            boost::unordered_map<uint32_t, EpisodeWithMetadataPtr>::const_iterator f_it;
+            for (it = unique_uids.begin(); it != unique_uids.end(); ++it) {
+                f_it = found.find(*it);
+                if (f_it == found.end()) {
+                    not_found.push_back(*it);
+                    continue;
+                }
+                episodes.push_back(f_it->second);
+            }
             return true;
         }
 
         bool EpisodeCollectionManager::update(const ltm::Episode &episode) {
-            ROS_WARN("UPDATE: Method not implemented");
-            return false;
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            // The new revision is written before the old ones are removed, so the episode never disappears.
+            double revision = next_revision();
+            insert_revision(episode, revision);
+            remove_older_revisions(std::vector<uint32_t>(1, episode.uid), revision);
+
+            // insert into cache
+            _db_uids.insert(episode.uid);
+            if ((int) episode.uid >= _next_uid) _next_uid = episode.uid + 1;
+            return true;
+        }
+
+        bool EpisodeCollectionManager::update_many(const std::vector<ltm::Episode> &episodes) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            if (episodes.empty()) return true;
+            double revision = next_revision();
+            std::vector<uint32_t> uids;
+            uids.reserve(episodes.size());
+            std::vector<ltm::Episode>::const_iterator it;
+            for (it = episodes.begin(); it != episodes.end(); ++it) {
+                insert_revision(*it, revision);
+                uids.push_back(it->uid);
+            }
+            remove_older_revisions(uids, revision);
+
+            // insert into cache
+            for (it = episodes.begin(); it != episodes.end(); ++it) {
+                _db_uids.insert(it->uid);
+                if ((int) it->uid >= _next_uid) _next_uid = it->uid + 1;
+            }
+            return true;
         }
 
         bool EpisodeCollectionManager::remove(int uid) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
             std::set<int>::iterator it;
 
             // value is already reserved
@@ -209,65 +805,82 @@ namespace ltm {
             if (it != _db_uids.end()) _db_uids.erase(it);
 
             // remove from DB
+            _cache.erase((uint32_t) uid);
+            unindex_episode((uint32_t) uid);
+            DBLock lock(db_mutex());
             QueryPtr query = _coll->createQuery();
             query->append("uid", uid);
-            _coll->removeMessages(query);
+            _counter.sub((int) _coll->removeMessages(query));
+            ++_version;
+            QueryCache::instance().invalidate(_scope);
             return true;
         }
 
+        bool EpisodeCollectionManager::remove_many(const std::vector<uint32_t> &uids) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            if (uids.empty()) return true;
+            std::vector<uint32_t>::const_iterator it;
+            for (it = uids.begin(); it != uids.end(); ++it) {
+                _reserved_uids.erase(*it);
+                _db_uids.erase(*it);
+                _cache.erase(*it);
+                unindex_episode(*it);
+            }
+
+            // remove from DB in a single request
+            DBLock lock(db_mutex());
+            QueryPtr query = _coll->createQuery();
+            query->append(ltm::util::json_in("uid", uids));
+            _counter.sub((int) _coll->removeMessages(query));
+            ++_version;
+            QueryCache::instance().invalidate(_scope);
+            return true;
+        }
 
         // -----------------------------------------------------------------------------------------------------------------
         // Other Queries
         // -----------------------------------------------------------------------------------------------------------------
 
         int EpisodeCollectionManager::count() {
-            return _coll->count();
+            // In process counter, so this never runs a count query nor waits for the locks. Older
+            // revisions are removed right after a new one is written, so it counts episodes.
+            return _counter.get();
+        }
+
+        int EpisodeCollectionManager::db_count() {
+            DBLock lock(db_mutex());
+            return _coll ? (int) _coll->count() : 0;
         }
 
         int EpisodeCollectionManager::reserve_uid() {
-            // TODO: find better way, maybe select the max_uid+1
-            // Returns a pseudo-random integral number in the range between 0 and RAND_MAX.
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            // Sequential allocation above the high-water mark. Values can only be taken by fixed uids,
+            // which are always tracked on the reserved and db caches.
             uint32_t max_int32 = std::numeric_limits<uint32_t>::max();
             int max_int = std::numeric_limits<int>::max();
             int upper_bound = max_int32 > max_int ? max_int : max_int32;
-
-            int db_size = count();
-            int reserved_ids = (int) _reserved_uids.size();
-            if (upper_bound <= db_size + reserved_ids) {
-                ROS_WARN_STREAM(
-                        "There aren't any available uids. Max entries: "
-                                << upper_bound
-                                << ". LTM DB has (" << db_size << ") entries."
-                                << " There are (" << reserved_ids << ") reserved uids."
-                );
-                return -1;
+            if (!_sequential_uids) return reserve_random_uid();
+
+            while (_next_uid < upper_bound) {
+                int value = _next_uid++;
+                if (_reserved_uids.find(value) != _reserved_uids.end()) continue;
+                if (_db_uids.find(value) != _db_uids.end()) continue;
+                _reserved_uids.insert(value);
+                return value;
             }
 
-            int value;
-            std::set<int>::iterator it;
-            while (true) {
-                value = rand() % upper_bound;
-
-                // value is already reserved
-                it = _reserved_uids.find(value);
-                if (it != _reserved_uids.end()) continue;
-
-                // value is in db cache
-                it = _db_uids.find(value);
-                if (it != _db_uids.end()) continue;
+            // The high-water mark is exhausted (e.g., a DB filled by the old random allocator).
+            ROS_WARN_STREAM_ONCE("Sequential episode uids are exhausted. Falling back to random uids.");
+            return reserve_random_uid();
+        }
 
-                // value is already in DB
-                if (has(value)) {
-                    _db_uids.insert(value);
-                    continue;
-                }
-                break;
-            }
-            _reserved_uids.insert(value);
-            return value;
+        void EpisodeCollectionManager::reserve_fixed_uid(int uid) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            _reserved_uids.insert(uid);
         }
 
         bool EpisodeCollectionManager::is_reserved(int uid) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
             std::set<int>::iterator it;
 
             // value is already reserved
@@ -283,11 +896,15 @@ namespace ltm {
         }
 
         bool EpisodeCollectionManager::has(int uid) {
-            // TODO: doc, no revisa por uids ya registradas
-            QueryPtr query = _coll->createQuery();
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            // the indexes track every write of this server
+            if (_indexes_complete) return _when_index.contains((uint32_t) uid);
+            EpisodeCollectionPtr coll = read_collection();
+            if (_cache.contains((uint32_t) uid)) return true;
+            QueryPtr query = coll->createQuery();
             query->append("uid", uid);
             try {
-                _coll->findOne(query, true);
+                coll->findOne(query, true);
             }
             catch (const ltm_db::NoMatchingMessageException &exception) {
                 return false;
@@ -295,90 +912,386 @@ namespace ltm {
             return true;
         }
 
+        bool EpisodeCollectionManager::has_many(const std::vector<uint32_t> &uids, std::set<uint32_t> &found) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+            found.clear();
+            std::vector<uint32_t>::const_iterator u_it;
+            if (_indexes_complete) {
+                for (u_it = uids.begin(); u_it != uids.end(); ++u_it) {
+                    if (_when_index.contains(*u_it)) found.insert(*u_it);
+                }
+                return true;
+            }
+
+            // single metadata-only request for all uids
+            EpisodeCollectionPtr coll = read_collection();
+            std::vector<uint32_t> missing;
+            for (u_it = uids.begin(); u_it != uids.end(); ++u_it) {
+                if (_cache.contains(*u_it)) {
+                    found.insert(*u_it);
+                } else {
+                    missing.push_back(*u_it);
+                }
+            }
+            if (missing.empty()) return true;
+            std::vector<EpisodeWithMetadataPtr> result;
+            try {
+                QueryPtr query = coll->createQuery();
+                query->append(ltm::util::json_in("uid", missing));
+                result = coll->queryList(query, true);
+            } catch (const ltm_db::NoMatchingMessageException &exception) {
+                return true;
+            } catch (const mongo::exception &ex) {
+                // a partial set would make stored episodes look new
+                ROS_ERROR_STREAM("Error while quering MongoDB for episodes. " << ex.what());
+                return false;
+            }
+            std::vector<EpisodeWithMetadataPtr>::const_iterator it;
+            for (it = result.begin(); it != result.end(); ++it) {
+                found.insert((uint32_t) (*it)->lookupInt("uid"));
+            }
+            return true;
+        }
+
         bool EpisodeCollectionManager::drop_db() {
-            _conn->dropDatabase(_db_name);
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            {
+                DBLock lock(db_mutex());
+                _conn->dropDatabase(_db_name);
+            }
             _reserved_uids.clear();
             _db_uids.clear();
+            _cache.clear();
             setup();
             return true;
         }
 
         bool EpisodeCollectionManager::switch_db(const std::string &db_name) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
             _db_name = db_name;
             _reserved_uids.clear();
             _db_uids.clear();
+            _cache.clear();
             setup();
             return true;
         }
 
         bool EpisodeCollectionManager::update_tree(int uid) {
-            if (!has(uid)) {
-                return false;
+            // The subtree is loaded and recomputed under the read lock, so neither readers nor writers are
+            // blocked meanwhile. It is only written back if no write happened in between, otherwise it is
+            // computed again. The last attempt holds the write lock all along.
+            static const int attempts = 3;
+            for (int attempt = 1; ; ++attempt) {
+                boost::scoped_ptr<ltm::util::ReentrantSharedMutex::WriteLock> exclusive;
+                if (attempt == attempts) exclusive.reset(new ltm::util::ReentrantSharedMutex::WriteLock(_mutex));
+
+                EpisodeTree tree;
+                std::vector<Episode> changed;
+                bool result;
+                size_t version;
+                {
+                    ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
+                    version = _version;
+
+                    // load the whole subtree, one query per tree level
+                    if (!load_subtree((uint32_t) uid, tree)) {
+                        ROS_WARN_STREAM("UPDATE TREE: Episode (" << uid << ") was not found.");
+                        return false;
+                    }
+
+                    // recompute bottom-up in memory and keep the modified inner nodes
+                    if (_tree_pool) {
+                        result = update_tree_parallel((uint32_t) uid, tree, changed);
+                    } else {
+                        boost::unordered_set<uint32_t> ancestors;
+                        result = update_tree_node((uint32_t) uid, tree, changed, ancestors);
+                    }
+                }
+
+                // write back at once
+                ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+                if (version != _version) {
+                    ROS_DEBUG_STREAM(" -> tree " << uid << " changed while it was updated, trying again.");
+                    continue;
+                }
+                result = update_many(changed) && result;
+                ROS_DEBUG_STREAM(" -> tree updated: " << uid << ". (" << tree.nodes.size() << ") nodes, ("
+                                                      << changed.size() << ") were modified.");
+                return result;
             }
-            Episode root_ptr;
-            return update_tree_node(uid, root_ptr);
         }
 
-        bool EpisodeCollectionManager::update_tree_node(int uid, Episode &updated_episode) {
-            ROS_DEBUG_STREAM(" - updating node: " << uid);
-            EpisodeWithMetadataPtr ep_ptr;
+        bool EpisodeCollectionManager::load_subtree(uint32_t root, EpisodeTree &tree) {
+            tree.nodes.clear();
+            tree.missing.clear();
+
+            std::vector<uint32_t> level(1, root);
+            boost::unordered_set<uint32_t> visited;
+            visited.insert(root);
+            while (!level.empty()) {
+                std::vector<EpisodeWithMetadataPtr> episodes;
+                std::vector<uint32_t> not_found;
+                if (!get_many(level, episodes, not_found)) return false;
+                tree.missing.insert(not_found.begin(), not_found.end());
+
+                // next level: children of inner nodes
+                level.clear();
+                std::vector<EpisodeWithMetadataPtr>::const_iterator it;
+                for (it = episodes.begin(); it != episodes.end(); ++it) {
+                    tree.nodes[(*it)->uid] = **it;
+                    if ((*it)->type == Episode::LEAF) continue;
+                    std::vector<uint32_t>::const_iterator c_it;
+                    for (c_it = (*it)->children_ids.begin(); c_it != (*it)->children_ids.end(); ++c_it) {
+                        if (visited.insert(*c_it).second) level.push_back(*c_it);
+                    }
+                }
+            }
+            return tree.nodes.find(root) != tree.nodes.end();
+        }
 
-            // get episode
-            if (!get(uid, ep_ptr)) {
-                throw ltm_db::NoMatchingMessageException("episode not found");
+        bool EpisodeCollectionManager::update_tree_node(uint32_t uid, EpisodeTree &tree, std::vector<Episode> &changed,
+                                                        boost::unordered_set<uint32_t> &ancestors) {
+            ROS_DEBUG_STREAM(" - updating node: " << uid);
+            EpisodeTree::NodeMap::iterator n_it = tree.nodes.find(uid);
+            if (n_it == tree.nodes.end()) {
+                ROS_WARN_STREAM("UPDATE TREE: Episode (" << uid << ") was not found.");
+                return false;
             }
-            updated_episode = *ep_ptr;
 
             // is leaf
-            if (ep_ptr->type == Episode::LEAF) {
+            Episode &node = n_it->second;
+            if (node.type == Episode::LEAF) {
                 ROS_DEBUG_STREAM(" ---> node " << uid << " is a leaf, will not update it.");
                 return true;
             }
 
+            // children_ids may loop back to this branch
+            if (!ancestors.insert(uid).second) {
+                ROS_WARN_STREAM("UPDATE TREE: Episode (" << uid << ") is part of a cycle, will not update it.");
+                return false;
+            }
+
             // init fields
+            Episode updated_episode = node;
             EpisodeUpdateHelper helper;
             this->update_tree_init(updated_episode, helper);
 
             // process children
             bool result = true;
-            Episode child;
             std::vector<uint32_t>::const_iterator c_it;
-            for (c_it = ep_ptr->children_ids.begin(); c_it != ep_ptr->children_ids.end(); ++c_it) {
+            for (c_it = node.children_ids.begin(); c_it != node.children_ids.end(); ++c_it) {
                 // recurse to children
-                result = result && update_tree_node(*c_it, child);
+                if (!update_tree_node(*c_it, tree, changed, ancestors)) {
+                    result = false;
+                    continue;
+                }
 
                 // update fields
-                result = result && this->update_from_child(updated_episode, child, helper);
+                result = this->update_from_child(updated_episode, tree.nodes[*c_it], helper) && result;
             }
             // finish fields
-            result = result && this->update_tree_last(updated_episode, helper);
+            result = this->update_tree_last(updated_episode, helper) && result;
+            ancestors.erase(uid);
 
-            // save updated episode
-            // TODO: update instead of remove/insert
-            result = result && remove(uid);
-            result = result && insert(updated_episode);
+            // keep updated episode, only if it differs from the stored one
+            if (!ltm::util::equals_message(node, updated_episode)) {
+                node = updated_episode;
+                changed.push_back(updated_episode);
+            }
             ROS_DEBUG_STREAM(" -> node updated: " << uid);
             ROS_ERROR_STREAM_COND(!result, "UPDATE TREE: An error occurred while updating episode (" << uid << ")");
             return result;
         }
 
+        // Shared state of a parallel update_tree() run.
+        // The node map is not resized while tasks run, each node entry is only written by its own task
+        // and only read by its parents once the dependency counter says it is done.
+        struct EpisodeCollectionManager::ParallelTreeContext {
+            struct NodeState {
+                std::vector<uint32_t> parents;
+                boost::atomic<int> pending;
+                boost::atomic<int> chunks_pending;
+                bool finished;
+                std::vector<Episode> partials;
+                std::vector<EpisodeUpdateHelper> helpers;
+                std::vector<uint8_t> partials_ok;
+                NodeState() : pending(0), chunks_pending(0), finished(false) {}
+            };
+            typedef boost::shared_ptr<NodeState> NodeStatePtr;
+
+            EpisodeTree *tree;
+            boost::unordered_map<uint32_t, NodeStatePtr> states;
+            boost::mutex mutex;
+            std::vector<Episode> changed;
+            bool result;
+            // of the request, installed on every task
+            CostContext *cost;
+
+            // lookup without inserting, safe while tasks run
+            NodeState &state(uint32_t uid) { return *states.find(uid)->second; }
+        };
+
+        bool EpisodeCollectionManager::update_tree_parallel(uint32_t root, EpisodeTree &tree, std::vector<Episode> &changed) {
+            ParallelTreeContext ctx;
+            ctx.tree = &tree;
+            ctx.result = tree.missing.empty();
+            ctx.cost = CostContext::current();
+            ROS_WARN_STREAM_COND(!tree.missing.empty(), "UPDATE TREE: Episodes " << ltm::util::vector_to_str(
+                    std::vector<uint32_t>(tree.missing.begin(), tree.missing.end())) << " were not found.");
+
+            // one state per inner node
+            EpisodeTree::NodeMap::const_iterator n_it;
+            for (n_it = tree.nodes.begin(); n_it != tree.nodes.end(); ++n_it) {
+                if (n_it->second.type == Episode::LEAF) continue;
+                ctx.states[n_it->first].reset(new ParallelTreeContext::NodeState());
+            }
+
+            // dependency counters: a node waits for its inner children
+            for (n_it = tree.nodes.begin(); n_it != tree.nodes.end(); ++n_it) {
+                if (n_it->second.type == Episode::LEAF) continue;
+                ParallelTreeContext::NodeState &state = *ctx.states[n_it->first];
+                std::vector<uint32_t>::const_iterator c_it;
+                for (c_it = n_it->second.children_ids.begin(); c_it != n_it->second.children_ids.end(); ++c_it) {
+                    boost::unordered_map<uint32_t, ParallelTreeContext::NodeStatePtr>::iterator s_it = ctx.states.find(*c_it);
+                    if (s_it == ctx.states.end()) continue;
+                    s_it->second->parents.push_back(n_it->first);
+                    ++state.pending;
+                }
+            }
+
+            // start from the lowest inner nodes
+            boost::unordered_map<uint32_t, ParallelTreeContext::NodeStatePtr>::iterator s_it;
+            for (s_it = ctx.states.begin(); s_it != ctx.states.end(); ++s_it) {
+                if (s_it->second->pending == 0) {
+                    _tree_pool->submit(boost::bind(&EpisodeCollectionManager::parallel_node_task, this, &ctx, s_it->first));
+                }
+            }
+            _tree_pool->wait();
+
+            // nodes on a cycle never become ready
+            for (s_it = ctx.states.begin(); s_it != ctx.states.end(); ++s_it) {
+                if (!s_it->second->finished) {
+                    ROS_WARN_STREAM("UPDATE TREE: Episode (" << s_it->first << ") is part of a cycle, will not update it.");
+                    ctx.result = false;
+                }
+            }
+            changed.insert(changed.end(), ctx.changed.begin(), ctx.changed.end());
+            ROS_ERROR_STREAM_COND(!ctx.result, "UPDATE TREE: An error occurred while updating episode (" << root << ")");
+            return ctx.result;
+        }
+
+        void EpisodeCollectionManager::parallel_node_task(ParallelTreeContext *ctx, uint32_t uid) {
+            CostScope cost(ctx->cost);
+            const Episode &node = ctx->tree->nodes.find(uid)->second;
+            size_t n_children = node.children_ids.size();
+
+            // small nodes are processed at once
+            if (n_children <= _tree_grain) {
+                Episode updated_episode = node;
+                EpisodeUpdateHelper helper;
+                this->update_tree_init(updated_episode, helper);
+                bool result = true;
+                std::vector<uint32_t>::const_iterator c_it;
+                for (c_it = node.children_ids.begin(); c_it != node.children_ids.end(); ++c_it) {
+                    EpisodeTree::NodeMap::const_iterator child_it = ctx->tree->nodes.find(*c_it);
+                    if (child_it == ctx->tree->nodes.end()) {
+                        result = false;
+                        continue;
+                    }
+                    result = this->update_from_child(updated_episode, child_it->second, helper) && result;
+                }
+                result = this->update_tree_last(updated_episode, helper) && result;
+                parallel_finish_node(ctx, uid, updated_episode, result);
+                return;
+            }
+
+            // fork: split children into chunks aggregated on their own
+            ParallelTreeContext::NodeState &state = ctx->state(uid);
+            size_t n_chunks = (n_children + _tree_grain - 1) / _tree_grain;
+            state.partials.assign(n_chunks, node);
+            state.helpers.assign(n_chunks, EpisodeUpdateHelper());
+            state.partials_ok.assign(n_chunks, (uint8_t) true);
+            state.chunks_pending = (int) n_chunks;
+            for (size_t k = 1; k < n_chunks; ++k) {
+                _tree_pool->submit(boost::bind(&EpisodeCollectionManager::parallel_chunk_task, this, ctx, uid, k));
+            }
+            parallel_chunk_task(ctx, uid, 0);
+        }
+
+        void EpisodeCollectionManager::parallel_chunk_task(ParallelTreeContext *ctx, uint32_t uid, size_t chunk) {
+            CostScope cost(ctx->cost);
+            const Episode &node = ctx->tree->nodes.find(uid)->second;
+            ParallelTreeContext::NodeState &state = ctx->state(uid);
+            Episode &partial = state.partials[chunk];
+            EpisodeUpdateHelper &helper = state.helpers[chunk];
+
+            // partial aggregate, without the last step
+            this->update_tree_init(partial, helper);
+            size_t begin = chunk * _tree_grain;
+            size_t end = std::min(begin + _tree_grain, node.children_ids.size());
+            bool result = true;
+            for (size_t i = begin; i < end; ++i) {
+                EpisodeTree::NodeMap::const_iterator child_it = ctx->tree->nodes.find(node.children_ids[i]);
+                if (child_it == ctx->tree->nodes.end()) {
+                    result = false;
+                    continue;
+                }
+                result = this->update_from_child(partial, child_it->second, helper) && result;
+            }
+            state.partials_ok[chunk] = (uint8_t) result;
+            if (--state.chunks_pending > 0) return;
+
+            // join: the last chunk merges every partial, in order
+            Episode updated_episode = node;
+            EpisodeUpdateHelper node_helper;
+            this->update_tree_init(updated_episode, node_helper);
+            result = true;
+            for (size_t k = 0; k < state.partials.size(); ++k) {
+                result = this->update_from_partial(updated_episode, state.partials[k], node_helper, state.helpers[k]) && result;
+                result = result && state.partials_ok[k];
+            }
+            result = this->update_tree_last(updated_episode, node_helper) && result;
+            state.partials.clear();
+            state.helpers.clear();
+            parallel_finish_node(ctx, uid, updated_episode, result);
+        }
+
+        void EpisodeCollectionManager::parallel_finish_node(ParallelTreeContext *ctx, uint32_t uid, const Episode &updated, bool result) {
+            Episode &node = ctx->tree->nodes.find(uid)->second;
+            ParallelTreeContext::NodeState &state = ctx->state(uid);
+            bool modified = !ltm::util::equals_message(node, updated);
+            if (modified) node = updated;
+            state.finished = true;
+            {
+                boost::mutex::scoped_lock lock(ctx->mutex);
+                if (modified) ctx->changed.push_back(updated);
+                ctx->result = ctx->result && result;
+            }
+            ROS_DEBUG_STREAM(" -> node updated: " << uid);
+
+            // wake up parents whose children are all done
+            std::vector<uint32_t>::const_iterator p_it;
+            for (p_it = state.parents.begin(); p_it != state.parents.end(); ++p_it) {
+                if (--ctx->state(*p_it).pending == 0) {
+                    _tree_pool->submit(boost::bind(&EpisodeCollectionManager::parallel_node_task, this, ctx, *p_it));
+                }
+            }
+        }
+
         bool EpisodeCollectionManager::update_from_children(ltm::Episode &episode) {
+            ltm::util::ReentrantSharedMutex::ReadLock r_lock(_mutex);
 
             // init fields
             EpisodeUpdateHelper helper;
             this->update_tree_init(episode, helper);
 
-            // iterate over children
+            // iterate over children, cached ones are not read again
             std::vector<uint32_t> bad_children;
-            std::vector<uint32_t>::const_iterator it;
-            bool result = true;
-            for (it = episode.children_ids.begin(); it != episode.children_ids.end(); ++it) {
-                EpisodeWithMetadataPtr child_ptr;
-                if (!this->get(*it, child_ptr)) {
-                    bad_children.push_back(*it);
-                    continue;
-                }
-                result = result && this->update_from_child(episode, *child_ptr, helper);
+            std::vector<EpisodeWithMetadataPtr> children;
+            bool result = get_many(episode.children_ids, children, bad_children);
+            std::vector<EpisodeWithMetadataPtr>::const_iterator it;
+            for (it = children.begin(); it != children.end(); ++it) {
+                result = result && this->update_from_child(episode, **it, helper);
             }
 
             // end fields
@@ -388,5 +1301,63 @@ namespace ltm {
             return result;
         }
 
+        bool EpisodeCollectionManager::update_ancestors(const ltm::Episode &episode, bool replaced) {
+            ltm::util::ReentrantSharedMutex::WriteLock w_lock(_mutex);
+            // Walks the parent_id chain up to the root. A new or grown child is merged into its parent
+            // as a delta. A replaced child may have shrunk, so its parent is recomputed from its children.
+            // A recomputed parent that only grew is merged as a delta on the levels above.
+            bool monotone = !replaced;
+            // usages the parent does not count yet: a new episode was not aggregated by anyone
+            int n_usages_delta = replaced ? 0 : episode.info.n_usages;
+            ltm::Episode child = episode;
+            boost::unordered_set<uint32_t> visited;
+            visited.insert(child.uid);
+            while (child.parent_id != 0 && child.parent_id != child.uid) {
+                if (!visited.insert(child.parent_id).second) {
+                    ROS_WARN_STREAM("UPDATE ANCESTORS: Found a cycle on the branch of episode (" << episode.uid << ").");
+                    return false;
+                }
+                EpisodeWithMetadataPtr parent_ptr;
+                if (!this->get(child.parent_id, parent_ptr)) {
+                    // children are usually added first, the parent aggregates them when it is added
+                    ROS_DEBUG_STREAM("UPDATE ANCESTORS: Parent (" << child.parent_id << ") of episode ("
+                                     << child.uid << ") is not stored yet.");
+                    break;
+                }
+                if (parent_ptr->type == ltm::Episode::LEAF) {
+                    ROS_WARN_STREAM("UPDATE ANCESTORS: Parent (" << parent_ptr->uid << ") of episode (" << child.uid << ") is a leaf.");
+                    return false;
+                }
+
+                // children_ids define the tree, a parent_id alone does not add a child
+                ltm::Episode parent = *parent_ptr;
+                if (std::find(parent.children_ids.begin(), parent.children_ids.end(), child.uid) == parent.children_ids.end()) {
+                    ROS_WARN_STREAM("UPDATE ANCESTORS: Episode (" << child.uid << ") is not a child of its parent ("
+                                    << parent.uid << "). Add it to the parent's children_ids.");
+                    return false;
+                }
+
+                bool result;
+                if (monotone) {
+                    result = this->update_from_delta(parent, child, n_usages_delta);
+                } else {
+                    result = this->update_from_children(parent);
+                    // the children are only read again while some ancestor shrinks
+                    ltm::Episode grown = *parent_ptr;
+                    monotone = this->update_from_delta(grown, child, parent.info.n_usages - parent_ptr->info.n_usages)
+                               && ltm::util::equals_message(grown, parent);
+                }
+                n_usages_delta = parent.info.n_usages - parent_ptr->info.n_usages;
+                ROS_WARN_STREAM_COND(!result, "UPDATE ANCESTORS: An error occurred while updating episode (" << parent.uid << ")");
+
+                // nothing changed, so neither will the remaining ancestors
+                if (ltm::util::equals_message(static_cast<const ltm::Episode &>(*parent_ptr), parent)) break;
+                ROS_DEBUG_STREAM(" -> ancestor updated: " << parent.uid);
+                this->update(parent);
+                child = parent;
+            }
+            return true;
+        }
+
     }
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <ltm/db/episode_metadata.h>
+#include <algorithm>
 
 
 namespace ltm {
@@ -30,6 +31,10 @@ namespace ltm {
             when->append("start", start);
             when->append("end", end);
             meta->appendMeta("when", when);
+
+            // flat copy, nested metadata cannot be looked up (see rebuild_indexes)
+            meta->append("when_start", start);
+            meta->append("when_end", end);
         }
 
         void EpisodeMetadataBuilder::make_meta_where(const Where &node, MetadataPtr meta) {
@@ -45,6 +50,28 @@ namespace ltm {
             meta->appendMeta("where", where);
         }
 
+        void EpisodeMetadataBuilder::make_meta_extent(const Episode &node, MetadataPtr meta) {
+            // Flat bounding box of the indexed location, so the location index is rebuilt from metadata.
+            // Parents cover their children hull, leaves (and parents without one) their position.
+            const Where &where = node.where;
+            std::vector<geometry_msgs::Point> points(1, where.position);
+            if (node.type == ltm::Episode::EPISODE && !where.children_hull.empty()) points = where.children_hull;
+            double min_x = points[0].x, min_y = points[0].y, max_x = points[0].x, max_y = points[0].y;
+            std::vector<geometry_msgs::Point>::const_iterator it;
+            for (it = points.begin(); it != points.end(); ++it) {
+                min_x = std::min(min_x, it->x);
+                min_y = std::min(min_y, it->y);
+                max_x = std::max(max_x, it->x);
+                max_y = std::max(max_y, it->y);
+            }
+            meta->append("where_map_name", where.map_name);
+            meta->append("where_frame_id", where.frame_id);
+            meta->append("where_min_x", min_x);
+            meta->append("where_min_y", min_y);
+            meta->append("where_max_x", max_x);
+            meta->append("where_max_y", max_y);
+        }
+
         void EpisodeMetadataBuilder::make_meta_what(const What &node, MetadataPtr meta) {
             MetadataPtr what = create_metadata();
 
@@ -73,6 +100,30 @@ namespace ltm {
             meta->appendMeta("what", what);
         }
 
+        void EpisodeMetadataBuilder::make_meta_registers(const What &node, MetadataPtr meta) {
+            // Flat copy of the What registers, as parallel arrays on the root document.
+            // Allows queries to collect stream/entity uids without deserializing the episode.
+            std::vector<std::string> stream_types;
+            std::vector<uint32_t> stream_uids;
+            std::vector<ltm::StreamRegister>::const_iterator s_it;
+            for (s_it = node.streams.begin(); s_it != node.streams.end(); ++s_it) {
+                stream_types.push_back(s_it->type);
+                stream_uids.push_back(s_it->uid);
+            }
+            meta->append("what_streams_type", stream_types);
+            meta->append("what_streams_uid", stream_uids);
+
+            std::vector<std::string> entity_types;
+            std::vector<uint32_t> entity_uids;
+            std::vector<ltm::EntityRegister>::const_iterator e_it;
+            for (e_it = node.entities.begin(); e_it != node.entities.end(); ++e_it) {
+                entity_types.push_back(e_it->type);
+                entity_uids.push_back(e_it->uid);
+            }
+            meta->append("what_entities_type", entity_types);
+            meta->append("what_entities_uid", entity_uids);
+        }
+
         void EpisodeMetadataBuilder::make_meta_relevance(const Relevance &node, MetadataPtr meta) {
             MetadataPtr relevance = create_metadata();
             make_meta_relevance_emotional(node.emotional, relevance);
@@ -111,7 +162,9 @@ namespace ltm {
             make_meta_info(episode.info, meta);
             make_meta_when(episode.when, meta);
             make_meta_where(episode.where, meta);
+            make_meta_extent(episode, meta);
             make_meta_what(episode.what, meta);
+            make_meta_registers(episode.what, meta);
             make_meta_relevance(episode.relevance, meta);
             return meta;
         }
@@ -0,0 +1,227 @@
+#include <ltm/db/episode_query.h>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace ltm {
+    namespace db {
+
+        // same representation as EpisodeMetadataBuilder::make_meta_when
+        static double to_secs(const ros::Time &stamp) {
+            return stamp.sec + stamp.nsec * pow10(-9);
+        }
+
+        static void write_string(std::ostream &os, const std::string &value) {
+            os << '"';
+            for (size_t i = 0; i < value.size(); ++i) {
+                if (value[i] == '"' || value[i] == '\\') os << '\\';
+                os << value[i];
+            }
+            os << '"';
+        }
+
+        template<class T>
+        static void write_array(std::ostream &os, const std::vector<T> &values) {
+            os << "[";
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (i > 0) os << ", ";
+                os << values[i];
+            }
+            os << "]";
+        }
+
+        static void write_array(std::ostream &os, const std::vector<std::string> &values) {
+            os << "[";
+            for (size_t i = 0; i < values.size(); ++i) {
+                if (i > 0) os << ", ";
+                write_string(os, values[i]);
+            }
+            os << "]";
+        }
+
+        EpisodeQuery::EpisodeQuery() : _start(0), _end(0), _min_emotion_value(0), _prepared(false) {}
+
+        EpisodeQuery::EpisodeQuery(const ltm::EpisodeFilter &filter)
+                : _start(0), _end(0), _min_emotion_value(0), _prepared(false) {
+            uids(filter.uids);
+            when(filter.start, filter.end);
+            all_tags(filter.all_tags);
+            any_tags(filter.any_tags);
+            location(filter.location);
+            area(filter.area);
+            emotions(filter.emotions, filter.min_emotion_value);
+            streams(filter.stream_type, filter.stream_uids);
+            entities(filter.entity_type, filter.entity_uids);
+        }
+
+        EpisodeQuery &EpisodeQuery::json(const std::string &json) {
+            _json = json;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::uids(const std::vector<uint32_t> &uids) {
+            _uids = uids;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::when(const ros::Time &start, const ros::Time &end) {
+            _start = to_secs(start);
+            _end = to_secs(end);
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::all_tags(const std::vector<std::string> &tags) {
+            _all_tags = tags;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::any_tags(const std::vector<std::string> &tags) {
+            _any_tags = tags;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::location(const std::string &location) {
+            _location = location;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::area(const std::string &area) {
+            _area = area;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::emotions(const std::vector<int32_t> &emotions, double min_value) {
+            _emotions = emotions;
+            _min_emotion_value = min_value;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::streams(const std::string &type, const std::vector<uint32_t> &uids) {
+            _stream_type = type;
+            _stream_uids = uids;
+            _prepared = false;
+            return *this;
+        }
+
+        EpisodeQuery &EpisodeQuery::entities(const std::string &type, const std::vector<uint32_t> &uids) {
+            _entity_type = type;
+            _entity_uids = uids;
+            _prepared = false;
+            return *this;
+        }
+
+        bool EpisodeQuery::empty() const {
+            return _json.empty() && _uids.empty() && _start <= 0 && _end <= 0
+                   && _all_tags.empty() && _any_tags.empty() && _location.empty() && _area.empty()
+                   && _emotions.empty() && _min_emotion_value <= 0
+                   && _stream_type.empty() && _stream_uids.empty()
+                   && _entity_type.empty() && _entity_uids.empty();
+        }
+
+        void EpisodeQuery::prepare() const {
+            if (_prepared) return;
+
+            // set predicates: a single JSON object for the driver
+            std::ostringstream sets;
+            if (_uids.size() > 1) {
+                sets << ", uid: {$in: ";
+                write_array(sets, _uids);
+                sets << "}";
+            }
+            if (_all_tags.size() > 1 || !_any_tags.empty()) {
+                sets << ", tags: {";
+                if (!_all_tags.empty()) {
+                    sets << "$all: ";
+                    write_array(sets, _all_tags);
+                    if (!_any_tags.empty()) sets << ", ";
+                }
+                if (!_any_tags.empty()) {
+                    sets << "$in: ";
+                    write_array(sets, _any_tags);
+                }
+                sets << "}";
+            }
+            if (_emotions.size() > 1) {
+                sets << ", \"relevance.emotional.emotion\": {$in: ";
+                write_array(sets, _emotions);
+                sets << "}";
+            }
+            // type and uid must match on the same register
+            if (!_stream_type.empty() && !_stream_uids.empty()) {
+                sets << ", \"what.streams\": {$elemMatch: {type: ";
+                write_string(sets, _stream_type);
+                sets << ", uid: {$in: ";
+                write_array(sets, _stream_uids);
+                sets << "}}}";
+            } else if (_stream_uids.size() > 1) {
+                sets << ", what_streams_uid: {$in: ";
+                write_array(sets, _stream_uids);
+                sets << "}";
+            }
+            if (!_entity_type.empty() && !_entity_uids.empty()) {
+                sets << ", \"what.entities\": {$elemMatch: {type: ";
+                write_string(sets, _entity_type);
+                sets << ", uid: {$in: ";
+                write_array(sets, _entity_uids);
+                sets << "}}}";
+            } else if (_entity_uids.size() > 1) {
+                sets << ", what_entities_uid: {$in: ";
+                write_array(sets, _entity_uids);
+                sets << "}";
+            }
+            _sets = sets.str().empty() ? "" : "{" + sets.str().substr(1) + " }";
+
+            // canonical text: raw json, set predicates and typed scalars (strings quoted, as in JSON)
+            std::ostringstream key;
+            key << std::setprecision(17) << _json << "|" << _sets;
+            if (_uids.size() == 1) key << "|uid=" << _uids[0];
+            if (_start > 0) key << "|start=" << _start;
+            if (_end > 0) key << "|end=" << _end;
+            if (_all_tags.size() == 1 && _any_tags.empty()) write_string(key << "|tag=", _all_tags[0]);
+            if (!_location.empty()) write_string(key << "|location=", _location);
+            if (!_area.empty()) write_string(key << "|area=", _area);
+            if (_emotions.size() == 1) key << "|emotion=" << _emotions[0];
+            if (_min_emotion_value > 0) key << "|min_emotion_value=" << _min_emotion_value;
+            if (_stream_uids.empty() && !_stream_type.empty()) write_string(key << "|stream_type=", _stream_type);
+            if (_stream_type.empty() && _stream_uids.size() == 1) key << "|stream_uid=" << _stream_uids[0];
+            if (_entity_uids.empty() && !_entity_type.empty()) write_string(key << "|entity_type=", _entity_type);
+            if (_entity_type.empty() && _entity_uids.size() == 1) key << "|entity_uid=" << _entity_uids[0];
+            _key = key.str();
+            _prepared = true;
+        }
+
+        void EpisodeQuery::compile(QueryPtr query) const {
+            prepare();
+            if (!_json.empty()) query->append(_json);
+            if (!_sets.empty()) query->append(_sets);
+
+            // typed predicates, no formatting nor parsing
+            if (_uids.size() == 1) query->append("uid", (int) _uids[0]);
+            if (_start > 0) query->appendGTE("when.end", _start);
+            if (_end > 0) query->appendLTE("when.start", _end);
+            if (_all_tags.size() == 1 && _any_tags.empty()) query->append("tags", _all_tags[0]);
+            if (!_location.empty()) query->append("where.location", _location);
+            if (!_area.empty()) query->append("where.area", _area);
+            if (_emotions.size() == 1) query->append("relevance.emotional.emotion", (int) _emotions[0]);
+            if (_min_emotion_value > 0) query->appendGTE("relevance.emotional.value", _min_emotion_value);
+            if (_stream_uids.empty() && !_stream_type.empty()) query->append("what_streams_type", _stream_type);
+            if (_stream_type.empty() && _stream_uids.size() == 1) query->append("what_streams_uid", (int) _stream_uids[0]);
+            if (_entity_uids.empty() && !_entity_type.empty()) query->append("what_entities_type", _entity_type);
+            if (_entity_type.empty() && _entity_uids.size() == 1) query->append("what_entities_uid", (int) _entity_uids[0]);
+        }
+
+        const std::string &EpisodeQuery::key() const {
+            prepare();
+            return _key;
+        }
+
+    }
+}
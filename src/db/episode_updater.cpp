@@ -39,6 +39,51 @@ namespace ltm {
             return result;
         }
 
+        bool EpisodeUpdater::update_from_delta(ltm::Episode &node, const ltm::Episode &child, int n_usages_delta) {
+            // Merges a new or grown child into an already aggregated node. Every field is a monotone
+            // aggregate, so this is equivalent to a full recomputation as long as the child did not shrink.
+            // The stored hull already covers the previous children positions.
+            EpisodeUpdateHelper helper;
+            helper.positions = node.where.children_hull;
+
+            // n_usages is a sum over children, the node already counts the previous usages of the child
+            int n_usages = node.info.n_usages;
+            bool result = update_from_child(node, child, helper);
+            node.info.n_usages = n_usages + n_usages_delta;
+            result = result && update_tree_last(node, helper);
+            return result;
+        }
+
+        bool EpisodeUpdater::update_from_partial(ltm::Episode &node, const ltm::Episode &partial,
+                                                 EpisodeUpdateHelper &helper, const EpisodeUpdateHelper &partial_helper) {
+            // Joins an aggregate built from a subset of the children (init + update_from_child, without the
+            // update_tree_last step). Every field is associative, so partials can be merged in any grouping.
+            bool result = true;
+            ltm::util::vector_merge(node.children_tags, partial.children_tags);
+            result = result && update_tree_info(node.info, partial.info);
+            result = result && update_tree_when(node.when, partial.when);
+
+            // where: same checks as children, but keep partial positions instead of its hull
+            ltm::util::vector_merge(node.where.children_locations, partial.where.children_locations);
+            ltm::util::vector_merge(node.where.children_areas, partial.where.children_areas);
+            helper.positions.insert(helper.positions.end(), partial_helper.positions.begin(), partial_helper.positions.end());
+            if (partial.where.frame_id != "" || partial.where.map_name != "") {
+                if (node.where.frame_id == "" && node.where.map_name == "") {
+                    node.where.frame_id = partial.where.frame_id;
+                    node.where.map_name = partial.where.map_name;
+                } else if (node.where.frame_id != partial.where.frame_id || node.where.map_name != partial.where.map_name) {
+                    ROS_WARN_STREAM("UPDATE: parent (" << node.uid << ") where frame {" << node.where.frame_id << ", "
+                                                       << node.where.map_name << "} does not match its children.");
+                    result = false;
+                }
+            }
+
+            // what and relevance: partials are merged as inner children
+            result = result && update_tree_what(node.what, partial.what);
+            result = result && update_tree_relevance(node.relevance, partial.relevance, false);
+            return result;
+        }
+
         // =================================================================================================================
         // Private API
         // =================================================================================================================
@@ -64,7 +109,7 @@ namespace ltm {
 
         bool EpisodeUpdater::update_tree_info(Info &node, const Info &child) {
             // TODO: DOC n_usages parent = SUM children
-            int n_usages = node.n_usages;
+            int n_usages = node.n_usages + child.n_usages;
 
             // keep last children information
             if (node.creation_date < child.creation_date) {
@@ -72,7 +117,7 @@ namespace ltm {
             }
 
             // and add n_usages
-            node.n_usages += n_usages;
+            node.n_usages = n_usages;
             return true;
         }
 
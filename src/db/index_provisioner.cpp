@@ -0,0 +1,118 @@
+#include <ltm/db/index_provisioner.h>
+#include <ltm/db/storage_backend.h>
+#include <ltm/util/parameter_server_wrapper.h>
+#include <ros/ros.h>
+
+namespace ltm {
+    namespace db {
+
+        IndexProvisioner::IndexProvisioner() : _connected(false) {
+            // same server as the LTM database
+            ltm::util::ParameterServerWrapper psw;
+            psw.getParameter("host", _host, "localhost");
+            psw.getParameter("port", _port, 27017);
+        }
+
+        IndexProvisioner::~IndexProvisioner() {}
+
+        IndexProvisioner &IndexProvisioner::instance() {
+            static IndexProvisioner provisioner;
+            return provisioner;
+        }
+
+        bool IndexProvisioner::connect() {
+            if (_connected) return true;
+            std::string error;
+            _client.reset(new mongo::DBClientConnection(true));
+            try {
+                _connected = _client->connect(mongo::HostAndPort(_host, _port), error);
+            } catch (const mongo::exception &ex) {
+                error = ex.what();
+                _connected = false;
+            }
+            ROS_ERROR_STREAM_COND(!_connected, "Could not connect to MongoDB at " << _host << ":" << _port
+                                                  << " to provision indexes. " << error);
+            return _connected;
+        }
+
+        mongo::BSONObj IndexProvisioner::parse_spec(const std::string &spec) {
+            // "field_a,-field_b" --> { field_a: 1, field_b: -1 }
+            mongo::BSONObjBuilder keys;
+            std::stringstream ss(spec);
+            std::string field;
+            while (std::getline(ss, field, ',')) {
+                field.erase(0, field.find_first_not_of(" \t"));
+                field.erase(field.find_last_not_of(" \t") + 1);
+                if (field.empty()) continue;
+                if (field[0] == '-') {
+                    keys.append(field.substr(1), -1);
+                } else {
+                    keys.append(field, 1);
+                }
+            }
+            return keys.obj();
+        }
+
+        bool IndexProvisioner::provision(const std::string &db_name, const std::string &collection,
+                                         const std::string &key, const std::vector<std::string> &defaults) {
+            boost::mutex::scoped_lock lock(_mutex);
+            std::vector<std::string> specs;
+            ltm::util::ParameterServerWrapper psw;
+            psw.getParameter("indexes/" + key, specs, defaults);
+
+            // in-memory collections are scanned
+            if (StorageBackend::instance().is_memory()) return true;
+
+            std::string ns = db_name + "." + collection;
+            _namespaces[collection] = ns;
+            if (specs.empty() || !connect()) return false;
+
+            // createIndex is a no-op for existing indexes
+            bool result = true;
+            std::vector<std::string>::const_iterator it;
+            for (it = specs.begin(); it != specs.end(); ++it) {
+                mongo::BSONObj keys = parse_spec(*it);
+                if (keys.isEmpty()) {
+                    ROS_WARN_STREAM("Ignoring empty index spec '" << *it << "' for collection '" << ns << "'.");
+                    continue;
+                }
+                try {
+                    _client->createIndex(ns, keys);
+                } catch (const mongo::exception &ex) {
+                    ROS_ERROR_STREAM("Could not create index " << keys.toString() << " on '" << ns << "'. " << ex.what());
+                    result = false;
+                }
+            }
+            ROS_DEBUG_STREAM("Provisioned (" << specs.size() << ") indexes for collection '" << ns << "'.");
+            return result;
+        }
+
+        void IndexProvisioner::append_status(std::stringstream &status) {
+            boost::mutex::scoped_lock lock(_mutex);
+            status << "Indexes: " << std::endl;
+            if (StorageBackend::instance().is_memory()) {
+                status << " - not used by the memory backend" << std::endl;
+                return;
+            }
+            if (!connect()) {
+                status << " - unavailable" << std::endl;
+                return;
+            }
+            std::map<std::string, std::string>::const_iterator it;
+            for (it = _namespaces.begin(); it != _namespaces.end(); ++it) {
+                status << " - " << it->second << ":";
+                try {
+                    std::list<mongo::BSONObj> indexes = _client->getIndexSpecs(it->second);
+                    std::list<mongo::BSONObj>::const_iterator i_it;
+                    for (i_it = indexes.begin(); i_it != indexes.end(); ++i_it) {
+                        status << " " << i_it->getStringField("name");
+                    }
+                } catch (const mongo::exception &ex) {
+                    status << " (error: " << ex.what() << ")";
+                }
+                status << std::endl;
+            }
+        }
+
+    }
+}
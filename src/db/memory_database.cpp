@@ -0,0 +1,644 @@
+#include <ltm/db/memory_database.h>
+#include <ros/ros.h>
+#include <algorithm>
+
+using ltm::util::JsonValue;
+
+namespace ltm {
+    namespace db {
+
+        // =================================================================================================================
+        // Matcher
+        // =================================================================================================================
+
+        // Values at a dotted path. Arrays of documents are walked through, as MongoDB does.
+        static void collect(const JsonValue &value, const std::string &path, size_t begin,
+                            std::vector<const JsonValue *> &out) {
+            if (value.is_array()) {
+                const JsonValue::Array &elements = value.as_array();
+                JsonValue::Array::const_iterator it;
+                for (it = elements.begin(); it != elements.end(); ++it) {
+                    if (it->is_object()) collect(*it, path, begin, out);
+                }
+                return;
+            }
+            size_t end = path.find('.', begin);
+            const JsonValue *child = value.find(path.substr(begin, end == std::string::npos ? end : end - begin));
+            if (!child) return;
+            if (end == std::string::npos) {
+                out.push_back(child);
+            } else {
+                collect(*child, path, end + 1, out);
+            }
+        }
+
+        static bool is_operator_document(const JsonValue &value) {
+            const JsonValue::Object &object = value.as_object();
+            return value.is_object() && !object.empty() && object.begin()->first[0] == '$';
+        }
+
+        // A value matches its own content or, for arrays, any element.
+        static bool equals_any(const std::vector<const JsonValue *> &values, const JsonValue &target) {
+            if (values.empty()) return target.is_null();
+            std::vector<const JsonValue *>::const_iterator it;
+            for (it = values.begin(); it != values.end(); ++it) {
+                if (**it == target) return true;
+                const JsonValue::Array &elements = (*it)->as_array();
+                if (std::find(elements.begin(), elements.end(), target) != elements.end()) return true;
+            }
+            return false;
+        }
+
+        static bool compares(const JsonValue &value, const std::string &op, const JsonValue &target) {
+            // only values of the same type are ordered
+            if (value.type() != target.type()) return false;
+            int c = JsonValue::compare(value, target);
+            if (op == "$lt") return c < 0;
+            if (op == "$lte") return c <= 0;
+            if (op == "$gt") return c > 0;
+            return c >= 0;
+        }
+
+        static bool compares_any(const std::vector<const JsonValue *> &values, const std::string &op,
+                                 const JsonValue &target) {
+            std::vector<const JsonValue *>::const_iterator it;
+            for (it = values.begin(); it != values.end(); ++it) {
+                if (compares(**it, op, target)) return true;
+                const JsonValue::Array &elements = (*it)->as_array();
+                JsonValue::Array::const_iterator e_it;
+                for (e_it = elements.begin(); e_it != elements.end(); ++e_it) {
+                    if (compares(*e_it, op, target)) return true;
+                }
+            }
+            return false;
+        }
+
+        static bool matches_operators(const std::vector<const JsonValue *> &values, const JsonValue &operators);
+
+        static bool matches_element(const JsonValue &element, const JsonValue &query) {
+            if (is_operator_document(query)) {
+                std::vector<const JsonValue *> values(1, &element);
+                return matches_operators(values, query);
+            }
+            return element.is_object() && MemoryQuery::matches(element, query);
+        }
+
+        static bool matches_operator(const std::vector<const JsonValue *> &values, const std::string &op,
+                                     const JsonValue &arg) {
+            std::vector<const JsonValue *>::const_iterator it;
+            JsonValue::Array::const_iterator a_it;
+            if (op == "$eq") return equals_any(values, arg);
+            if (op == "$ne") return !equals_any(values, arg);
+            if (op == "$lt" || op == "$lte" || op == "$gt" || op == "$gte") return compares_any(values, op, arg);
+            if (op == "$in" || op == "$nin") {
+                bool found = false;
+                for (a_it = arg.as_array().begin(); a_it != arg.as_array().end() && !found; ++a_it) {
+                    found = equals_any(values, *a_it);
+                }
+                return (op == "$in") == found;
+            }
+            if (op == "$all") {
+                if (arg.as_array().empty()) return false;
+                for (a_it = arg.as_array().begin(); a_it != arg.as_array().end(); ++a_it) {
+                    if (!equals_any(values, *a_it)) return false;
+                }
+                return true;
+            }
+            if (op == "$exists") return values.empty() != arg.as_bool();
+            if (op == "$size") {
+                for (it = values.begin(); it != values.end(); ++it) {
+                    if ((*it)->is_array() && (*it)->as_array().size() == (size_t) arg.as_number()) return true;
+                }
+                return false;
+            }
+            if (op == "$elemMatch") {
+                for (it = values.begin(); it != values.end(); ++it) {
+                    const JsonValue::Array &elements = (*it)->as_array();
+                    for (a_it = elements.begin(); a_it != elements.end(); ++a_it) {
+                        if (matches_element(*a_it, arg)) return true;
+                    }
+                }
+                return false;
+            }
+            if (op == "$not") return !matches_operators(values, arg);
+            ROS_WARN_STREAM_ONCE("The memory DB backend does not support the '" << op << "' query operator.");
+            return false;
+        }
+
+        static bool matches_operators(const std::vector<const JsonValue *> &values, const JsonValue &operators) {
+            JsonValue::Object::const_iterator it;
+            for (it = operators.as_object().begin(); it != operators.as_object().end(); ++it) {
+                if (!matches_operator(values, it->first, it->second)) return false;
+            }
+            return true;
+        }
+
+        bool MemoryQuery::matches(const JsonValue &document, const JsonValue &query) {
+            JsonValue::Object::const_iterator it;
+            JsonValue::Array::const_iterator a_it;
+            for (it = query.as_object().begin(); it != query.as_object().end(); ++it) {
+                const std::string &key = it->first;
+                const JsonValue &cond = it->second;
+                if (key == "$and" || key == "$or" || key == "$nor") {
+                    size_t matched = 0;
+                    for (a_it = cond.as_array().begin(); a_it != cond.as_array().end(); ++a_it) {
+                        if (matches(document, *a_it)) ++matched;
+                    }
+                    if (key == "$and" && matched != cond.as_array().size()) return false;
+                    if (key == "$or" && matched == 0) return false;
+                    if (key == "$nor" && matched > 0) return false;
+                    continue;
+                }
+
+                std::vector<const JsonValue *> values;
+                collect(document, key, 0, values);
+                if (is_operator_document(cond)) {
+                    if (!matches_operators(values, cond)) return false;
+                } else if (!equals_any(values, cond)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // =================================================================================================================
+        // MemoryQuery
+        // =================================================================================================================
+
+        MemoryQuery::MemoryQuery() : _valid(true) {}
+
+        MemoryQuery::~MemoryQuery() {}
+
+        void MemoryQuery::append_condition(const std::string &name, const std::string &op, const JsonValue &value) {
+            JsonValue clause;
+            clause[name][op] = value;
+            _clauses.push_back(clause);
+        }
+
+        void MemoryQuery::append(const std::string &json) {
+            JsonValue clause;
+            std::string error;
+            if (!JsonValue::parse(json, clause, error) || !clause.is_object()) {
+                ROS_ERROR_STREAM("Invalid JSON query '" << json << "'. " << error);
+                _valid = false;
+                return;
+            }
+            _clauses.push_back(clause);
+        }
+
+        void MemoryQuery::append(const std::string &name, const std::string &val) {
+            append_condition(name, "$eq", JsonValue(val));
+        }
+
+        void MemoryQuery::append(const std::string &name, const double val) {
+            append_condition(name, "$eq", JsonValue(val));
+        }
+
+        void MemoryQuery::append(const std::string &name, const int val) {
+            append_condition(name, "$eq", JsonValue(val));
+        }
+
+        void MemoryQuery::append(const std::string &name, const bool val) {
+            append_condition(name, "$eq", JsonValue(val));
+        }
+
+        void MemoryQuery::appendLT(const std::string &name, const double val) {
+            append_condition(name, "$lt", JsonValue(val));
+        }
+
+        void MemoryQuery::appendLT(const std::string &name, const int val) {
+            append_condition(name, "$lt", JsonValue(val));
+        }
+
+        void MemoryQuery::appendLTE(const std::string &name, const double val) {
+            append_condition(name, "$lte", JsonValue(val));
+        }
+
+        void MemoryQuery::appendLTE(const std::string &name, const int val) {
+            append_condition(name, "$lte", JsonValue(val));
+        }
+
+        void MemoryQuery::appendGT(const std::string &name, const double val) {
+            append_condition(name, "$gt", JsonValue(val));
+        }
+
+        void MemoryQuery::appendGT(const std::string &name, const int val) {
+            append_condition(name, "$gt", JsonValue(val));
+        }
+
+        void MemoryQuery::appendGTE(const std::string &name, const double val) {
+            append_condition(name, "$gte", JsonValue(val));
+        }
+
+        void MemoryQuery::appendGTE(const std::string &name, const int val) {
+            append_condition(name, "$gte", JsonValue(val));
+        }
+
+        void MemoryQuery::appendRange(const std::string &name, const double lower, const double upper) {
+            appendGT(name, lower);
+            appendLT(name, upper);
+        }
+
+        void MemoryQuery::appendRangeInclusive(const std::string &name, const double lower, const double upper) {
+            appendGTE(name, lower);
+            appendLTE(name, upper);
+        }
+
+        bool MemoryQuery::matches(const JsonValue &document) const {
+            if (!_valid) return false;
+            std::vector<JsonValue>::const_iterator it;
+            for (it = _clauses.begin(); it != _clauses.end(); ++it) {
+                if (!matches(document, *it)) return false;
+            }
+            return true;
+        }
+
+        std::string MemoryQuery::to_string() const {
+            JsonValue query;
+            query["$and"] = JsonValue::make_array();
+            std::vector<JsonValue>::const_iterator it;
+            for (it = _clauses.begin(); it != _clauses.end(); ++it) {
+                query["$and"].push_back(*it);
+            }
+            return query.to_string();
+        }
+
+        // =================================================================================================================
+        // MemoryMetadata
+        // =================================================================================================================
+
+        MemoryMetadata::MemoryMetadata() : _doc(JsonValue::make_object()) {}
+
+        MemoryMetadata::MemoryMetadata(const JsonValue &doc) : _doc(doc) {}
+
+        MemoryMetadata::~MemoryMetadata() {}
+
+        const JsonValue &MemoryMetadata::document() const {
+            return _doc;
+        }
+
+        JsonValue &MemoryMetadata::document() {
+            return _doc;
+        }
+
+        void MemoryMetadata::append(const std::string &name, const std::string &val) {
+            _doc[name] = JsonValue(val);
+        }
+
+        void MemoryMetadata::append(const std::string &name, const double val) {
+            _doc[name] = JsonValue(val);
+        }
+
+        void MemoryMetadata::append(const std::string &name, const int val) {
+            _doc[name] = JsonValue(val);
+        }
+
+        void MemoryMetadata::append(const std::string &name, const bool val) {
+            _doc[name] = JsonValue(val);
+        }
+
+        void MemoryMetadata::append(const std::string &name, const std::vector<std::string> &val) {
+            JsonValue &array = _doc[name] = JsonValue::make_array();
+            std::vector<std::string>::const_iterator it;
+            for (it = val.begin(); it != val.end(); ++it) array.push_back(JsonValue(*it));
+        }
+
+        void MemoryMetadata::append(const std::string &name, const std::vector<uint32_t> &val) {
+            JsonValue &array = _doc[name] = JsonValue::make_array();
+            std::vector<uint32_t>::const_iterator it;
+            for (it = val.begin(); it != val.end(); ++it) array.push_back(JsonValue((double) *it));
+        }
+
+        void MemoryMetadata::append(const std::string &name, const std::vector<int32_t> &val) {
+            JsonValue &array = _doc[name] = JsonValue::make_array();
+            std::vector<int32_t>::const_iterator it;
+            for (it = val.begin(); it != val.end(); ++it) array.push_back(JsonValue((int) *it));
+        }
+
+        void MemoryMetadata::append(const std::string &name, const std::vector<float> &val) {
+            JsonValue &array = _doc[name] = JsonValue::make_array();
+            std::vector<float>::const_iterator it;
+            for (it = val.begin(); it != val.end(); ++it) array.push_back(JsonValue((double) *it));
+        }
+
+        void MemoryMetadata::appendMeta(const std::string &name, ltm_db::Metadata::ConstPtr val) {
+            MemoryMetadataConstPtr meta = boost::dynamic_pointer_cast<const MemoryMetadata>(val);
+            _doc[name] = meta ? meta->document() : JsonValue::make_object();
+        }
+
+        void MemoryMetadata::appendMeta(const std::string &name, const std::vector<ltm_db::Metadata::ConstPtr> &val) {
+            JsonValue &array = _doc[name] = JsonValue::make_array();
+            std::vector<ltm_db::Metadata::ConstPtr>::const_iterator it;
+            for (it = val.begin(); it != val.end(); ++it) {
+                MemoryMetadataConstPtr meta = boost::dynamic_pointer_cast<const MemoryMetadata>(*it);
+                array.push_back(meta ? meta->document() : JsonValue::make_object());
+            }
+        }
+
+        std::string MemoryMetadata::lookupString(const std::string &name) const {
+            const JsonValue *value = _doc.find_path(name);
+            return value ? value->as_string() : "";
+        }
+
+        double MemoryMetadata::lookupDouble(const std::string &name) const {
+            const JsonValue *value = _doc.find_path(name);
+            return value ? value->as_number() : 0.0;
+        }
+
+        int MemoryMetadata::lookupInt(const std::string &name) const {
+            const JsonValue *value = _doc.find_path(name);
+            return value ? (int) value->as_number() : 0;
+        }
+
+        bool MemoryMetadata::lookupBool(const std::string &name) const {
+            const JsonValue *value = _doc.find_path(name);
+            return value && value->as_bool();
+        }
+
+        bool MemoryMetadata::lookupField(const std::string &name) const {
+            return _doc.find_path(name) != NULL;
+        }
+
+        std::set<std::string> MemoryMetadata::lookupFieldNames() const {
+            std::set<std::string> names;
+            JsonValue::Object::const_iterator it;
+            for (it = _doc.as_object().begin(); it != _doc.as_object().end(); ++it) {
+                names.insert(it->first);
+            }
+            return names;
+        }
+
+        void MemoryMetadata::lookupUInt32Array(const std::string &name, std::vector<uint32_t> &val) const {
+            const JsonValue *value = _doc.find_path(name);
+            if (!value) return;
+            JsonValue::Array::const_iterator it;
+            for (it = value->as_array().begin(); it != value->as_array().end(); ++it) {
+                val.push_back((uint32_t) it->as_number());
+            }
+        }
+
+        void MemoryMetadata::lookupStringArray(const std::string &name, std::vector<std::string> &val) const {
+            const JsonValue *value = _doc.find_path(name);
+            if (!value) return;
+            JsonValue::Array::const_iterator it;
+            for (it = value->as_array().begin(); it != value->as_array().end(); ++it) {
+                val.push_back(it->as_string());
+            }
+        }
+
+        // =================================================================================================================
+        // MemoryResultIterator
+        // =================================================================================================================
+
+        MemoryResultIterator::MemoryResultIterator(const std::vector<MemoryDocumentPtr> &documents)
+                : _documents(documents), _current(0) {}
+
+        MemoryResultIterator::~MemoryResultIterator() {}
+
+        bool MemoryResultIterator::next() {
+            if (_current < _documents.size()) ++_current;
+            return hasData();
+        }
+
+        bool MemoryResultIterator::hasData() const {
+            return _current < _documents.size();
+        }
+
+        ltm_db::Metadata::ConstPtr MemoryResultIterator::metadata() const {
+            return _documents[_current]->metadata;
+        }
+
+        std::string MemoryResultIterator::message() const {
+            return _documents[_current]->message;
+        }
+
+        // =================================================================================================================
+        // MemoryMessageCollection
+        // =================================================================================================================
+
+        // sort key of a document: its first value at the path, or null
+        struct MemorySortKey {
+            std::string path;
+            bool ascending;
+
+            const JsonValue &key(const MemoryDocumentPtr &doc) const {
+                static const JsonValue null_value;
+                std::vector<const JsonValue *> values;
+                collect(doc->metadata->document(), path, 0, values);
+                return values.empty() ? null_value : *values.front();
+            }
+
+            bool operator()(const MemoryDocumentPtr &a, const MemoryDocumentPtr &b) const {
+                int c = JsonValue::compare(key(a), key(b));
+                return ascending ? c < 0 : c > 0;
+            }
+        };
+
+        MemoryMessageCollection::MemoryMessageCollection(const std::string &name, MemoryCollectionDataPtr data)
+                : _name(name), _data(data) {}
+
+        MemoryMessageCollection::~MemoryMessageCollection() {}
+
+        const MemoryQuery *MemoryMessageCollection::cast_query(ltm_db::Query::ConstPtr query) {
+            const MemoryQuery *memory_query = dynamic_cast<const MemoryQuery *>(query.get());
+            ROS_ERROR_STREAM_COND(query && !memory_query, "The memory DB backend cannot run queries of other backends.");
+            return memory_query;
+        }
+
+        void MemoryMessageCollection::find(ltm_db::Query::ConstPtr query, std::vector<MemoryDocumentPtr> &found) const {
+            // caller holds the collection lock
+            const MemoryQuery *memory_query = cast_query(query);
+            if (query && !memory_query) return;
+            std::vector<MemoryDocumentPtr>::const_iterator it;
+            for (it = _data->documents.begin(); it != _data->documents.end(); ++it) {
+                if (!memory_query || memory_query->matches((*it)->metadata->document())) found.push_back(*it);
+            }
+        }
+
+        bool MemoryMessageCollection::initialize(const std::string &datatype, const std::string &md5) {
+            boost::unique_lock<boost::shared_mutex> lock(_data->mutex);
+            if (!_data->md5.empty() && _data->md5 != md5) {
+                ROS_ERROR_STREAM("Collection '" << _name << "' holds messages of type '" << _data->datatype
+                                                << "', not '" << datatype << "'.");
+                return false;
+            }
+            _data->datatype = datatype;
+            _data->md5 = md5;
+            return true;
+        }
+
+        void MemoryMessageCollection::insert(char *msg, size_t msg_size, ltm_db::Metadata::ConstPtr metadata) {
+            boost::shared_ptr<MemoryDocument> doc(new MemoryDocument());
+            // copied, so the caller can keep using its metadata
+            MemoryMetadataConstPtr meta = boost::dynamic_pointer_cast<const MemoryMetadata>(metadata);
+            ROS_ERROR_STREAM_COND(metadata && !meta, "The memory DB backend cannot store metadata of other backends.");
+            doc->metadata.reset(meta ? new MemoryMetadata(meta->document()) : new MemoryMetadata());
+            doc->message.assign(msg, msg_size);
+
+            boost::unique_lock<boost::shared_mutex> lock(_data->mutex);
+            _data->documents.push_back(doc);
+        }
+
+        ltm_db::ResultIteratorHelper::Ptr MemoryMessageCollection::query(ltm_db::Query::ConstPtr query,
+                                                                         const std::string &sort_by,
+                                                                         bool ascending) const {
+            std::vector<MemoryDocumentPtr> found;
+            {
+                boost::shared_lock<boost::shared_mutex> lock(_data->mutex);
+                find(query, found);
+            }
+            if (!sort_by.empty()) {
+                MemorySortKey key;
+                key.path = sort_by;
+                key.ascending = ascending;
+                std::stable_sort(found.begin(), found.end(), key);
+            }
+            return ltm_db::ResultIteratorHelper::Ptr(new MemoryResultIterator(found));
+        }
+
+        unsigned MemoryMessageCollection::removeMessages(ltm_db::Query::ConstPtr query) {
+            const MemoryQuery *memory_query = cast_query(query);
+            if (query && !memory_query) return 0;
+
+            boost::unique_lock<boost::shared_mutex> lock(_data->mutex);
+            std::vector<MemoryDocumentPtr> kept;
+            kept.reserve(_data->documents.size());
+            std::vector<MemoryDocumentPtr>::const_iterator it;
+            for (it = _data->documents.begin(); it != _data->documents.end(); ++it) {
+                if (memory_query && !memory_query->matches((*it)->metadata->document())) kept.push_back(*it);
+            }
+            unsigned removed = (unsigned) (_data->documents.size() - kept.size());
+            _data->documents.swap(kept);
+            return removed;
+        }
+
+        void MemoryMessageCollection::modifyMetadata(ltm_db::Query::ConstPtr query, ltm_db::Metadata::ConstPtr metadata) {
+            const MemoryQuery *memory_query = cast_query(query);
+            MemoryMetadataConstPtr meta = boost::dynamic_pointer_cast<const MemoryMetadata>(metadata);
+            if ((query && !memory_query) || !meta) return;
+
+            // first match only. Documents are replaced, so running queries keep their snapshot.
+            boost::unique_lock<boost::shared_mutex> lock(_data->mutex);
+            std::vector<MemoryDocumentPtr>::iterator it;
+            for (it = _data->documents.begin(); it != _data->documents.end(); ++it) {
+                if (memory_query && !memory_query->matches((*it)->metadata->document())) continue;
+                JsonValue updated = (*it)->metadata->document();
+                JsonValue::Object::const_iterator f_it;
+                for (f_it = meta->document().as_object().begin(); f_it != meta->document().as_object().end(); ++f_it) {
+                    updated[f_it->first] = f_it->second;
+                }
+                boost::shared_ptr<MemoryDocument> doc(new MemoryDocument());
+                doc->metadata.reset(new MemoryMetadata(updated));
+                doc->message = (*it)->message;
+                *it = doc;
+                return;
+            }
+        }
+
+        unsigned MemoryMessageCollection::count() {
+            boost::shared_lock<boost::shared_mutex> lock(_data->mutex);
+            return (unsigned) _data->documents.size();
+        }
+
+        std::string MemoryMessageCollection::collectionName() const {
+            return _name;
+        }
+
+        ltm_db::Query::Ptr MemoryMessageCollection::createQuery() const {
+            return ltm_db::Query::Ptr(new MemoryQuery());
+        }
+
+        ltm_db::Metadata::Ptr MemoryMessageCollection::createMetadata() const {
+            return ltm_db::Metadata::Ptr(new MemoryMetadata());
+        }
+
+        ltm_db::Metadata::Ptr MemoryMessageCollection::createNestedMetadata() const {
+            return ltm_db::Metadata::Ptr(new MemoryMetadata());
+        }
+
+        // =================================================================================================================
+        // MemoryStore
+        // =================================================================================================================
+
+        MemoryStore::MemoryStore() {}
+
+        MemoryStore::~MemoryStore() {}
+
+        MemoryStore &MemoryStore::instance() {
+            static MemoryStore store;
+            return store;
+        }
+
+        MemoryCollectionDataPtr MemoryStore::collection(const std::string &db_name, const std::string &collection_name) {
+            boost::mutex::scoped_lock lock(_mutex);
+            MemoryCollectionDataPtr &data = _databases[db_name][collection_name];
+            if (!data) data.reset(new MemoryCollectionData());
+            return data;
+        }
+
+        void MemoryStore::drop(const std::string &db_name) {
+            boost::mutex::scoped_lock lock(_mutex);
+            CollectionMap &collections = _databases[db_name];
+            CollectionMap::iterator it;
+            for (it = collections.begin(); it != collections.end(); ++it) {
+                boost::unique_lock<boost::shared_mutex> c_lock(it->second->mutex);
+                it->second->documents.clear();
+            }
+        }
+
+        void MemoryStore::append_status(std::stringstream &status) {
+            boost::mutex::scoped_lock lock(_mutex);
+            std::map<std::string, CollectionMap>::const_iterator it;
+            for (it = _databases.begin(); it != _databases.end(); ++it) {
+                CollectionMap::const_iterator c_it;
+                for (c_it = it->second.begin(); c_it != it->second.end(); ++c_it) {
+                    boost::shared_lock<boost::shared_mutex> c_lock(c_it->second->mutex);
+                    status << " - " << it->first << "." << c_it->first << ": "
+                           << c_it->second->documents.size() << " documents" << std::endl;
+                }
+            }
+        }
+
+        // =================================================================================================================
+        // MemoryDatabaseConnection
+        // =================================================================================================================
+
+        MemoryDatabaseConnection::MemoryDatabaseConnection() : _connected(false) {}
+
+        MemoryDatabaseConnection::~MemoryDatabaseConnection() {}
+
+        bool MemoryDatabaseConnection::setParams(const std::string &host, unsigned port, float timeout) {
+            return true;
+        }
+
+        bool MemoryDatabaseConnection::setTimeout(float timeout) {
+            return true;
+        }
+
+        bool MemoryDatabaseConnection::connect() {
+            _connected = true;
+            return true;
+        }
+
+        bool MemoryDatabaseConnection::isConnected() {
+            return _connected;
+        }
+
+        void MemoryDatabaseConnection::dropDatabase(const std::string &db_name) {
+            MemoryStore::instance().drop(db_name);
+        }
+
+        std::string MemoryDatabaseConnection::messageType(const std::string &db_name, const std::string &collection_name) {
+            MemoryCollectionDataPtr data = MemoryStore::instance().collection(db_name, collection_name);
+            boost::shared_lock<boost::shared_mutex> lock(data->mutex);
+            return data->datatype;
+        }
+
+        ltm_db::MessageCollectionHelper::Ptr MemoryDatabaseConnection::openCollectionHelper(
+                const std::string &db_name, const std::string &collection_name) {
+            MemoryCollectionDataPtr data = MemoryStore::instance().collection(db_name, collection_name);
+            return ltm_db::MessageCollectionHelper::Ptr(new MemoryMessageCollection(db_name + "." + collection_name, data));
+        }
+
+    }
+}
@@ -0,0 +1,89 @@
+#include <ltm/db/query_aggregator.h>
+#include <algorithm>
+
+namespace ltm {
+    namespace db {
+
+        bool QueryAggregator::UidList::add(uint32_t uid) {
+            if (!visited.insert(uid).second) return false;
+            uids.push_back(uid);
+            return true;
+        }
+
+        QueryAggregator::QueryAggregator(bool sorted, size_t max_results) {
+            _sorted = sorted;
+            _max_results = max_results;
+            _stream_cnt = 0;
+            _entity_cnt = 0;
+        }
+
+        void QueryAggregator::add_episode(uint32_t uid) {
+            _episodes.add(uid);
+        }
+
+        void QueryAggregator::add_stream(const std::string &type, uint32_t uid) {
+            if (_streams[type].add(uid)) _stream_cnt++;
+        }
+
+        void QueryAggregator::add_entity(const std::string &type, uint32_t uid) {
+            if (_entities[type].add(uid)) _entity_cnt++;
+        }
+
+        size_t QueryAggregator::episodes_count() const {
+            return _episodes.uids.size();
+        }
+
+        size_t QueryAggregator::streams_count() const {
+            return _stream_cnt;
+        }
+
+        size_t QueryAggregator::entities_count() const {
+            return _entity_cnt;
+        }
+
+        size_t QueryAggregator::stream_types_count() const {
+            return _streams.size();
+        }
+
+        size_t QueryAggregator::entity_types_count() const {
+            return _entities.size();
+        }
+
+        void QueryAggregator::fill_list(const UidList &list, std::vector<uint32_t> &uids) {
+            uids = list.uids;
+            if (_sorted) {
+                std::sort(uids.begin(), uids.end());
+            }
+            if (_max_results > 0 && uids.size() > _max_results) {
+                uids.resize(_max_results);
+            }
+        }
+
+        void QueryAggregator::fill_types(const TypeMap &types, std::vector<ltm::QueryResult> &results) {
+            // semantic types are reported by name
+            std::vector<std::string> names;
+            names.reserve(types.size());
+            TypeMap::const_iterator it;
+            for (it = types.begin(); it != types.end(); ++it) {
+                names.push_back(it->first);
+            }
+            std::sort(names.begin(), names.end());
+
+            results.clear();
+            results.reserve(names.size());
+            std::vector<std::string>::const_iterator n_it;
+            for (n_it = names.begin(); n_it != names.end(); ++n_it) {
+                ltm::QueryResult qr;
+                qr.type = *n_it;
+                fill_list(types.find(*n_it)->second, qr.uids);
+                results.push_back(qr);
+            }
+        }
+
+        void QueryAggregator::fill(ltm::QueryServer::Response &res) {
+            fill_list(_episodes, res.episodes);
+            fill_types(_streams, res.streams);
+            fill_types(_entities, res.entities);
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#include <ltm/db/query_cache.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <cctype>
+#include <iomanip>
+
+namespace ltm {
+    namespace db {
+
+        QueryCache::QueryCache() : _hits(0), _misses(0), _invalidations(0) {}
+
+        QueryCache::~QueryCache() {}
+
+        QueryCache &QueryCache::instance() {
+            static QueryCache cache;
+            return cache;
+        }
+
+        void QueryCache::set_options(int max_bytes) {
+            _cache.set_capacity(max_bytes > 0 ? (size_t) max_bytes : 0);
+            _cache.clear();
+        }
+
+        bool QueryCache::enabled() const {
+            return _cache.enabled();
+        }
+
+        std::string QueryCache::normalize(const std::string &json) {
+            std::string out;
+            out.reserve(json.size());
+            char quote = 0;
+            for (size_t i = 0; i < json.size(); ++i) {
+                char c = json[i];
+                if (quote) {
+                    out += c;
+                    if (c == '\\' && i + 1 < json.size()) {
+                        out += json[++i];
+                    } else if (c == quote) {
+                        quote = 0;
+                    }
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                    out += c;
+                } else if (!std::isspace((unsigned char) c)) {
+                    out += c;
+                }
+            }
+            return out;
+        }
+
+        std::string QueryCache::make_key(const std::string &target, const std::string &type, const std::string &json) {
+            return target + '\n' + type + '\n' + normalize(json);
+        }
+
+        size_t QueryCache::cost(const std::string &key, const Entry &entry) {
+            size_t bytes = key.size() + entry.scope.size() + sizeof(Entry) + entry.episodes.size() * sizeof(uint32_t);
+            const std::vector<ltm::QueryResult> *lists[] = {&entry.streams, &entry.entities, &entry.entities_trail};
+            for (size_t i = 0; i < 3; ++i) {
+                std::vector<ltm::QueryResult>::const_iterator it;
+                for (it = lists[i]->begin(); it != lists[i]->end(); ++it) {
+                    bytes += sizeof(ltm::QueryResult) + it->type.size() + it->uids.size() * sizeof(uint32_t);
+                }
+            }
+            return bytes;
+        }
+
+        bool QueryCache::get(const std::string &target, const std::string &type, const std::string &json,
+                             const std::string &scope, ltm::QueryServer::Response &res) {
+            if (!_cache.enabled()) return false;
+            std::string key = make_key(target, type, json);
+            Entry entry;
+            bool found = _cache.get(key, entry);
+
+            boost::mutex::scoped_lock lock(_mutex);
+            if (found && (entry.scope != scope || entry.generation != _generations[scope])) {
+                // written since it was cached
+                _cache.erase(key);
+                found = false;
+            }
+            if (!found) {
+                ++_misses;
+                return false;
+            }
+            ++_hits;
+            res.episodes.swap(entry.episodes);
+            res.streams.swap(entry.streams);
+            res.entities.swap(entry.entities);
+            res.entities_trail.swap(entry.entities_trail);
+            return true;
+        }
+
+        void QueryCache::put(const std::string &target, const std::string &type, const std::string &json,
+                             const std::string &scope, const ltm::QueryServer::Response &res) {
+            if (!_cache.enabled()) return;
+            std::string key = make_key(target, type, json);
+            Entry entry;
+            entry.episodes = res.episodes;
+            entry.streams = res.streams;
+            entry.entities = res.entities;
+            entry.entities_trail = res.entities_trail;
+            entry.scope = scope;
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                entry.generation = _generations[scope];
+            }
+            _cache.put(key, entry, cost(key, entry));
+        }
+
+        void QueryCache::invalidate(const std::string &scope) {
+            boost::mutex::scoped_lock lock(_mutex);
+            ++_generations[scope];
+            ++_invalidations;
+        }
+
+        void QueryCache::clear() {
+            _cache.clear();
+        }
+
+        void QueryCache::append_status(std::stringstream &status) {
+            ltm::util::LRUCacheStats stats = _cache.stats();
+            if (stats.max_bytes == 0) {
+                status << "Query cache: disabled" << std::endl;
+                return;
+            }
+            boost::mutex::scoped_lock lock(_mutex);
+            size_t lookups = _hits + _misses;
+            std::stringstream hit_rate;
+            hit_rate << std::fixed << std::setprecision(1) << (lookups > 0 ? 100.0 * _hits / lookups : 0.0);
+            status << "Query cache: " << stats.entries << " entries, " << stats.bytes << "/" << stats.max_bytes << " bytes" << std::endl;
+            status << " - hits: " << _hits << ", misses: " << _misses << " (" << hit_rate.str()
+                   << "% hit rate), invalidations: " << _invalidations
+                   << ", evictions: " << stats.evictions << std::endl;
+        }
+
+    }
+}
@@ -0,0 +1,154 @@
+#include <ltm/db/request_cost.h>
+#include <ros/ros.h>
+#include <boost/thread/tss.hpp>
+#include <sstream>
+
+namespace ltm {
+    namespace db {
+
+        // =================================================================================================================
+        // CostContext
+        // =================================================================================================================
+
+        static const char *operation_names[] = {
+                "findOne", "queryList", "query", "insert", "remove", "count", "modifyMetadata"
+        };
+
+        // contexts are owned by their RequestScope
+        static void keep_context(CostContext *) {}
+
+        static boost::thread_specific_ptr<CostContext> &current_context() {
+            static boost::thread_specific_ptr<CostContext> context(keep_context);
+            return context;
+        }
+
+        CostContext::CostContext() : _documents(0), _bytes(0), _db_time_ns(0) {
+            for (size_t i = 0; i < OPERATIONS; ++i) _calls[i] = 0;
+        }
+
+        void CostContext::add_call(Operation operation, const ros::WallDuration &elapsed) {
+            _calls[operation].fetch_add(1, boost::memory_order_relaxed);
+            _db_time_ns.fetch_add(elapsed.toNSec(), boost::memory_order_relaxed);
+        }
+
+        void CostContext::add_read(size_t documents, size_t bytes) {
+            _documents.fetch_add(documents, boost::memory_order_relaxed);
+            _bytes.fetch_add(bytes, boost::memory_order_relaxed);
+        }
+
+        void CostContext::add(const CostContext &other) {
+            for (size_t i = 0; i < OPERATIONS; ++i) _calls[i].fetch_add(other._calls[i].load(), boost::memory_order_relaxed);
+            _documents.fetch_add(other._documents.load(), boost::memory_order_relaxed);
+            _bytes.fetch_add(other._bytes.load(), boost::memory_order_relaxed);
+            _db_time_ns.fetch_add(other._db_time_ns.load(), boost::memory_order_relaxed);
+        }
+
+        size_t CostContext::calls() const {
+            size_t calls = 0;
+            for (size_t i = 0; i < OPERATIONS; ++i) calls += _calls[i].load();
+            return calls;
+        }
+
+        size_t CostContext::documents() const {
+            return _documents.load();
+        }
+
+        size_t CostContext::bytes() const {
+            return _bytes.load();
+        }
+
+        ros::WallDuration CostContext::db_time() const {
+            ros::WallDuration db_time;
+            db_time.fromNSec(_db_time_ns.load());
+            return db_time;
+        }
+
+        std::string CostContext::to_string() const {
+            std::stringstream ss;
+            ss << calls() << " DB calls";
+            bool first = true;
+            for (size_t i = 0; i < OPERATIONS; ++i) {
+                size_t calls = _calls[i].load();
+                if (calls == 0) continue;
+                ss << (first ? " (" : ", ") << operation_names[i] << ": " << calls;
+                first = false;
+            }
+            if (!first) ss << ")";
+            ss << ", " << documents() << " documents, " << bytes() << " bytes, "
+               << db_time().toSec() * 1000.0 << " ms in DB";
+            return ss.str();
+        }
+
+        void CostContext::to_msg(ltm::RequestCost &msg) const {
+            msg.calls = (uint32_t) calls();
+            msg.documents = (uint32_t) documents();
+            msg.bytes = (uint64_t) bytes();
+            msg.db_time_ms = db_time().toSec() * 1000.0;
+        }
+
+        CostContext *CostContext::current() {
+            return current_context().get();
+        }
+
+        void CostContext::set_current(CostContext *cost) {
+            current_context().reset(cost);
+        }
+
+        void CostContext::read(size_t documents, size_t bytes) {
+            CostContext *cost = current();
+            if (cost) cost->add_read(documents, bytes);
+        }
+
+        // =================================================================================================================
+        // CostScope
+        // =================================================================================================================
+
+        CostScope::CostScope(CostContext *cost) : _outer(CostContext::current()) {
+            CostContext::set_current(cost);
+        }
+
+        CostScope::~CostScope() {
+            CostContext::set_current(_outer);
+        }
+
+        // =================================================================================================================
+        // RequestScope
+        // =================================================================================================================
+
+        boost::atomic<uint64_t> RequestScope::_slow_threshold(0);
+
+        RequestScope::RequestScope(ltm::util::LatencyHistogram &histogram)
+                : _histogram(histogram), _start(ros::WallTime::now()), _outer(CostContext::current()), _report(NULL) {
+            CostContext::set_current(&_cost);
+        }
+
+        RequestScope::~RequestScope() {
+            ros::WallDuration elapsed = ros::WallTime::now() - _start;
+            _histogram.record(elapsed);
+            CostContext::set_current(_outer);
+            if (_outer) _outer->add(_cost);
+
+            if (_report) {
+                _cost.to_msg(*_report);
+                _report->total_time_ms = elapsed.toSec() * 1000.0;
+            }
+            uint64_t threshold = _slow_threshold.load(boost::memory_order_relaxed);
+            ROS_WARN_STREAM_COND(threshold > 0 && (uint64_t) (elapsed.toNSec() / 1000) >= threshold,
+                                 "[LTM]: Slow request '" << _histogram.name() << "' took "
+                                 << elapsed.toSec() * 1000.0 << " ms: " << _cost.to_string() << ".");
+        }
+
+        const CostContext &RequestScope::cost() const {
+            return _cost;
+        }
+
+        void RequestScope::report(ltm::RequestCost &msg) {
+            _report = &msg;
+        }
+
+        void RequestScope::set_slow_threshold(double seconds) {
+            _slow_threshold.store(seconds > 0 ? (uint64_t) (seconds * 1e6) : 0);
+        }
+
+    }
+}
@@ -0,0 +1,52 @@
+#include <ltm/db/storage_backend.h>
+#include <ltm/db/memory_database.h>
+#include <ltm/util/parameter_server_wrapper.h>
+#include <ros/ros.h>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+
+// queries of both backends are used through the same interface, see types.h
+BOOST_STATIC_ASSERT((boost::is_same<ltm_db_mongo::Query, ltm_db::Query>::value));
+
+namespace ltm {
+    namespace db {
+
+        StorageBackend::StorageBackend() : _memory(false) {
+            ltm::util::ParameterServerWrapper psw;
+            psw.getParameter("backend", _name, "mongo");
+            if (_name == "memory") {
+                _memory = true;
+                ROS_WARN_STREAM("Using the in-memory DB backend. Nothing will be persisted.");
+            } else if (_name != "mongo") {
+                ROS_WARN_STREAM("Unknown DB backend '" << _name << "'. Using 'mongo'.");
+                _name = "mongo";
+            }
+        }
+
+        StorageBackend::~StorageBackend() {}
+
+        StorageBackend &StorageBackend::instance() {
+            static StorageBackend backend;
+            return backend;
+        }
+
+        const std::string &StorageBackend::name() const {
+            return _name;
+        }
+
+        bool StorageBackend::is_memory() const {
+            return _memory;
+        }
+
+        DBConnectionPtr StorageBackend::create_connection() const {
+            if (_memory) return DBConnectionPtr(new MemoryDatabaseConnection());
+            return DBConnectionPtr(new ltm_db_mongo::MongoDatabaseConnection());
+        }
+
+        void StorageBackend::append_status(std::stringstream &status) {
+            status << "Backend: " << _name << std::endl;
+            if (_memory) MemoryStore::instance().append_status(status);
+        }
+
+    }
+}
@@ -126,17 +126,17 @@ namespace ltm {
             }
         }
 
-        void EntitiesManager::query(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail) {
+        bool EntitiesManager::query(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail) {
             if (_use_plugins) {
                 std::vector<PluginPtr>::iterator it;
                 for (it = _plugins.begin(); it != _plugins.end(); ++it) {
                     if ((*it)->get_type() == type) {
-                        (*it)->query(json, res, trail);
-                        return;
+                        return (*it)->query(json, res, trail);
                     }
                 }
             }
             ROS_WARN_STREAM("Query: Entity type '" << type << "' not found.");
+            return false;
         }
     }
 }
\ No newline at end of file
@@ -23,6 +23,8 @@ namespace ltm {
         }
 
         void PluginsManager::register_episode(uint32_t uid, EpisodeRegister &reg) {
+            // registry and plugins are shared by all service threads
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             // register in cache
             std::map<uint32_t, EpisodeRegister>::const_iterator it = registry.find(uid);
             if (it != registry.end()) {
@@ -42,6 +44,7 @@ namespace ltm {
         }
 
         void PluginsManager::unregister_episode(uint32_t uid) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             // unregister from cache
             std::map<uint32_t, EpisodeRegister>::const_iterator it = registry.find(uid);
             if (it == registry.end()) {
@@ -60,6 +63,7 @@ namespace ltm {
         }
 
         void PluginsManager::collect(uint32_t uid, ltm::Episode &episode) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             EpisodeRegister reg = registry[uid];
             ROS_DEBUG_STREAM(" - plugin manager: collecting information...");
             ROS_DEBUG_STREAM(" - plugin manager: gather location: " << reg.gather_location);
@@ -74,6 +78,7 @@ namespace ltm {
         }
 
         void PluginsManager::drop_db() {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             registry.clear();
             ROS_WARN_STREAM("Resetting Location Manager ...");
             _location_manager->reset();
@@ -89,6 +94,7 @@ namespace ltm {
         }
 
         bool PluginsManager::switch_db(const std::string &db_name) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             registry.clear();
 
             ROS_WARN_STREAM("Resetting Location Manager ...");
@@ -106,18 +112,21 @@ namespace ltm {
         }
 
         void PluginsManager::append_status(std::stringstream &status) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
             status << "Entity Plugins: \n";
             _entities_manager->append_status(status);
             status << "Stream Plugins: \n";
             _streams_manager->append_status(status);
         }
 
-        void PluginsManager::query_stream(std::string type, const std::string &json, ltm::QueryServer::Response &res) {
-            _streams_manager->query(type, json, res);
+        bool PluginsManager::query_stream(std::string type, const std::string &json, ltm::QueryServer::Response &res) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
+            return _streams_manager->query(type, json, res);
         }
 
-        void PluginsManager::query_entity(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail) {
-            _entities_manager->query(type, json, res, trail);
+        bool PluginsManager::query_entity(std::string type, const std::string &json, ltm::QueryServer::Response &res, bool trail) {
+            ltm::db::DBLock lock(ltm::db::db_mutex());
+            return _entities_manager->query(type, json, res, trail);
         }
 
     }
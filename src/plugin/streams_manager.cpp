@@ -131,17 +131,17 @@ namespace ltm {
             }
         }
 
-        void StreamsManager::query(std::string type, const std::string &json, ltm::QueryServer::Response &res) {
+        bool StreamsManager::query(std::string type, const std::string &json, ltm::QueryServer::Response &res) {
             if (_use_plugins) {
                 std::vector<PluginPtr>::iterator it;
                 for (it = _plugins.begin(); it != _plugins.end(); ++it) {
                     if ((*it)->get_type() == type) {
-                        (*it)->query(json, res);
-                        return;
+                        return (*it)->query(json, res);
                     }
                 }
             }
             ROS_WARN_STREAM("Query: Stream type '" << type << "' not found.");
+            return false;
         }
 
     }
@@ -18,91 +18,458 @@ namespace ltm {
         psw.getParameter("host", _db_host, "localhost");
         psw.getParameter("port", _db_port, 27017);
         psw.getParameter("timeout", _db_timeout, 60.0);
+        psw.getParameter("query/sorted", _query_sorted, false);
+        psw.getParameter("query/max_results", _query_max_results, 0);
+        psw.getParameter("query/cursor_ttl", _query_cursor_ttl, 60.0);
+        psw.getParameter("query/max_cursors", _query_max_cursors, 64);
+        psw.getParameter("tree/threads", _tree_threads, 0);
+        psw.getParameter("tree/grain", _tree_grain, 64);
+        psw.getParameter("cache/max_bytes", _cache_max_bytes, 16777216);
+        psw.getParameter("query_cache/max_bytes", _query_cache_max_bytes, 8388608);
+        psw.getParameter("threads/services", _service_threads, 4);
+        psw.getParameter("threads/heavy", _heavy_threads, 2);
+        psw.getParameter("write_behind/enabled", _write_behind, false);
+        psw.getParameter("write_behind/capacity", _write_behind_capacity, 1000);
+        psw.getParameter("write_behind/batch", _write_behind_batch, 100);
+        psw.getParameter("counters/reconcile_period", _counters_period, 300.0);
+        psw.getParameter("metrics/period", _metrics_period, 10.0);
+        psw.getParameter("metrics/slow_request_ms", _slow_request_ms, 500.0);
+
+        ltm::db::RequestScope::set_slow_threshold(_slow_request_ms / 1000.0);
+        ltm::db::QueryCache::instance().set_options(_query_cache_max_bytes);
 
         // DB manager
         _db.reset(new ltm::db::EpisodeCollectionManager(_db_name, _db_collection_name, _db_host, (uint)_db_port, _db_timeout));
         _db->setup();
+        _db->set_query_options(_query_sorted, _query_max_results);
+        _cursors.set_options(_query_cursor_ttl, (size_t) std::max(_query_max_cursors, 1));
+        _db->set_tree_options(_tree_threads, _tree_grain);
+        _db->set_cache_options(_cache_max_bytes);
+        if (_write_behind) {
+            _episode_queue.reset(new EpisodeQueue(boost::bind(&Server::write_episodes, this, _1),
+                                                  (size_t) std::max(_write_behind_capacity, 1),
+                                                  (size_t) std::max(_write_behind_batch, 1), &_write_mutex));
+        }
 
         // Plugins manager
         _pl.reset(new ltm::plugin::PluginsManager(_db->_conn, _db_name));
 
+        // Long running services have their own queue, so they cannot starve the others.
+        ros::NodeHandle heavy("~");
+        heavy.setCallbackQueue(&_heavy_queue);
+
         // Announce services
         _add_episode_service = priv.advertiseService("episode/add", &Server::add_episode_service, this);
+        _add_episodes_service = heavy.advertiseService("episode/add_batch", &Server::add_episodes_service, this);
         _get_episodes_service = priv.advertiseService("episode/get", &Server::get_episodes_service, this);
         _register_episode_service = priv.advertiseService("episode/register", &Server::register_episode_service, this);
-        _update_tree_service = priv.advertiseService("episode/update_tree", &Server::update_tree_service, this);
+        _update_tree_service = heavy.advertiseService("episode/update_tree", &Server::update_tree_service, this);
+        _update_episode_service = priv.advertiseService("episode/update", &Server::update_episode_service, this);
         _status_service = priv.advertiseService("db/status", &Server::status_service, this);
-        _drop_db_service = priv.advertiseService("db/drop", &Server::drop_db_service, this);
-        _switch_db_service = priv.advertiseService("db/switch", &Server::switch_db_service, this);
-        _query_server_service = priv.advertiseService("db/query", &Server::query_server_service, this);
+        _metrics_service = priv.advertiseService("db/metrics", &Server::metrics_service, this);
+        _drop_db_service = heavy.advertiseService("db/drop", &Server::drop_db_service, this);
+        _switch_db_service = heavy.advertiseService("db/switch", &Server::switch_db_service, this);
+        _query_server_service = heavy.advertiseService("db/query", &Server::query_server_service, this);
+        _query_join_service = heavy.advertiseService("db/query_join", &Server::query_join_service, this);
+        _query_when_service = priv.advertiseService("db/query_when", &Server::query_when_service, this);
+        _query_where_service = priv.advertiseService("db/query_where", &Server::query_where_service, this);
+        _query_tags_service = priv.advertiseService("db/query_tags", &Server::query_tags_service, this);
+
+        // counters are reconciled on setup, this only corrects drifts (e.g., other DB clients)
+        if (_counters_period > 0) {
+            _counters_timer = priv.createWallTimer(ros::WallDuration(_counters_period), &Server::reconcile_counters, this);
+        }
+
+        // metrics are latched, so late subscribers get the last ones
+        _metrics_pub = priv.advertise<ltm::Metrics>("metrics", 1, true);
+        if (_metrics_period > 0) {
+            _metrics_timer = priv.createWallTimer(ros::WallDuration(_metrics_period), &Server::publish_metrics, this);
+        }
+        publish_metrics(ros::WallTimerEvent());
 
         ROS_INFO_STREAM(_log_prefix << "Server is up and running.");
         show_status();
     }
 
-    Server::~Server() {}
+    Server::~Server() {
+        // cursors give their connections back to the DB manager
+        _cursors.clear();
+        // write pending episodes while the DB and plugins are still alive
+        _episode_queue.reset();
+    }
+
+    void Server::spin() {
+        // Services, plugin services and subscriptions run on the global queue.
+        ros::AsyncSpinner spinner((uint32_t) std::max(_service_threads, 1));
+        ros::AsyncSpinner heavy_spinner((uint32_t) std::max(_heavy_threads, 1), &_heavy_queue);
+        spinner.start();
+        heavy_spinner.start();
+        ROS_INFO_STREAM(_log_prefix << "Serving with (" << _service_threads << ") threads and ("
+                                    << _heavy_threads << ") threads for long running services.");
+        ros::waitForShutdown();
+    }
+
+    std::string Server::db_name() {
+        boost::mutex::scoped_lock lock(_params_mutex);
+        return _db_name;
+    }
 
     void Server::show_status() {
         std::stringstream status;
         status << "Database parameters: " << std::endl;
-        status << " - name: " << _db_name << std::endl;
+        status << " - name: " << db_name() << std::endl;
         status << " - host: " << _db_host << std::endl;
         status << " - port: " << _db_port << std::endl;
         status << "Episodes: " << _db->count() << " entries in collection '" << _db_collection_name << "'" << std::endl;
+        status << "Open query cursors: " << _cursors.size() << std::endl;
+        if (_episode_queue) {
+            status << " - write-behind: " << _episode_queue->size() << " pending episodes" << std::endl;
+        }
+        _db->append_status(status);
         _pl->append_status(status);
+        ltm::db::QueryCache::instance().append_status(status);
+        ltm::db::CounterRegistry::instance().append_status(status);
+        ltm::db::IndexProvisioner::instance().append_status(status);
+        ltm::db::StorageBackend::instance().append_status(status);
         ROS_INFO_STREAM(_log_prefix << "DB Status:\n" << status.str());
     }
 
+    void Server::reconcile_counters(const ros::WallTimerEvent &event) {
+        size_t drifted = ltm::db::CounterRegistry::instance().reconcile_all();
+        ROS_WARN_STREAM_COND(drifted > 0, _log_prefix << "(" << drifted << ") collection counters were out of sync with the DB.");
+    }
+
+    static void fill_latencies(const ltm::util::MetricsRegistry::Snapshots &snapshots,
+                               std::vector<ltm::LatencyStats> &stats) {
+        stats.clear();
+        stats.reserve(snapshots.size());
+        ltm::util::MetricsRegistry::Snapshots::const_iterator it;
+        for (it = snapshots.begin(); it != snapshots.end(); ++it) {
+            ltm::LatencyStats s;
+            s.name = it->first;
+            s.count = it->second.count;
+            s.mean_us = it->second.mean_us;
+            s.p50_us = it->second.p50_us;
+            s.p95_us = it->second.p95_us;
+            s.p99_us = it->second.p99_us;
+            s.max_us = it->second.max_us;
+            stats.push_back(s);
+        }
+    }
+
+    void Server::fill_metrics(ltm::Metrics &metrics) {
+        metrics.stamp = ros::Time::now();
+        metrics.db_name = db_name();
+        metrics.backend = ltm::db::StorageBackend::instance().name();
+        metrics.episodes = (uint32_t) _db->count();
+        metrics.open_cursors = (uint32_t) _cursors.size();
+        metrics.pending_episodes = (uint32_t) (_episode_queue ? _episode_queue->size() : 0);
+
+        std::vector<std::pair<std::string, int> > counts;
+        ltm::db::CounterRegistry::instance().get_counts(counts);
+        metrics.collections.clear();
+        std::vector<std::pair<std::string, int> >::const_iterator c_it;
+        for (c_it = counts.begin(); c_it != counts.end(); ++c_it) {
+            ltm::CollectionStats collection;
+            collection.name = c_it->first;
+            collection.count = (uint32_t) c_it->second;
+            metrics.collections.push_back(collection);
+        }
+
+        ltm::util::MetricsRegistry::Snapshots snapshots;
+        ltm::util::MetricsRegistry::instance().snapshot_services(snapshots);
+        fill_latencies(snapshots, metrics.services);
+        ltm::util::MetricsRegistry::instance().snapshot_db(snapshots);
+        fill_latencies(snapshots, metrics.db);
+    }
+
+    void Server::publish_metrics(const ros::WallTimerEvent &event) {
+        ltm::Metrics metrics;
+        fill_metrics(metrics);
+        _metrics_pub.publish(metrics);
+    }
+
+    bool Server::collect_episode(ltm::Episode &episode) {
+        if (episode.type == ltm::Episode::LEAF) {
+            // only collect information for LEAFs
+            ROS_DEBUG_STREAM("ADD: as LEAF '" << episode.uid << "'");
+            _pl->collect(episode.uid, episode);
+        } else if (episode.type == ltm::Episode::EPISODE) {
+            ROS_DEBUG_STREAM("ADD: as NODE '" << episode.uid << "'");
+            // update node based on its children
+            // THIS REQUIRES THE CHILDREN_IDS FIELD TO BE SET UP.
+            // TODO: rework design to not require this field. It can be built automatically while adding children.
+            _db->update_from_children(episode);
+        } else {
+            ROS_ERROR_STREAM("Unsupported episode type: " << (uint32_t) episode.type);
+            return false;
+        }
+        _pl->unregister_episode(episode.uid);
+        return true;
+    }
+
+    void Server::flush_episodes() {
+        // Writers call it while holding the write mutex: queued episodes are then written by the caller,
+        // and no other episode can be queued or written until the mutex is released.
+        if (_episode_queue) _episode_queue->flush();
+    }
+
+    void Server::write_episodes(const std::vector<EpisodeQueue::Entry> &entries) {
+        // the queue holds the write mutex
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        // a request of its own on the queue thread, nested in the flushing one otherwise
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/write_behind"));
+
+        // the last version of each episode wins
+        std::map<uint32_t, size_t> last;
+        std::vector<uint32_t> uids;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (last.find(entries[i].first) == last.end()) uids.push_back(entries[i].first);
+            last[entries[i].first] = i;
+        }
+
+        // Queued episodes were checked against 'replace' when added. If the stored ones are unknown, all
+        // are written as replacements: a new revision is also valid for a new episode.
+        std::set<uint32_t> existing;
+        if (!_db->has_many(uids, existing)) {
+            ROS_ERROR_STREAM(_log_prefix << "WRITE BEHIND: Could not look for the stored episodes. Writing ("
+                                         << uids.size() << ") episodes as replacements.");
+            existing.insert(uids.begin(), uids.end());
+        }
+
+        std::vector<ltm::Episode> to_insert;
+        std::vector<ltm::Episode> to_replace;
+        std::map<uint32_t, size_t>::const_iterator l_it;
+        for (l_it = last.begin(); l_it != last.end(); ++l_it) {
+            const ltm::Episode &episode = entries[l_it->second].second;
+            if (existing.find(episode.uid) != existing.end()) {
+                to_replace.push_back(episode);
+            } else {
+                to_insert.push_back(episode);
+            }
+        }
+        _db->insert_many(to_insert);
+        _db->update_many(to_replace);
+
+        std::vector<ltm::Episode>::const_iterator it;
+        for (it = to_insert.begin(); it != to_insert.end(); ++it) {
+            _db->update_ancestors(*it, false);
+        }
+        for (it = to_replace.begin(); it != to_replace.end(); ++it) {
+            _db->update_ancestors(*it, true);
+        }
+        ROS_DEBUG_STREAM(_log_prefix << "WRITE BEHIND: Wrote (" << last.size() << ") episodes, replacing ("
+                                     << to_replace.size() << ") of them.");
+    }
+
     // ==========================================================
     // ROS Services
     // ==========================================================
 
     bool Server::get_episodes_service(ltm::GetEpisodes::Request &req, ltm::GetEpisodes::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/get"));
+        if (req.report_cost) request.report(res.cost);
         ROS_INFO_STREAM(_log_prefix << "GET: Retrieving episodes with uids: " << ltm::util::vector_to_str(req.uids));
-        res.not_found.clear();
         res.episodes.clear();
-        std::vector<uint32_t> visited;
-        std::vector<uint32_t>::const_iterator it;
-        for (it = req.uids.begin(); it != req.uids.end(); ++it) {
-            // do not seek repeated episodes
-            if (visited.end() != std::find(visited.begin(), visited.end(), *it)) continue;
-            visited.push_back(*it);
-
-            EpisodeWithMetadataPtr ep_ptr;
-            if (!_db->get(*it, ep_ptr)) {
-                res.not_found.push_back(*it);
+
+        // Episodes are returned once, in the requested order. Those still on the write-behind queue
+        // are newer than the stored ones, so they are served from it.
+        std::vector<uint32_t> uids;
+        std::vector<uint32_t> requested;
+        std::set<uint32_t> visited;
+        std::map<uint32_t, ltm::Episode> queued;
+        std::vector<uint32_t>::const_iterator u_it;
+        for (u_it = req.uids.begin(); u_it != req.uids.end(); ++u_it) {
+            if (!visited.insert(*u_it).second) continue;
+            requested.push_back(*u_it);
+            ltm::Episode episode;
+            if (_episode_queue && _episode_queue->find(*u_it, episode)) {
+                queued[*u_it] = episode;
+            } else {
+                uids.push_back(*u_it);
+            }
+        }
+
+        std::vector<EpisodeWithMetadataPtr> episodes;
+        if (!_db->get_many(uids, episodes, res.not_found)) {
+            ROS_ERROR_STREAM(_log_prefix << "GET: Could not retrieve episodes from the DB.");
+            return false;
+        }
+        std::map<uint32_t, EpisodeWithMetadataPtr> stored;
+        std::vector<EpisodeWithMetadataPtr>::const_iterator it;
+        for (it = episodes.begin(); it != episodes.end(); ++it) {
+            stored[(*it)->uid] = *it;
+        }
+
+        res.episodes.reserve(queued.size() + stored.size());
+        for (u_it = requested.begin(); u_it != requested.end(); ++u_it) {
+            std::map<uint32_t, ltm::Episode>::const_iterator q_it = queued.find(*u_it);
+            if (q_it != queued.end()) {
+                res.episodes.push_back(q_it->second);
                 continue;
             }
-            res.episodes.push_back(*ep_ptr);
+            std::map<uint32_t, EpisodeWithMetadataPtr>::const_iterator s_it = stored.find(*u_it);
+            if (s_it != stored.end()) res.episodes.push_back(*s_it->second);
         }
         ROS_WARN_STREAM_COND(res.not_found.size() > 0, _log_prefix
                 << "GET: The following requested episodes were not found: " << ltm::util::vector_to_str(res.not_found));
         return true;
     }
 
+    bool Server::next_page(ltm::db::QueryCursorPtr cursor, uint32_t limit, ltm::QueryServer::Response &res) {
+        res.continuation.clear();
+        if (cursor->next(limit, res)) res.continuation = _cursors.put(cursor);
+        return true;
+    }
+
     bool Server::query_server_service(ltm::QueryServer::Request &req, ltm::QueryServer::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("db/query"));
+        if (req.report_cost) request.report(res.cost);
+        // next page of a previous query
+        if (!req.continuation.empty()) {
+            ltm::db::QueryCursorPtr cursor = _cursors.take(req.continuation);
+            if (!cursor) {
+                ROS_WARN_STREAM(_log_prefix << "QUERY: Unknown or expired continuation token '" << req.continuation << "'.");
+                return false;
+            }
+            return next_page(cursor, req.limit, res);
+        }
+
+        bool paged = req.limit > 0 || !req.sort_by.empty();
         if (req.target == "episode") {
-            _db->query(req.json, res, req.logging);
-            return true;
-        } else if (req.target == "entity") {
-            _pl->query_entity(req.semantic_type, req.json, res, false);
-            return true;
+            flush_episodes();
+            ltm::db::EpisodeQuery query(req.filter);
+            query.json(req.json);
+            if (!paged) {
+                _db->query(query, res, req.logging);
+                return true;
+            }
+            ltm::db::QueryCursorPtr cursor = _db->open_cursor(query, req.sort_by, !req.descending);
+            if (!cursor) return false;
+            return next_page(cursor, req.limit, res);
+        }
+
+        bool ok;
+        if (req.target == "entity") {
+            ok = _pl->query_entity(req.semantic_type, req.json, res, false);
         } else if (req.target == "entity_trail") {
-            _pl->query_entity(req.semantic_type, req.json, res, true);
-            return true;
+            ok = _pl->query_entity(req.semantic_type, req.json, res, true);
         } else if (req.target == "stream") {
-            _pl->query_stream(req.semantic_type, req.json, res);
+            ok = _pl->query_stream(req.semantic_type, req.json, res);
+        } else {
+            ROS_WARN_STREAM("Invalid 'target' field for 'query' service. Got: '" << req.target << "'");
+            return false;
+        }
+        if (!ok) {
+            ROS_WARN_STREAM(_log_prefix << "QUERY: Failed to query '" << req.target << "' of type '" << req.semantic_type << "'.");
+            return false;
+        }
+        if (!paged) return true;
+
+        // plugins answer at once, their results are paged from memory
+        ROS_WARN_STREAM_COND(!req.sort_by.empty() && req.sort_by != "uid", _log_prefix << "QUERY: Sorting '"
+                << req.target << "' results by '" << req.sort_by << "' is not supported. Using the natural order.");
+        ltm::db::QueryCursorPtr cursor(new ltm::db::ResultCursor(res, req.sort_by == "uid", !req.descending));
+        return next_page(cursor, req.limit, res);
+    }
+
+    bool Server::query_join_service(ltm::QueryJoin::Request &req, ltm::QueryJoin::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("db/query_join"));
+        // Plugin predicates go first, their episodes are sorted and intersected. The episode predicate
+        // is then evaluated by the DB on the joined uids only.
+        std::vector<uint32_t> joined;
+        bool constrained = false;
+        if (!req.entity_type.empty()) {
+            ltm::QueryServer::Response entity_res;
+            if (!_pl->query_entity(req.entity_type, req.entity_json.empty() ? "{}" : req.entity_json, entity_res, true)) {
+                ROS_WARN_STREAM(_log_prefix << "QUERY JOIN: Failed to query entities of type '" << req.entity_type << "'.");
+                res.succeeded = (uint8_t) false;
+                return true;
+            }
+            ltm::util::uid_vector_sort(entity_res.episodes);
+            joined.swap(entity_res.episodes);
+            constrained = true;
+        }
+        if (!req.stream_type.empty() && (!constrained || !joined.empty())) {
+            ltm::QueryServer::Response stream_res;
+            if (!_pl->query_stream(req.stream_type, req.stream_json.empty() ? "{}" : req.stream_json, stream_res)) {
+                ROS_WARN_STREAM(_log_prefix << "QUERY JOIN: Failed to query streams of type '" << req.stream_type << "'.");
+                res.succeeded = (uint8_t) false;
+                return true;
+            }
+            ltm::util::uid_vector_sort(stream_res.episodes);
+            if (constrained) {
+                ltm::util::uid_vector_intersect(joined, stream_res.episodes);
+            } else {
+                joined.swap(stream_res.episodes);
+            }
+            constrained = true;
+        }
+
+        ltm::db::EpisodeQuery query(req.episode_filter);
+        query.json(req.episode_json);
+        if (constrained) {
+            if (!req.episode_filter.uids.empty()) {
+                std::vector<uint32_t> uids(req.episode_filter.uids);
+                ltm::util::uid_vector_sort(uids);
+                ltm::util::uid_vector_intersect(joined, uids);
+            }
+            if (joined.empty() || query.empty()) {
+                res.episodes.swap(joined);
+                res.succeeded = (uint8_t) true;
+                ROS_DEBUG_STREAM(_log_prefix << "QUERY JOIN: Found (" << res.episodes.size() << ") episodes.");
+                return true;
+            }
+            query.uids(joined);
+        } else if (query.empty()) {
+            ROS_WARN_STREAM(_log_prefix << "QUERY JOIN: At least one predicate is required.");
+            res.succeeded = (uint8_t) false;
             return true;
         }
-        ROS_WARN_STREAM("Invalid 'target' field for 'query' service. Got: '" << req.target << "'");
-        return false;
+
+        flush_episodes();
+        ltm::QueryServer::Response episode_res;
+        res.succeeded = (uint8_t) _db->query(query, episode_res, false);
+        res.episodes.swap(episode_res.episodes);
+        ltm::util::uid_vector_sort(res.episodes);
+        ROS_DEBUG_STREAM(_log_prefix << "QUERY JOIN: Found (" << res.episodes.size() << ") episodes.");
+        return true;
+    }
+
+    bool Server::query_when_service(ltm::QueryWhen::Request &req, ltm::QueryWhen::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("db/query_when"));
+        flush_episodes();
+        res.succeeded = (uint8_t) _db->query_when(req.mode, req.start, req.end, res.episodes);
+        ROS_DEBUG_STREAM(_log_prefix << "QUERY WHEN: Found (" << res.episodes.size() << ") episodes.");
+        return true;
+    }
+
+    bool Server::query_where_service(ltm::QueryWhere::Request &req, ltm::QueryWhere::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("db/query_where"));
+        flush_episodes();
+        res.succeeded = (uint8_t) _db->query_where(req, res.episodes);
+        ROS_DEBUG_STREAM(_log_prefix << "QUERY WHERE: Found (" << res.episodes.size() << ") episodes on map '"
+                                     << req.map_name << "', frame '" << req.frame_id << "'.");
+        return true;
+    }
+
+    bool Server::query_tags_service(ltm::QueryTags::Request &req, ltm::QueryTags::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("db/query_tags"));
+        flush_episodes();
+        res.succeeded = (uint8_t) _db->query_tags(req.expression, req.include_children, res.episodes);
+        ROS_DEBUG_STREAM(_log_prefix << "QUERY TAGS: Found (" << res.episodes.size() << ") episodes for '" << req.expression << "'.");
+        return true;
     }
 
     bool Server::register_episode_service(ltm::RegisterEpisode::Request &req, ltm::RegisterEpisode::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/register"));
+        if (req.report_cost) request.report(res.cost);
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        flush_episodes();
         int value;
         if (req.generate_uid) {
             value = _db->reserve_uid();
-            ROS_DEBUG_STREAM(_log_prefix << "[REGISTER] Reserving random uid: " << value);
+            ROS_DEBUG_STREAM(_log_prefix << "[REGISTER] Reserving sequential uid: " << value);
         } else {
             value = req.uid;
             ROS_DEBUG_STREAM(_log_prefix << "[REGISTER] Reserving fixed uid: " << value);
@@ -116,6 +483,7 @@ namespace ltm {
                     return false;
                 }
             }
+            _db->reserve_fixed_uid(value);
         }
         res.uid = (uint32_t) value;
 
@@ -132,36 +500,30 @@ namespace ltm {
     }
 
     bool Server::update_tree_service(ltm::UpdateTree::Request &req, ltm::UpdateTree::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/update_tree"));
+        if (req.report_cost) request.report(res.cost);
+        flush_episodes();
+        // Not serialized with the other writes: the manager recomputes the tree without blocking them,
+        // and only writes it back if no episode changed meanwhile.
         ROS_INFO_STREAM(_log_prefix << "Updating episode structure for uid: " << req.uid);
         // reportar problemas!
         // TODO: missing child
         // TODO: missing root
+        res.succeeded = (uint8_t) true;
         if (!_db->update_tree(req.uid)) {
             ROS_ERROR_STREAM(_log_prefix << "A problem occurred while trying to update the tree for uid: " << req.uid);
             res.succeeded = (uint8_t) false;
         }
-        res.succeeded = (uint8_t) true;
         return true;
     }
 
     bool Server::add_episode_service(ltm::AddEpisode::Request &req, ltm::AddEpisode::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/add"));
+        if (_episode_queue) return enqueue_episode(req, res);
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
         bool replace = false;
         ROS_DEBUG_STREAM("ADD: Episode '" << req.episode.uid << "'");
-        if (req.episode.type == ltm::Episode::LEAF) {
-            // only collect information for LEAFs
-            ROS_DEBUG_STREAM("ADD: as LEAF '" << req.episode.uid << "'");
-            _pl->collect(req.episode.uid, req.episode);
-        } else if (req.episode.type == ltm::Episode::EPISODE) {
-            ROS_DEBUG_STREAM("ADD: as NODE '" << req.episode.uid << "'");
-            // update node based on its children
-            // THIS REQUIRES THE CHILDREN_IDS FIELD TO BE SET UP.
-            // TODO: rework design to not require this field. It can be built automatically while adding children.
-            _db->update_from_children(req.episode);
-        } else {
-            ROS_ERROR_STREAM("Unsupported episode type: " << (uint32_t) req.episode.type);
-            return false;
-        }
-        _pl->unregister_episode(req.episode.uid);
+        if (!collect_episode(req.episode)) return false;
 
         // insert episode
         if (_db->has(req.episode.uid)) {
@@ -172,12 +534,15 @@ namespace ltm {
                 return true;
             }
             replace = true;
-            _db->remove(req.episode.uid);
         }
-        _db->insert(req.episode);
+        if (replace) {
+            _db->update(req.episode);
+        } else {
+            _db->insert(req.episode);
+        }
 
-        // TODO: update branch up to the root
-        // impl
+        // update branch up to the root
+        _db->update_ancestors(req.episode, replace);
 
         // finish
         ROS_INFO_STREAM_COND(req.logging && replace, _log_prefix << "ADD: Replacing episode '" << req.episode.uid << "'. (" << _db->count() << " entries)");
@@ -186,12 +551,135 @@ namespace ltm {
         return true;
     }
 
+    bool Server::enqueue_episode(ltm::AddEpisode::Request &req, ltm::AddEpisode::Response &res) {
+        // Queued under the write mutex, so a drop or switch never sees an accepted episode that is
+        // not on the queue yet.
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        // nodes are built from their children, which must be written first
+        if (req.episode.type == ltm::Episode::EPISODE) flush_episodes();
+        ROS_DEBUG_STREAM("ADD: Queuing episode '" << req.episode.uid << "'");
+        if (!collect_episode(req.episode)) return false;
+
+        ltm::Episode pending;
+        // stored uids are known from the in-memory indexes, no DB read
+        bool replace = _episode_queue->find(req.episode.uid, pending) || _db->has(req.episode.uid);
+        if (replace && !req.replace) {
+            ROS_ERROR_STREAM(_log_prefix << "ADD: Episode with uid '" << req.episode.uid << "' already exists.");
+            res.succeeded = (uint8_t) false;
+            return true;
+        }
+
+        // the writer thread waits for the write mutex, so a full queue is written here instead of blocking
+        if (_episode_queue->full()) flush_episodes();
+        _episode_queue->push(req.episode.uid, req.episode);
+        ROS_INFO_STREAM_COND(req.logging && replace, _log_prefix << "ADD: Replacing episode '" << req.episode.uid << "'. (queued)");
+        ROS_INFO_STREAM_COND(req.logging && !replace, _log_prefix << "ADD: New episode '" << req.episode.uid << "'. (queued)");
+        res.succeeded = (uint8_t) true;
+        return true;
+    }
+
+    bool Server::add_episodes_service(ltm::AddEpisodes::Request &req, ltm::AddEpisodes::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/add_batch"));
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        flush_episodes();
+        ROS_DEBUG_STREAM("ADD BATCH: (" << req.episodes.size() << ") episodes");
+        res.succeeded.assign(req.episodes.size(), (uint8_t) false);
+
+        std::vector<uint32_t> uids;
+        std::vector<ltm::Episode>::iterator it;
+        for (it = req.episodes.begin(); it != req.episodes.end(); ++it) {
+            uids.push_back(it->uid);
+        }
+
+        // a single lookup for all uids already in the DB
+        std::set<uint32_t> existing;
+        if (!_db->has_many(uids, existing)) {
+            ROS_ERROR_STREAM(_log_prefix << "ADD BATCH: Could not look for the stored episodes. Nothing was added.");
+            return true;
+        }
+
+        std::set<uint32_t> batch_uids;
+        std::vector<ltm::Episode> to_insert;
+        std::vector<ltm::Episode> to_replace;
+        to_insert.reserve(req.episodes.size());
+        for (size_t i = 0; i < req.episodes.size(); ++i) {
+            ltm::Episode &episode = req.episodes[i];
+            if (!batch_uids.insert(episode.uid).second) {
+                ROS_ERROR_STREAM(_log_prefix << "ADD BATCH: Episode with uid '" << episode.uid << "' is repeated on the batch.");
+                continue;
+            }
+            // collected before the checks, as on add_episode_service, so rejected episodes are unregistered too
+            if (!collect_episode(episode)) continue;
+            if (existing.find(episode.uid) != existing.end()) {
+                if (!req.replace) {
+                    ROS_ERROR_STREAM(_log_prefix << "ADD BATCH: Episode with uid '" << episode.uid << "' already exists.");
+                    continue;
+                }
+                to_replace.push_back(episode);
+            } else {
+                to_insert.push_back(episode);
+            }
+            res.succeeded[i] = (uint8_t) true;
+        }
+
+        // write everything at once
+        _db->insert_many(to_insert);
+        _db->update_many(to_replace);
+
+        // update branches up to the root
+        for (it = to_insert.begin(); it != to_insert.end(); ++it) {
+            _db->update_ancestors(*it, false);
+        }
+        for (it = to_replace.begin(); it != to_replace.end(); ++it) {
+            _db->update_ancestors(*it, true);
+        }
+
+        ROS_INFO_STREAM_COND(req.logging, _log_prefix << "ADD BATCH: Added (" << to_insert.size() + to_replace.size()
+                                                      << "/" << req.episodes.size() << ") episodes, replacing ("
+                                                      << to_replace.size() << ") of them.");
+        return true;
+    }
+
+    bool Server::update_episode_service(ltm::UpdateEpisode::Request &req, ltm::UpdateEpisode::Response &res) {
+        ltm::db::RequestScope request(ltm::util::MetricsRegistry::instance().service("episode/update"));
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        flush_episodes();
+        ROS_DEBUG_STREAM(_log_prefix << "UPDATE: Episode '" << req.uid << "'");
+        EpisodeWithMetadataPtr ep_ptr;
+        if (!_db->get(req.uid, ep_ptr)) {
+            ROS_WARN_STREAM(_log_prefix << "UPDATE: Episode '" << req.uid << "' does not exists.");
+            res.succeeded = (uint8_t) false;
+            return true;
+        }
+
+        // patch the selected fields, then write the whole episode as a new revision (the older one is removed)
+        ltm::Episode episode = *ep_ptr;
+        if (req.update_tags) {
+            episode.tags = req.tags;
+            std::sort(episode.tags.begin(), episode.tags.end());
+        }
+        if (req.update_relevance) {
+            episode.relevance = req.relevance;
+        }
+        res.succeeded = (uint8_t) _db->update(episode);
+        if (res.succeeded) _db->update_ancestors(episode, true);
+        return true;
+    }
+
     bool Server::status_service(std_srvs::Empty::Request &req, std_srvs::Empty::Response &res) {
         show_status();
         return true;
     }
 
+    bool Server::metrics_service(ltm::GetMetrics::Request &req, ltm::GetMetrics::Response &res) {
+        fill_metrics(res.metrics);
+        return true;
+    }
+
     bool Server::drop_db_service(ltm::DropDB::Request &req, ltm::DropDB::Response &res) {
+        // queued episodes belong to the current DB, nothing can be queued until it is dropped
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        flush_episodes();
         // TODO: this requires a synchronization mechanism
         if (!req.i_understand_this_is_a_dangerous_operation ||
             req.html_is_a_real_programming_language) {
@@ -201,6 +689,7 @@ namespace ltm {
         }
 
         ROS_WARN_STREAM(_log_prefix << "DELETE: Deleting all entries from collection '" << _db_collection_name << "'");
+        _cursors.clear();
         _pl->drop_db();
         _db->drop_db();
         show_status();
@@ -208,10 +697,18 @@ namespace ltm {
     }
 
     bool Server::switch_db_service(ltm::SwitchDB::Request &req, ltm::SwitchDB::Response &res) {
-        ROS_WARN_STREAM(_log_prefix << "Switching LTM database from '" << _db_name << "' to '" << req.db_name << "'");
-        _db_name = req.db_name;
+        // queued episodes belong to the current DB, nothing can be queued until it is switched
+        boost::recursive_mutex::scoped_lock lock(_write_mutex);
+        flush_episodes();
+        ROS_WARN_STREAM(_log_prefix << "Switching LTM database from '" << db_name() << "' to '" << req.db_name << "'");
+        {
+            boost::mutex::scoped_lock params_lock(_params_mutex);
+            _db_name = req.db_name;
+        }
+        _cursors.clear();
         _pl->switch_db(req.db_name);
         _db->switch_db(req.db_name);
+        return true;
     }
 }
 
@@ -222,7 +719,7 @@ int main(int argc, char **argv) {
     boost::scoped_ptr<ltm::Server> server(new ltm::Server());
 
     // run
-    ros::spin();
+    server->spin();
 
     // close
     printf("\nClosing LTM server... \n\n");
@@ -0,0 +1,198 @@
+#include <ltm/util/interval_tree.h>
+#include <algorithm>
+
+namespace ltm {
+    namespace util {
+
+        IntervalTree::IntervalTree() : _root(-1), _seed(2463534242u) {}
+
+        IntervalTree::~IntervalTree() {}
+
+        size_t IntervalTree::size() const {
+            return _by_uid.size();
+        }
+
+        bool IntervalTree::contains(uint32_t uid) const {
+            return _by_uid.find(uid) != _by_uid.end();
+        }
+
+        void IntervalTree::clear() {
+            _nodes.clear();
+            _free.clear();
+            _by_uid.clear();
+            _root = -1;
+        }
+
+        bool IntervalTree::less(int a, double start, uint32_t uid) const {
+            // nodes are ordered by (start, uid)
+            const Node &node = _nodes[a];
+            return node.start < start || (node.start == start && node.uid < uid);
+        }
+
+        int IntervalTree::new_node(uint32_t uid, double start, double end) {
+            // xorshift priorities keep the treap balanced in expectation
+            _seed ^= _seed << 13;
+            _seed ^= _seed >> 17;
+            _seed ^= _seed << 5;
+
+            Node node;
+            node.uid = uid;
+            node.start = start;
+            node.end = end;
+            node.max_end = end;
+            node.min_end = end;
+            node.priority = _seed;
+            node.left = -1;
+            node.right = -1;
+            if (!_free.empty()) {
+                int n = _free.back();
+                _free.pop_back();
+                _nodes[n] = node;
+                return n;
+            }
+            _nodes.push_back(node);
+            return (int) _nodes.size() - 1;
+        }
+
+        void IntervalTree::pull(int n) {
+            Node &node = _nodes[n];
+            node.max_end = node.end;
+            node.min_end = node.end;
+            if (node.left >= 0) {
+                node.max_end = std::max(node.max_end, _nodes[node.left].max_end);
+                node.min_end = std::min(node.min_end, _nodes[node.left].min_end);
+            }
+            if (node.right >= 0) {
+                node.max_end = std::max(node.max_end, _nodes[node.right].max_end);
+                node.min_end = std::min(node.min_end, _nodes[node.right].min_end);
+            }
+        }
+
+        void IntervalTree::split(int n, double start, uint32_t uid, bool inclusive, int &left, int &right) {
+            // left: keys before (start, uid), also the key itself when inclusive. right: the others.
+            if (n < 0) {
+                left = right = -1;
+                return;
+            }
+            bool goes_left = less(n, start, uid) || (inclusive && _nodes[n].start == start && _nodes[n].uid == uid);
+            if (goes_left) {
+                split(_nodes[n].right, start, uid, inclusive, _nodes[n].right, right);
+                left = n;
+            } else {
+                split(_nodes[n].left, start, uid, inclusive, left, _nodes[n].left);
+                right = n;
+            }
+            pull(n);
+        }
+
+        int IntervalTree::merge(int left, int right) {
+            // every key on left precedes the keys on right
+            if (left < 0) return right;
+            if (right < 0) return left;
+            if (_nodes[left].priority > _nodes[right].priority) {
+                _nodes[left].right = merge(_nodes[left].right, right);
+                pull(left);
+                return left;
+            }
+            _nodes[right].left = merge(left, _nodes[right].left);
+            pull(right);
+            return right;
+        }
+
+        void IntervalTree::insert(uint32_t uid, double start, double end) {
+            remove(uid);
+            if (end < start) std::swap(start, end);
+            int n = new_node(uid, start, end);
+            int left, right;
+            split(_root, start, uid, false, left, right);
+            _root = merge(merge(left, n), right);
+            _by_uid[uid] = n;
+        }
+
+        bool IntervalTree::remove(uint32_t uid) {
+            boost::unordered_map<uint32_t, int>::iterator it = _by_uid.find(uid);
+            if (it == _by_uid.end()) return false;
+            double start = _nodes[it->second].start;
+
+            // isolate the node and join the rest
+            int left, middle, right;
+            split(_root, start, uid, false, left, right);
+            split(right, start, uid, true, middle, right);
+            _root = merge(left, right);
+            if (middle >= 0) _free.push_back(middle);
+            _by_uid.erase(it);
+            return true;
+        }
+
+        void IntervalTree::query_overlap(double start, double end, std::vector<uint32_t> &uids) const {
+            overlap(_root, start, end, uids);
+        }
+
+        void IntervalTree::query_contained(double start, double end, std::vector<uint32_t> &uids) const {
+            contained(_root, start, end, uids);
+        }
+
+        void IntervalTree::query_before(double time, std::vector<uint32_t> &uids) const {
+            before(_root, time, uids);
+        }
+
+        void IntervalTree::query_after(double time, std::vector<uint32_t> &uids) const {
+            after(_root, time, uids);
+        }
+
+        void IntervalTree::overlap(int n, double start, double end, std::vector<uint32_t> &uids) const {
+            // start <= end(i) && start(i) <= end
+            if (n < 0 || _nodes[n].max_end < start) return;
+            const Node &node = _nodes[n];
+            overlap(node.left, start, end, uids);
+            if (node.start > end) return;
+            if (node.end >= start) uids.push_back(node.uid);
+            overlap(node.right, start, end, uids);
+        }
+
+        void IntervalTree::contained(int n, double start, double end, std::vector<uint32_t> &uids) const {
+            // start <= start(i) && end(i) <= end
+            if (n < 0 || _nodes[n].min_end > end) return;
+            const Node &node = _nodes[n];
+            if (node.start >= start) {
+                contained(node.left, start, end, uids);
+                if (node.end <= end) uids.push_back(node.uid);
+            }
+            if (node.start <= end) contained(node.right, start, end, uids);
+        }
+
+        void IntervalTree::before(int n, double time, std::vector<uint32_t> &uids) const {
+            // end(i) < time, which also requires start(i) < time
+            if (n < 0 || _nodes[n].min_end >= time) return;
+            const Node &node = _nodes[n];
+            before(node.left, time, uids);
+            if (node.start >= time) return;
+            if (node.end < time) uids.push_back(node.uid);
+            before(node.right, time, uids);
+        }
+
+        void IntervalTree::after(int n, double time, std::vector<uint32_t> &uids) const {
+            // time < start(i). Nodes are ordered by start, so the left subtree of a node starting
+            // before time is skipped, and the right subtree of a node starting after it is taken whole.
+            while (n >= 0) {
+                const Node &node = _nodes[n];
+                if (node.start <= time) {
+                    n = node.right;
+                    continue;
+                }
+                after(node.left, time, uids);
+                uids.push_back(node.uid);
+                all(node.right, uids);
+                return;
+            }
+        }
+
+        void IntervalTree::all(int n, std::vector<uint32_t> &uids) const {
+            if (n < 0) return;
+            all(_nodes[n].left, uids);
+            uids.push_back(_nodes[n].uid);
+            all(_nodes[n].right, uids);
+        }
+
+    }
+}
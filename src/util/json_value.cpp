@@ -0,0 +1,410 @@
+#include <ltm/util/json_value.h>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace ltm {
+    namespace util {
+
+        // =================================================================================================================
+        // Value
+        // =================================================================================================================
+
+        JsonValue::JsonValue() : _type(NUL), _bool(false), _number(0), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(bool value) : _type(BOOL), _bool(value), _number(0), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(int value) : _type(NUMBER), _bool(false), _number(value), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(double value) : _type(NUMBER), _bool(false), _number(value), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(const char *value)
+                : _type(STRING), _bool(false), _number(0), _string(value), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(const std::string &value)
+                : _type(STRING), _bool(false), _number(0), _string(value), _array(NULL), _object(NULL) {}
+
+        JsonValue::JsonValue(const JsonValue &other)
+                : _type(other._type), _bool(other._bool), _number(other._number), _string(other._string),
+                  _array(other._array ? new Array(*other._array) : NULL),
+                  _object(other._object ? new Object(*other._object) : NULL) {}
+
+        JsonValue &JsonValue::operator=(const JsonValue &other) {
+            if (this == &other) return *this;
+            // other may be owned by this value
+            JsonValue copy(other);
+            reset();
+            _type = copy._type;
+            _bool = copy._bool;
+            _number = copy._number;
+            _string.swap(copy._string);
+            std::swap(_array, copy._array);
+            std::swap(_object, copy._object);
+            return *this;
+        }
+
+        JsonValue::~JsonValue() {
+            reset();
+        }
+
+        void JsonValue::reset() {
+            delete _array;
+            delete _object;
+            _array = NULL;
+            _object = NULL;
+            _string.clear();
+            _type = NUL;
+        }
+
+        JsonValue JsonValue::make_array() {
+            JsonValue value;
+            value.array();
+            return value;
+        }
+
+        JsonValue JsonValue::make_object() {
+            JsonValue value;
+            value.object();
+            return value;
+        }
+
+        JsonValue::Type JsonValue::type() const {
+            return _type;
+        }
+
+        bool JsonValue::is_null() const {
+            return _type == NUL;
+        }
+
+        bool JsonValue::is_array() const {
+            return _type == ARRAY;
+        }
+
+        bool JsonValue::is_object() const {
+            return _type == OBJECT;
+        }
+
+        bool JsonValue::as_bool() const {
+            if (_type == NUMBER) return _number != 0;
+            return _type == BOOL && _bool;
+        }
+
+        double JsonValue::as_number() const {
+            if (_type == BOOL) return _bool ? 1 : 0;
+            return _type == NUMBER ? _number : 0;
+        }
+
+        const std::string &JsonValue::as_string() const {
+            return _string;
+        }
+
+        const JsonValue::Array &JsonValue::as_array() const {
+            static const Array empty;
+            return _array ? *_array : empty;
+        }
+
+        const JsonValue::Object &JsonValue::as_object() const {
+            static const Object empty;
+            return _object ? *_object : empty;
+        }
+
+        JsonValue::Array &JsonValue::array() {
+            if (_type != ARRAY) {
+                reset();
+                _type = ARRAY;
+                _array = new Array();
+            }
+            return *_array;
+        }
+
+        JsonValue::Object &JsonValue::object() {
+            if (_type != OBJECT) {
+                reset();
+                _type = OBJECT;
+                _object = new Object();
+            }
+            return *_object;
+        }
+
+        JsonValue &JsonValue::operator[](const std::string &key) {
+            return object()[key];
+        }
+
+        void JsonValue::push_back(const JsonValue &value) {
+            array().push_back(value);
+        }
+
+        const JsonValue *JsonValue::find(const std::string &key) const {
+            if (!_object) return NULL;
+            Object::const_iterator it = _object->find(key);
+            return (it != _object->end()) ? &it->second : NULL;
+        }
+
+        const JsonValue *JsonValue::find_path(const std::string &path) const {
+            const JsonValue *value = this;
+            size_t begin = 0;
+            while (value) {
+                size_t end = path.find('.', begin);
+                if (end == std::string::npos) return value->find(path.substr(begin));
+                value = value->find(path.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            return NULL;
+        }
+
+        int JsonValue::compare(const JsonValue &a, const JsonValue &b) {
+            // MongoDB order: null < numbers < strings < objects < arrays < booleans
+            static const int rank[] = {0, 5, 1, 2, 4, 3};
+            if (a._type != b._type) return rank[a._type] < rank[b._type] ? -1 : 1;
+            switch (a._type) {
+                case NUL:
+                    return 0;
+                case BOOL:
+                    return (a._bool == b._bool) ? 0 : (a._bool ? 1 : -1);
+                case NUMBER:
+                    return (a._number < b._number) ? -1 : (a._number > b._number ? 1 : 0);
+                case STRING:
+                    return a._string.compare(b._string);
+                case ARRAY: {
+                    const Array &x = a.as_array();
+                    const Array &y = b.as_array();
+                    for (size_t i = 0; i < x.size() && i < y.size(); ++i) {
+                        int c = compare(x[i], y[i]);
+                        if (c != 0) return c;
+                    }
+                    return (x.size() == y.size()) ? 0 : (x.size() < y.size() ? -1 : 1);
+                }
+                case OBJECT: {
+                    const Object &x = a.as_object();
+                    const Object &y = b.as_object();
+                    Object::const_iterator x_it = x.begin(), y_it = y.begin();
+                    for (; x_it != x.end() && y_it != y.end(); ++x_it, ++y_it) {
+                        int c = x_it->first.compare(y_it->first);
+                        if (c != 0) return c;
+                        c = compare(x_it->second, y_it->second);
+                        if (c != 0) return c;
+                    }
+                    return (x.size() == y.size()) ? 0 : (x.size() < y.size() ? -1 : 1);
+                }
+            }
+            return 0;
+        }
+
+        bool JsonValue::operator==(const JsonValue &other) const {
+            return compare(*this, other) == 0;
+        }
+
+        bool JsonValue::operator!=(const JsonValue &other) const {
+            return compare(*this, other) != 0;
+        }
+
+        // =================================================================================================================
+        // Text
+        // =================================================================================================================
+
+        static void write_string(std::string &out, const std::string &value) {
+            out += '"';
+            for (size_t i = 0; i < value.size(); ++i) {
+                char c = value[i];
+                if (c == '"' || c == '\\') out += '\\';
+                if (c == '\n') {
+                    out += "\\n";
+                    continue;
+                }
+                out += c;
+            }
+            out += '"';
+        }
+
+        void JsonValue::write(std::string &out) const {
+            switch (_type) {
+                case NUL:
+                    out += "null";
+                    break;
+                case BOOL:
+                    out += _bool ? "true" : "false";
+                    break;
+                case NUMBER: {
+                    std::ostringstream ss;
+                    ss.precision(17);
+                    ss << _number;
+                    out += ss.str();
+                    break;
+                }
+                case STRING:
+                    write_string(out, _string);
+                    break;
+                case ARRAY: {
+                    out += '[';
+                    const Array &values = as_array();
+                    for (size_t i = 0; i < values.size(); ++i) {
+                        if (i > 0) out += ", ";
+                        values[i].write(out);
+                    }
+                    out += ']';
+                    break;
+                }
+                case OBJECT: {
+                    out += '{';
+                    Object::const_iterator it;
+                    for (it = as_object().begin(); it != as_object().end(); ++it) {
+                        if (it != as_object().begin()) out += ", ";
+                        write_string(out, it->first);
+                        out += ": ";
+                        it->second.write(out);
+                    }
+                    out += '}';
+                    break;
+                }
+            }
+        }
+
+        std::string JsonValue::to_string() const {
+            std::string out;
+            write(out);
+            return out;
+        }
+
+        // Recursive descent parser over the relaxed syntax.
+        class JsonParser {
+        private:
+            const std::string &_text;
+            size_t _pos;
+            std::string _error;
+
+            bool fail(const std::string &what) {
+                if (_error.empty()) {
+                    std::stringstream ss;
+                    ss << what << " at offset " << _pos;
+                    _error = ss.str();
+                }
+                return false;
+            }
+
+            void skip_spaces() {
+                while (_pos < _text.size() && std::isspace((unsigned char) _text[_pos])) ++_pos;
+            }
+
+            bool consume(char c) {
+                skip_spaces();
+                if (_pos < _text.size() && _text[_pos] == c) {
+                    ++_pos;
+                    return true;
+                }
+                return false;
+            }
+
+            bool parse_string(std::string &out) {
+                char quote = _text[_pos++];
+                while (_pos < _text.size() && _text[_pos] != quote) {
+                    char c = _text[_pos++];
+                    if (c == '\\' && _pos < _text.size()) {
+                        c = _text[_pos++];
+                        if (c == 'n') c = '\n';
+                        else if (c == 't') c = '\t';
+                        else if (c == 'r') c = '\r';
+                    }
+                    out += c;
+                }
+                if (_pos >= _text.size()) return fail("Unterminated string");
+                ++_pos;
+                return true;
+            }
+
+            bool parse_word(std::string &out) {
+                while (_pos < _text.size()) {
+                    char c = _text[_pos];
+                    if (!std::isalnum((unsigned char) c) && c != '_' && c != '$' && c != '.' && c != '-' && c != '+') break;
+                    out += c;
+                    ++_pos;
+                }
+                return !out.empty() || fail("Expected a value");
+            }
+
+            bool parse_key(std::string &key) {
+                skip_spaces();
+                if (_pos >= _text.size()) return fail("Expected a key");
+                if (_text[_pos] == '"' || _text[_pos] == '\'') return parse_string(key);
+                return parse_word(key);
+            }
+
+            bool parse_object(JsonValue &value) {
+                JsonValue::Object &object = value.object();
+                if (consume('}')) return true;
+                do {
+                    std::string key;
+                    if (!parse_key(key)) return false;
+                    if (!consume(':')) return fail("Expected ':'");
+                    if (!parse_value(object[key])) return false;
+                } while (consume(','));
+                return consume('}') || fail("Expected '}'");
+            }
+
+            bool parse_array(JsonValue &value) {
+                JsonValue::Array &array = value.array();
+                if (consume(']')) return true;
+                do {
+                    array.push_back(JsonValue());
+                    if (!parse_value(array.back())) return false;
+                } while (consume(','));
+                return consume(']') || fail("Expected ']'");
+            }
+
+        public:
+            explicit JsonParser(const std::string &text) : _text(text), _pos(0) {}
+
+            const std::string &error() const {
+                return _error;
+            }
+
+            bool parse_value(JsonValue &value) {
+                skip_spaces();
+                if (_pos >= _text.size()) return fail("Unexpected end of text");
+                char c = _text[_pos];
+                if (c == '{') {
+                    ++_pos;
+                    return parse_object(value);
+                }
+                if (c == '[') {
+                    ++_pos;
+                    return parse_array(value);
+                }
+                if (c == '"' || c == '\'') {
+                    std::string s;
+                    if (!parse_string(s)) return false;
+                    value = JsonValue(s);
+                    return true;
+                }
+                std::string word;
+                if (!parse_word(word)) return false;
+                if (word == "null") value = JsonValue();
+                else if (word == "true") value = JsonValue(true);
+                else if (word == "false") value = JsonValue(false);
+                else {
+                    char *end;
+                    double number = std::strtod(word.c_str(), &end);
+                    if (*end != '\0') return fail("Invalid value '" + word + "'");
+                    value = JsonValue(number);
+                }
+                return true;
+            }
+
+            bool finish() {
+                skip_spaces();
+                return _pos == _text.size() || fail("Unexpected trailing text");
+            }
+        };
+
+        bool JsonValue::parse(const std::string &text, JsonValue &value, std::string &error) {
+            JsonParser parser(text);
+            JsonValue result;
+            if (!parser.parse_value(result) || !parser.finish()) {
+                error = parser.error();
+                return false;
+            }
+            value = result;
+            return true;
+        }
+
+    }
+}
@@ -0,0 +1,127 @@
+#include <ltm/util/metrics.h>
+#include <boost/thread/locks.hpp>
+
+namespace ltm {
+    namespace util {
+
+        // =================================================================================================================
+        // LatencyHistogram
+        // =================================================================================================================
+
+        LatencyHistogram::LatencyHistogram(const std::string &name) : _name(name) {
+            for (size_t i = 0; i < BUCKETS; ++i) _buckets[i].store(0);
+            _sum_us.store(0);
+            _max_us.store(0);
+        }
+
+        LatencyHistogram::~LatencyHistogram() {}
+
+        const std::string &LatencyHistogram::name() const {
+            return _name;
+        }
+
+        size_t LatencyHistogram::bucket(uint64_t us) {
+            size_t i = 0;
+            while (us >= 2 && i < BUCKETS - 1) {
+                us >>= 1;
+                ++i;
+            }
+            return i;
+        }
+
+        void LatencyHistogram::record(uint64_t us) {
+            _buckets[bucket(us)].fetch_add(1, boost::memory_order_relaxed);
+            _sum_us.fetch_add(us, boost::memory_order_relaxed);
+            uint64_t max = _max_us.load(boost::memory_order_relaxed);
+            while (us > max && !_max_us.compare_exchange_weak(max, us, boost::memory_order_relaxed)) {}
+        }
+
+        void LatencyHistogram::record(const ros::WallDuration &elapsed) {
+            int64_t ns = elapsed.toNSec();
+            record(ns > 0 ? (uint64_t) (ns / 1000) : 0);
+        }
+
+        LatencySnapshot LatencyHistogram::snapshot() const {
+            uint64_t counts[BUCKETS];
+            LatencySnapshot s;
+            s.count = 0;
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                counts[i] = _buckets[i].load(boost::memory_order_relaxed);
+                s.count += counts[i];
+            }
+            s.max_us = _max_us.load(boost::memory_order_relaxed);
+            s.mean_us = (s.count > 0) ? _sum_us.load(boost::memory_order_relaxed) / (double) s.count : 0.0;
+
+            // nearest rank over the buckets
+            const double quantiles[] = {0.50, 0.95, 0.99};
+            double *values[] = {&s.p50_us, &s.p95_us, &s.p99_us};
+            for (size_t q = 0; q < 3; ++q) {
+                *values[q] = 0.0;
+                if (s.count == 0) continue;
+                uint64_t rank = (uint64_t) (quantiles[q] * s.count + 0.999999);
+                uint64_t seen = 0;
+                for (size_t i = 0; i < BUCKETS; ++i) {
+                    seen += counts[i];
+                    if (seen >= rank) {
+                        double upper = (double) ((uint64_t) 1 << (i + 1));
+                        *values[q] = (upper < s.max_us) ? upper : s.max_us;
+                        break;
+                    }
+                }
+            }
+            return s;
+        }
+
+        // =================================================================================================================
+        // MetricsRegistry
+        // =================================================================================================================
+
+        MetricsRegistry::MetricsRegistry() {}
+
+        MetricsRegistry::~MetricsRegistry() {}
+
+        MetricsRegistry &MetricsRegistry::instance() {
+            static MetricsRegistry registry;
+            return registry;
+        }
+
+        LatencyHistogram &MetricsRegistry::histogram(HistogramMap &histograms, const std::string &name) {
+            {
+                boost::shared_lock<boost::shared_mutex> lock(_mutex);
+                HistogramMap::const_iterator it = histograms.find(name);
+                if (it != histograms.end()) return *it->second;
+            }
+            boost::unique_lock<boost::shared_mutex> lock(_mutex);
+            boost::shared_ptr<LatencyHistogram> &histogram = histograms[name];
+            if (!histogram) histogram.reset(new LatencyHistogram(name));
+            return *histogram;
+        }
+
+        LatencyHistogram &MetricsRegistry::service(const std::string &name) {
+            return histogram(_services, name);
+        }
+
+        LatencyHistogram &MetricsRegistry::db(const std::string &operation) {
+            return histogram(_db, operation);
+        }
+
+        void MetricsRegistry::snapshot(const HistogramMap &histograms, Snapshots &snapshots) {
+            boost::shared_lock<boost::shared_mutex> lock(_mutex);
+            snapshots.clear();
+            snapshots.reserve(histograms.size());
+            HistogramMap::const_iterator it;
+            for (it = histograms.begin(); it != histograms.end(); ++it) {
+                snapshots.push_back(std::make_pair(it->first, it->second->snapshot()));
+            }
+        }
+
+        void MetricsRegistry::snapshot_services(Snapshots &snapshots) {
+            snapshot(_services, snapshots);
+        }
+
+        void MetricsRegistry::snapshot_db(Snapshots &snapshots) {
+            snapshot(_db, snapshots);
+        }
+
+    }
+}
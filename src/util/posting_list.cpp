@@ -0,0 +1,173 @@
+#include <ltm/util/posting_list.h>
+#include <algorithm>
+
+namespace ltm {
+    namespace util {
+
+        const uint32_t CompressedPostingList::MAX_BLOCK;
+
+        CompressedPostingList::CompressedPostingList() : _size(0) {}
+
+        CompressedPostingList::~CompressedPostingList() {}
+
+        size_t CompressedPostingList::size() const {
+            return _size;
+        }
+
+        bool CompressedPostingList::empty() const {
+            return _size == 0;
+        }
+
+        size_t CompressedPostingList::blocks() const {
+            return _blocks.size();
+        }
+
+        void CompressedPostingList::clear() {
+            _blocks.clear();
+            _size = 0;
+        }
+
+        void CompressedPostingList::append_varint(std::vector<uint8_t> &bytes, uint32_t value) {
+            while (value >= 0x80) {
+                bytes.push_back((uint8_t) ((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            bytes.push_back((uint8_t) value);
+        }
+
+        void CompressedPostingList::decode_block(uint32_t first, const Block &block, std::vector<uint32_t> &uids) {
+            uids.push_back(first);
+            uint32_t value = first;
+            uint32_t delta = 0;
+            int shift = 0;
+            std::vector<uint8_t>::const_iterator it;
+            for (it = block.deltas.begin(); it != block.deltas.end(); ++it) {
+                delta |= (uint32_t) (*it & 0x7F) << shift;
+                if (*it & 0x80) {
+                    shift += 7;
+                    continue;
+                }
+                value += delta;
+                uids.push_back(value);
+                delta = 0;
+                shift = 0;
+            }
+        }
+
+        void CompressedPostingList::decode(std::vector<uint32_t> &uids) const {
+            uids.reserve(uids.size() + _size);
+            BlockMap::const_iterator it;
+            for (it = _blocks.begin(); it != _blocks.end(); ++it) {
+                decode_block(it->first, it->second, uids);
+            }
+        }
+
+        void CompressedPostingList::store(const std::vector<uint32_t> &uids) {
+            // a block overflows by one uid at most, then it is split in halves
+            size_t parts = uids.size() > MAX_BLOCK ? 2 : 1;
+            size_t begin = 0;
+            for (size_t part = 0; part < parts; ++part) {
+                size_t end = (part + 1 == parts) ? uids.size() : uids.size() / 2;
+                Block &block = _blocks[uids[begin]];
+                block.last = uids[end - 1];
+                block.count = (uint32_t) (end - begin);
+                block.deltas.clear();
+                for (size_t i = begin + 1; i < end; ++i) {
+                    append_varint(block.deltas, uids[i] - uids[i - 1]);
+                }
+                begin = end;
+            }
+        }
+
+        CompressedPostingList::BlockMap::iterator CompressedPostingList::find_block(uint32_t uid) {
+            // last block starting at or before uid, or the first block
+            BlockMap::iterator it = _blocks.upper_bound(uid);
+            if (it != _blocks.begin()) --it;
+            return it;
+        }
+
+        bool CompressedPostingList::insert(uint32_t uid) {
+            if (_blocks.empty()) {
+                std::vector<uint32_t> uids(1, uid);
+                store(uids);
+                ++_size;
+                return true;
+            }
+            BlockMap::iterator it = find_block(uid);
+            Block &block = it->second;
+            if (uid == it->first || uid == block.last) return false;
+
+            // appending past the end of a block does not need to decode it
+            if (uid > block.last && block.count < MAX_BLOCK) {
+                append_varint(block.deltas, uid - block.last);
+                block.last = uid;
+                ++block.count;
+                ++_size;
+                return true;
+            }
+
+            std::vector<uint32_t> uids;
+            uids.reserve(block.count + 1);
+            decode_block(it->first, block, uids);
+            std::vector<uint32_t>::iterator pos = std::lower_bound(uids.begin(), uids.end(), uid);
+            if (pos != uids.end() && *pos == uid) return false;
+            uids.insert(pos, uid);
+            _blocks.erase(it);
+            store(uids);
+            ++_size;
+            return true;
+        }
+
+        bool CompressedPostingList::erase(uint32_t uid) {
+            if (_blocks.empty()) return false;
+            BlockMap::iterator it = find_block(uid);
+            if (uid < it->first || uid > it->second.last) return false;
+
+            std::vector<uint32_t> uids;
+            uids.reserve(MAX_BLOCK);
+            decode_block(it->first, it->second, uids);
+            std::vector<uint32_t>::iterator pos = std::lower_bound(uids.begin(), uids.end(), uid);
+            if (pos == uids.end() || *pos != uid) return false;
+            uids.erase(pos);
+
+            // merge small blocks into the next one, so removes do not leave many tiny blocks
+            BlockMap::iterator next = it;
+            ++next;
+            if (uids.size() < MAX_BLOCK / 4 && next != _blocks.end() && uids.size() + next->second.count <= MAX_BLOCK) {
+                decode_block(next->first, next->second, uids);
+                _blocks.erase(next);
+            }
+            _blocks.erase(it);
+            if (!uids.empty()) store(uids);
+            --_size;
+            return true;
+        }
+
+        bool CompressedPostingList::contains(uint32_t uid) const {
+            BlockMap::const_iterator it = _blocks.upper_bound(uid);
+            if (it == _blocks.begin()) return false;
+            --it;
+            if (uid == it->first || uid == it->second.last) return true;
+            if (uid > it->second.last) return false;
+
+            // walk the deltas up to uid
+            uint32_t value = it->first;
+            uint32_t delta = 0;
+            int shift = 0;
+            std::vector<uint8_t>::const_iterator b_it;
+            for (b_it = it->second.deltas.begin(); b_it != it->second.deltas.end(); ++b_it) {
+                delta |= (uint32_t) (*b_it & 0x7F) << shift;
+                if (*b_it & 0x80) {
+                    shift += 7;
+                    continue;
+                }
+                value += delta;
+                if (value >= uid) return value == uid;
+                delta = 0;
+                shift = 0;
+            }
+            return false;
+        }
+
+    }
+}
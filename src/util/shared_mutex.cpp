@@ -0,0 +1,49 @@
+#include <ltm/util/shared_mutex.h>
+#include <stdexcept>
+
+namespace ltm {
+    namespace util {
+
+        ReentrantSharedMutex::Owner &ReentrantSharedMutex::owner() {
+            Owner *owner = _owner.get();
+            if (!owner) {
+                owner = new Owner();
+                _owner.reset(owner);
+            }
+            return *owner;
+        }
+
+        bool ReentrantSharedMutex::lock(bool unique) {
+            Owner &o = owner();
+            if (o.depth > 0) {
+                // already owned by this thread
+                if (unique && !o.unique) {
+                    throw std::logic_error("ReentrantSharedMutex: cannot upgrade a read lock to a write lock.");
+                }
+                ++o.depth;
+                return false;
+            }
+            if (unique) {
+                _mutex.lock();
+            } else {
+                _mutex.lock_shared();
+            }
+            o.depth = 1;
+            o.unique = unique;
+            return true;
+        }
+
+        void ReentrantSharedMutex::unlock(bool owns) {
+            Owner &o = owner();
+            --o.depth;
+            if (!owns) return;
+            if (o.unique) {
+                _mutex.unlock();
+            } else {
+                _mutex.unlock_shared();
+            }
+            o.unique = false;
+        }
+
+    }
+}
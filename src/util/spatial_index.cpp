@@ -0,0 +1,160 @@
+#include <ltm/util/spatial_index.h>
+
+#include <map>
+#include <iterator>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/polygon.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+namespace ltm {
+    namespace util {
+
+        typedef bg::model::d2::point_xy<double> Point2D;
+        typedef bg::model::box<Point2D> Box2D;
+        typedef bg::model::polygon<Point2D> Polygon2D;
+        typedef std::pair<Box2D, uint32_t> BoxEntry;
+        typedef bgi::rtree<BoxEntry, bgi::quadratic<16> > RTree;
+        typedef std::pair<std::string, std::string> TreeKey;
+
+        static bool box_covered_by(const Box2D &box, const Polygon2D &poly) {
+            // box/polygon is not supported by bg::covered_by, points are not valid polygons
+            if (bg::equals(box.min_corner(), box.max_corner())) return bg::covered_by(box.min_corner(), poly);
+            Polygon2D box_poly;
+            bg::convert(box, box_poly);
+            return bg::covered_by(box_poly, poly);
+        }
+
+        struct SpatialIndex::Impl {
+            std::map<TreeKey, RTree> trees;
+
+            // current entry of each uid
+            boost::unordered_map<uint32_t, std::pair<TreeKey, BoxEntry> > entries;
+
+            const RTree *find(const std::string &map_name, const std::string &frame_id) const {
+                std::map<TreeKey, RTree>::const_iterator it = trees.find(TreeKey(map_name, frame_id));
+                if (it == trees.end()) return NULL;
+                return &it->second;
+            }
+        };
+
+        SpatialIndex::SpatialIndex() : _impl(new Impl()) {}
+
+        SpatialIndex::~SpatialIndex() {}
+
+        size_t SpatialIndex::size() const {
+            return _impl->entries.size();
+        }
+
+        size_t SpatialIndex::trees() const {
+            return _impl->trees.size();
+        }
+
+        void SpatialIndex::clear() {
+            _impl->trees.clear();
+            _impl->entries.clear();
+        }
+
+        void SpatialIndex::insert(uint32_t uid, const std::string &map_name, const std::string &frame_id,
+                                  const std::vector<geometry_msgs::Point> &points) {
+            remove(uid);
+            if (points.empty()) return;
+
+            Box2D box(Point2D(points[0].x, points[0].y), Point2D(points[0].x, points[0].y));
+            std::vector<geometry_msgs::Point>::const_iterator it;
+            for (it = points.begin() + 1; it != points.end(); ++it) {
+                bg::expand(box, Point2D(it->x, it->y));
+            }
+
+            TreeKey key(map_name, frame_id);
+            BoxEntry entry(box, uid);
+            _impl->trees[key].insert(entry);
+            _impl->entries[uid] = std::make_pair(key, entry);
+        }
+
+        bool SpatialIndex::remove(uint32_t uid) {
+            boost::unordered_map<uint32_t, std::pair<TreeKey, BoxEntry> >::iterator it = _impl->entries.find(uid);
+            if (it == _impl->entries.end()) return false;
+            std::map<TreeKey, RTree>::iterator t_it = _impl->trees.find(it->second.first);
+            if (t_it != _impl->trees.end()) {
+                t_it->second.remove(it->second.second);
+                if (t_it->second.empty()) _impl->trees.erase(t_it);
+            }
+            _impl->entries.erase(it);
+            return true;
+        }
+
+        void SpatialIndex::query_radius(const std::string &map_name, const std::string &frame_id,
+                                        const geometry_msgs::Point &center, double radius,
+                                        std::vector<uint32_t> &uids) const {
+            const RTree *tree = _impl->find(map_name, frame_id);
+            if (!tree || radius < 0) return;
+
+            // candidates from the circle envelope, then the exact distance to each box
+            Point2D c(center.x, center.y);
+            Box2D envelope(Point2D(center.x - radius, center.y - radius), Point2D(center.x + radius, center.y + radius));
+            std::vector<BoxEntry> candidates;
+            tree->query(bgi::intersects(envelope), std::back_inserter(candidates));
+
+            std::vector<BoxEntry>::const_iterator it;
+            for (it = candidates.begin(); it != candidates.end(); ++it) {
+                if (bg::distance(c, it->first) <= radius) uids.push_back(it->second);
+            }
+        }
+
+        void SpatialIndex::query_polygon(const std::string &map_name, const std::string &frame_id,
+                                         const std::vector<geometry_msgs::Point> &polygon,
+                                         std::vector<uint32_t> &uids) const {
+            const RTree *tree = _impl->find(map_name, frame_id);
+            if (!tree || polygon.size() < 3) return;
+
+            Polygon2D poly;
+            std::vector<geometry_msgs::Point>::const_iterator p_it;
+            for (p_it = polygon.begin(); p_it != polygon.end(); ++p_it) {
+                bg::append(poly.outer(), Point2D(p_it->x, p_it->y));
+            }
+            // accept any orientation, open or closed
+            bg::correct(poly);
+
+            std::vector<BoxEntry> candidates;
+            tree->query(bgi::intersects(bg::return_envelope<Box2D>(poly)), std::back_inserter(candidates));
+
+            std::vector<BoxEntry>::const_iterator it;
+            for (it = candidates.begin(); it != candidates.end(); ++it) {
+                if (box_covered_by(it->first, poly)) uids.push_back(it->second);
+            }
+        }
+
+        void SpatialIndex::query_nearest(const std::string &map_name, const std::string &frame_id,
+                                         const geometry_msgs::Point &point, size_t k,
+                                         std::vector<uint32_t> &uids) const {
+            const RTree *tree = _impl->find(map_name, frame_id);
+            if (!tree || k == 0) return;
+
+            // the rtree returns the k nearest entries unordered
+            Point2D p(point.x, point.y);
+            std::vector<BoxEntry> result;
+            tree->query(bgi::nearest(p, (unsigned) k), std::back_inserter(result));
+
+            std::vector<std::pair<double, uint32_t> > ranked;
+            ranked.reserve(result.size());
+            std::vector<BoxEntry>::const_iterator it;
+            for (it = result.begin(); it != result.end(); ++it) {
+                ranked.push_back(std::make_pair(bg::comparable_distance(p, it->first), it->second));
+            }
+            std::sort(ranked.begin(), ranked.end());
+
+            std::vector<std::pair<double, uint32_t> >::const_iterator r_it;
+            for (r_it = ranked.begin(); r_it != ranked.end(); ++r_it) {
+                uids.push_back(r_it->second);
+            }
+        }
+
+    }
+}
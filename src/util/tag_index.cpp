@@ -0,0 +1,198 @@
+#include <ltm/util/tag_index.h>
+#include <cctype>
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+
+namespace ltm {
+    namespace util {
+
+        // tokenizer state for TagIndex::query
+        struct TagIndex::Parser {
+            const std::string &text;
+            size_t pos;
+            bool include_children;
+            std::string error;
+
+            Parser(const std::string &text, bool include_children)
+                    : text(text), pos(0), include_children(include_children) {}
+
+            void skip_spaces() {
+                while (pos < text.size() && std::isspace((unsigned char) text[pos])) ++pos;
+            }
+
+            bool at_end() {
+                skip_spaces();
+                return pos >= text.size();
+            }
+
+            // consumes c, when it is the next token
+            bool accept(char c) {
+                skip_spaces();
+                if (pos < text.size() && text[pos] == c) {
+                    ++pos;
+                    return true;
+                }
+                return false;
+            }
+
+            bool tag(std::string &value) {
+                skip_spaces();
+                value.clear();
+                if (pos < text.size() && text[pos] == '"') {
+                    size_t end = text.find('"', pos + 1);
+                    if (end == std::string::npos) return fail("unterminated quote");
+                    value = text.substr(pos + 1, end - pos - 1);
+                    pos = end + 1;
+                    return true;
+                }
+                size_t start = pos;
+                while (pos < text.size() && !std::isspace((unsigned char) text[pos])
+                       && std::string("&|!()\"").find(text[pos]) == std::string::npos) {
+                    ++pos;
+                }
+                if (pos == start) return fail("expected a tag");
+                value = text.substr(start, pos - start);
+                return true;
+            }
+
+            bool fail(const std::string &message) {
+                if (error.empty()) {
+                    std::stringstream ss;
+                    ss << message << " at position " << pos;
+                    error = ss.str();
+                }
+                return false;
+            }
+        };
+
+        TagIndex::TagIndex() {}
+
+        TagIndex::~TagIndex() {}
+
+        size_t TagIndex::size() const {
+            return _uids.size();
+        }
+
+        size_t TagIndex::tags() const {
+            return _tags.size();
+        }
+
+        void TagIndex::clear() {
+            _tags.clear();
+            _children_tags.clear();
+            _uids.clear();
+            _by_uid.clear();
+        }
+
+        void TagIndex::add(PostingMap &map, const std::vector<std::string> &tags, uint32_t uid) {
+            std::vector<std::string>::const_iterator it;
+            for (it = tags.begin(); it != tags.end(); ++it) {
+                map[*it].insert(uid);
+            }
+        }
+
+        void TagIndex::erase(PostingMap &map, const std::vector<std::string> &tags, uint32_t uid) {
+            std::vector<std::string>::const_iterator it;
+            for (it = tags.begin(); it != tags.end(); ++it) {
+                PostingMap::iterator m_it = map.find(*it);
+                if (m_it == map.end()) continue;
+                m_it->second.erase(uid);
+                if (m_it->second.empty()) map.erase(m_it);
+            }
+        }
+
+        void TagIndex::insert(uint32_t uid, const std::vector<std::string> &tags, const std::vector<std::string> &children_tags) {
+            remove(uid);
+            add(_tags, tags, uid);
+            add(_children_tags, children_tags, uid);
+            _uids.insert(uid);
+            _by_uid[uid] = std::make_pair(tags, children_tags);
+        }
+
+        bool TagIndex::remove(uint32_t uid) {
+            boost::unordered_map<uint32_t, std::pair<std::vector<std::string>, std::vector<std::string> > >::iterator it;
+            it = _by_uid.find(uid);
+            if (it == _by_uid.end()) return false;
+            erase(_tags, it->second.first, uid);
+            erase(_children_tags, it->second.second, uid);
+            _uids.erase(uid);
+            _by_uid.erase(it);
+            return true;
+        }
+
+        void TagIndex::lookup(const std::string &tag, bool include_children, PostingList &out) const {
+            out.clear();
+            PostingMap::const_iterator own = _tags.find(tag);
+            if (own != _tags.end()) own->second.decode(out);
+            if (!include_children) return;
+
+            PostingMap::const_iterator children = _children_tags.find(tag);
+            if (children == _children_tags.end()) return;
+            if (out.empty()) {
+                children->second.decode(out);
+                return;
+            }
+            PostingList children_uids, merged;
+            children->second.decode(children_uids);
+            merged.reserve(out.size() + children_uids.size());
+            std::set_union(out.begin(), out.end(), children_uids.begin(), children_uids.end(), std::back_inserter(merged));
+            out.swap(merged);
+        }
+
+        bool TagIndex::parse_or(Parser &p, PostingList &out) const {
+            if (!parse_and(p, out)) return false;
+            while (p.accept('|')) {
+                PostingList rhs, merged;
+                if (!parse_and(p, rhs)) return false;
+                std::set_union(out.begin(), out.end(), rhs.begin(), rhs.end(), std::back_inserter(merged));
+                out.swap(merged);
+            }
+            return true;
+        }
+
+        bool TagIndex::parse_and(Parser &p, PostingList &out) const {
+            if (!parse_not(p, out)) return false;
+            while (p.accept('&')) {
+                PostingList rhs, merged;
+                if (!parse_not(p, rhs)) return false;
+                std::set_intersection(out.begin(), out.end(), rhs.begin(), rhs.end(), std::back_inserter(merged));
+                out.swap(merged);
+            }
+            return true;
+        }
+
+        bool TagIndex::parse_not(Parser &p, PostingList &out) const {
+            if (p.accept('!')) {
+                PostingList operand, universe;
+                if (!parse_not(p, operand)) return false;
+                _uids.decode(universe);
+                out.clear();
+                std::set_difference(universe.begin(), universe.end(), operand.begin(), operand.end(), std::back_inserter(out));
+                return true;
+            }
+            if (p.accept('(')) {
+                if (!parse_or(p, out)) return false;
+                if (!p.accept(')')) return p.fail("expected ')'");
+                return true;
+            }
+            std::string tag;
+            if (!p.tag(tag)) return false;
+            lookup(tag, p.include_children, out);
+            return true;
+        }
+
+        bool TagIndex::query(const std::string &expression, bool include_children, PostingList &uids, std::string &error) const {
+            Parser p(expression, include_children);
+            uids.clear();
+            if (!parse_or(p, uids) || !p.at_end()) {
+                if (p.error.empty()) p.fail("unexpected token");
+                error = p.error;
+                uids.clear();
+                return false;
+            }
+            return true;
+        }
+
+    }
+}
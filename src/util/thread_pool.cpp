@@ -0,0 +1,110 @@
+#include <ltm/util/thread_pool.h>
+#include <boost/bind.hpp>
+
+namespace ltm {
+    namespace util {
+
+        WorkStealingPool::WorkStealingPool(size_t n_threads) : _pending(0), _queued(0), _next(0), _stop(false) {
+            if (n_threads == 0) n_threads = 1;
+            for (size_t i = 0; i < n_threads; ++i) {
+                _workers.push_back(WorkerPtr(new Worker()));
+            }
+            for (size_t i = 0; i < n_threads; ++i) {
+                _threads.create_thread(boost::bind(&WorkStealingPool::run, this, i));
+            }
+        }
+
+        WorkStealingPool::~WorkStealingPool() {
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                _stop = true;
+            }
+            _task_cv.notify_all();
+            _threads.join_all();
+        }
+
+        size_t WorkStealingPool::size() const {
+            return _workers.size();
+        }
+
+        void WorkStealingPool::submit(const Task &task) {
+            size_t idx;
+            size_t *own = _worker_idx.get();
+            {
+                boost::mutex::scoped_lock lock(_mutex);
+                idx = own ? *own : (_next++ % _workers.size());
+                ++_pending;
+                ++_queued;
+            }
+            {
+                boost::mutex::scoped_lock w_lock(_workers[idx]->mutex);
+                _workers[idx]->tasks.push_back(task);
+            }
+            _task_cv.notify_one();
+        }
+
+        void WorkStealingPool::wait() {
+            boost::mutex::scoped_lock lock(_mutex);
+            while (_pending > 0) {
+                _done_cv.wait(lock);
+            }
+        }
+
+        bool WorkStealingPool::pop(size_t idx, Task &task) {
+            // own deque: newest first
+            {
+                boost::mutex::scoped_lock w_lock(_workers[idx]->mutex);
+                if (!_workers[idx]->tasks.empty()) {
+                    task = _workers[idx]->tasks.back();
+                    _workers[idx]->tasks.pop_back();
+                    return true;
+                }
+            }
+            // steal: oldest first
+            for (size_t i = 1; i < _workers.size(); ++i) {
+                Worker &victim = *_workers[(idx + i) % _workers.size()];
+                boost::mutex::scoped_lock w_lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void WorkStealingPool::run(size_t idx) {
+            _worker_idx.reset(new size_t(idx));
+            while (true) {
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    while (_queued == 0 && !_stop) {
+                        _task_cv.wait(lock);
+                    }
+                    if (_stop && _queued == 0) return;
+                    // claim one task, some deque holds it
+                    --_queued;
+                }
+
+                Task task;
+                while (!pop(idx, task)) {
+                    // the claimed task is still being pushed by submit()
+                    boost::this_thread::yield();
+                }
+                try {
+                    task();
+                } catch (...) {
+                    // tasks report their own errors, keep the pool consistent
+                }
+
+                bool done;
+                {
+                    boost::mutex::scoped_lock lock(_mutex);
+                    done = (--_pending == 0);
+                }
+                if (done) _done_cv.notify_all();
+            }
+        }
+
+    }
+}
@@ -1,4 +1,5 @@
 #include <ltm/util/util.h>
+#include <iterator>
 
 namespace ltm {
     namespace util {
@@ -42,26 +43,55 @@ namespace ltm {
             return ss.str();
         }
 
-        void vector_merge(std::vector<std::string> &result, const std::vector<std::string> &source) {
-            std::vector<std::string>::const_iterator it;
-            for (it = source.begin(); it != source.end(); ++it) {
-
-                if (std::find(result.begin(), result.end(), *it) == result.end()) {
-                    result.push_back(*it);
-                }
-
+        std::string json_in(const std::string &field, const std::vector<uint32_t> &values) {
+            std::vector<uint32_t>::const_iterator it;
+            std::ostringstream ss;
+            ss << "{" << field << ": {$in: [";
+            for (it = values.begin(); it != values.end(); ++it) {
+                if (it != values.begin()) ss << ", ";
+                ss << *it;
             }
+            ss << "]}}";
+            return ss.str();
+        }
+
+        void vector_merge(std::vector<std::string> &result, const std::vector<std::string> &source) {
+            // sorted union without duplicates
+            std::vector<std::string> sorted_source(source);
+            std::sort(sorted_source.begin(), sorted_source.end());
             std::sort(result.begin(), result.end());
+
+            std::vector<std::string> merged;
+            merged.reserve(result.size() + sorted_source.size());
+            std::set_union(result.begin(), result.end(), sorted_source.begin(), sorted_source.end(), std::back_inserter(merged));
+            merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+            result.swap(merged);
         }
 
         void uid_vector_merge(std::vector<uint32_t> &result, const std::vector<uint32_t> &source) {
-            std::vector<uint32_t>::const_iterator it;
-            for (it = source.begin(); it != source.end(); ++it) {
-                if (std::find(result.begin(), result.end(), *it) == result.end()) {
-                    result.push_back(*it);
-                }
-            }
+            // sorted union without duplicates
+            std::vector<uint32_t> sorted_source(source);
+            std::sort(sorted_source.begin(), sorted_source.end());
             std::sort(result.begin(), result.end());
+
+            std::vector<uint32_t> merged;
+            merged.reserve(result.size() + sorted_source.size());
+            std::set_union(result.begin(), result.end(), sorted_source.begin(), sorted_source.end(), std::back_inserter(merged));
+            merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+            result.swap(merged);
+        }
+
+        void uid_vector_sort(std::vector<uint32_t> &uids) {
+            std::sort(uids.begin(), uids.end());
+            uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+        }
+
+        void uid_vector_intersect(std::vector<uint32_t> &result, const std::vector<uint32_t> &source) {
+            // both sorted, without duplicates
+            std::vector<uint32_t> common;
+            common.reserve(std::min(result.size(), source.size()));
+            std::set_intersection(result.begin(), result.end(), source.begin(), source.end(), std::back_inserter(common));
+            result.swap(common);
         }
 
     }
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <ltm/util/interval_tree.h>
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+
+using ltm::util::IntervalTree;
+
+// brute-force reference: every interval by uid
+typedef std::map<uint32_t, std::pair<double, double> > Intervals;
+
+enum Mode { OVERLAP, CONTAINED, BEFORE, AFTER };
+
+static bool matches(Mode mode, const std::pair<double, double> &interval, double start, double end) {
+    switch (mode) {
+        case OVERLAP:
+            return start <= interval.second && interval.first <= end;
+        case CONTAINED:
+            return start <= interval.first && interval.second <= end;
+        case BEFORE:
+            return interval.second < start;
+        default:
+            return start < interval.first;
+    }
+}
+
+// matching uids in ascending (start, uid) order, as the tree gives them
+static std::vector<uint32_t> scan(const Intervals &intervals, Mode mode, double start, double end) {
+    std::vector<std::pair<double, uint32_t> > found;
+    Intervals::const_iterator it;
+    for (it = intervals.begin(); it != intervals.end(); ++it) {
+        if (matches(mode, it->second, start, end)) found.push_back(std::make_pair(it->second.first, it->first));
+    }
+    std::sort(found.begin(), found.end());
+    std::vector<uint32_t> uids;
+    for (size_t i = 0; i < found.size(); ++i) uids.push_back(found[i].second);
+    return uids;
+}
+
+static std::vector<uint32_t> query(const IntervalTree &tree, Mode mode, double start, double end) {
+    std::vector<uint32_t> uids;
+    switch (mode) {
+        case OVERLAP:
+            tree.query_overlap(start, end, uids);
+            break;
+        case CONTAINED:
+            tree.query_contained(start, end, uids);
+            break;
+        case BEFORE:
+            tree.query_before(start, uids);
+            break;
+        default:
+            tree.query_after(start, uids);
+    }
+    return uids;
+}
+
+TEST(IntervalTree, AnswersEachMode) {
+    IntervalTree tree;
+    tree.insert(1, 0, 10);
+    tree.insert(2, 5, 15);
+    tree.insert(3, 20, 30);
+    // reversed bounds are swapped
+    tree.insert(4, 12, 8);
+
+    std::vector<uint32_t> uids;
+    tree.query_overlap(9, 11, uids);
+    ASSERT_EQ(3u, uids.size());
+    EXPECT_EQ(1u, uids[0]);
+    EXPECT_EQ(2u, uids[1]);
+    EXPECT_EQ(4u, uids[2]);
+
+    uids.clear();
+    tree.query_contained(0, 15, uids);
+    ASSERT_EQ(3u, uids.size());
+    EXPECT_EQ(1u, uids[0]);
+
+    uids.clear();
+    tree.query_before(15, uids);
+    ASSERT_EQ(2u, uids.size());
+    EXPECT_EQ(1u, uids[0]);
+    EXPECT_EQ(4u, uids[1]);
+
+    uids.clear();
+    tree.query_after(5, uids);
+    ASSERT_EQ(2u, uids.size());
+    EXPECT_EQ(4u, uids[0]);
+    EXPECT_EQ(3u, uids[1]);
+}
+
+TEST(IntervalTree, ReplacesAndRemovesByUid) {
+    IntervalTree tree;
+    tree.insert(1, 0, 10);
+    tree.insert(1, 50, 60);
+    EXPECT_EQ(1u, tree.size());
+    EXPECT_TRUE(tree.contains(1));
+
+    std::vector<uint32_t> uids;
+    tree.query_overlap(0, 10, uids);
+    EXPECT_TRUE(uids.empty());
+
+    EXPECT_TRUE(tree.remove(1));
+    EXPECT_FALSE(tree.remove(1));
+    EXPECT_FALSE(tree.contains(1));
+    EXPECT_EQ(0u, tree.size());
+    tree.query_after(-1, uids);
+    EXPECT_TRUE(uids.empty());
+}
+
+TEST(IntervalTree, MatchesBruteForceAfterRandomUpdates) {
+    srand(11);
+    IntervalTree tree;
+    Intervals intervals;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 300; ++i) {
+            uint32_t uid = 1 + rand() % 1000;
+            if (rand() % 4 == 0) {
+                EXPECT_EQ(intervals.erase(uid) > 0, tree.remove(uid));
+                continue;
+            }
+            // small integer bounds, so many intervals share a start or end with the queries
+            double start = rand() % 200;
+            double end = start + rand() % 40;
+            tree.insert(uid, start, end);
+            intervals[uid] = std::make_pair(start, end);
+        }
+        ASSERT_EQ(intervals.size(), tree.size());
+
+        for (int q = 0; q < 50; ++q) {
+            double start = rand() % 240 - 20;
+            double end = start + rand() % 60;
+            for (int mode = OVERLAP; mode <= AFTER; ++mode) {
+                EXPECT_EQ(scan(intervals, (Mode) mode, start, end), query(tree, (Mode) mode, start, end))
+                                    << "mode " << mode << " [" << start << ", " << end << "]";
+            }
+        }
+    }
+
+    // removing everything leaves an empty tree
+    Intervals::const_iterator it;
+    for (it = intervals.begin(); it != intervals.end(); ++it) EXPECT_TRUE(tree.remove(it->first));
+    EXPECT_EQ(0u, tree.size());
+    EXPECT_TRUE(query(tree, OVERLAP, -1000, 1000).empty());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <ltm/util/json_value.h>
+
+using ltm::util::JsonValue;
+
+static JsonValue parse(const std::string &text) {
+    JsonValue value;
+    std::string error;
+    EXPECT_TRUE(JsonValue::parse(text, value, error)) << text << ": " << error;
+    return value;
+}
+
+static bool parses(const std::string &text) {
+    JsonValue value;
+    std::string error;
+    return JsonValue::parse(text, value, error);
+}
+
+TEST(JsonValue, ParsesScalars) {
+    EXPECT_TRUE(parse("null").is_null());
+    EXPECT_EQ(JsonValue::BOOL, parse("true").type());
+    EXPECT_TRUE(parse("true").as_bool());
+    EXPECT_FALSE(parse("false").as_bool());
+    EXPECT_DOUBLE_EQ(-12.5, parse("-12.5").as_number());
+    EXPECT_DOUBLE_EQ(1500.0, parse("1.5e3").as_number());
+    EXPECT_EQ("a\"b\\c\nd", parse("\"a\\\"b\\\\c\\nd\"").as_string());
+}
+
+TEST(JsonValue, ParsesRelaxedMongoSyntax) {
+    JsonValue value = parse("{uid: 3, 'name': 'kitchen', tags: ['a', \"b\"]}");
+    ASSERT_TRUE(value.is_object());
+    EXPECT_DOUBLE_EQ(3, value.find("uid")->as_number());
+    EXPECT_EQ("kitchen", value.find("name")->as_string());
+    ASSERT_EQ(2u, value.find("tags")->as_array().size());
+    EXPECT_EQ("b", value.find("tags")->as_array()[1].as_string());
+}
+
+TEST(JsonValue, RejectsMalformedJson) {
+    EXPECT_FALSE(parses(""));
+    EXPECT_FALSE(parses("{"));
+    EXPECT_FALSE(parses("{uid: }"));
+    EXPECT_FALSE(parses("{uid: 1,, name: 2}"));
+    EXPECT_FALSE(parses("[1, 2"));
+    EXPECT_FALSE(parses("\"unterminated"));
+    EXPECT_FALSE(parses("{uid: 1} trailing"));
+    EXPECT_FALSE(parses("tru"));
+}
+
+TEST(JsonValue, FindsNestedPaths) {
+    JsonValue value = parse("{when: {start: 10, end: {sec: 20}}, uid: 1}");
+    ASSERT_TRUE(value.find_path("when.start") != NULL);
+    EXPECT_DOUBLE_EQ(10, value.find_path("when.start")->as_number());
+    EXPECT_DOUBLE_EQ(20, value.find_path("when.end.sec")->as_number());
+    EXPECT_TRUE(value.find_path("when.middle") == NULL);
+    EXPECT_TRUE(value.find_path("uid.sec") == NULL);
+}
+
+TEST(JsonValue, ComparesByTypeThenValue) {
+    // null < numbers < strings < objects < arrays < bools, as MongoDB sorts them
+    EXPECT_LT(JsonValue::compare(JsonValue(), JsonValue(1)), 0);
+    EXPECT_LT(JsonValue::compare(JsonValue(1), JsonValue(2.5)), 0);
+    EXPECT_LT(JsonValue::compare(JsonValue(100), JsonValue("1")), 0);
+    EXPECT_LT(JsonValue::compare(JsonValue("a"), JsonValue("b")), 0);
+    EXPECT_EQ(0, JsonValue::compare(JsonValue(2), JsonValue(2.0)));
+    EXPECT_TRUE(parse("{a: [1, 'x']}") == parse("{a: [1, \"x\"]}"));
+    EXPECT_TRUE(parse("{a: [1, 2]}") != parse("{a: [2, 1]}"));
+}
+
+TEST(JsonValue, RoundTripsThroughToString) {
+    JsonValue value = parse("{a: [1, 2.5, 'x', null, true], b: {c: \"q\\\"uote\"}}");
+    JsonValue copy = parse(value.to_string());
+    EXPECT_TRUE(value == copy);
+}
+
+TEST(JsonValue, CopiesAreDeep) {
+    JsonValue value = JsonValue::make_object();
+    value["list"].push_back(JsonValue(1));
+    JsonValue copy(value);
+    copy["list"].push_back(JsonValue(2));
+    EXPECT_EQ(1u, value.find("list")->as_array().size());
+    EXPECT_EQ(2u, copy.find("list")->as_array().size());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
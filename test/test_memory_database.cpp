@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <ltm/db/memory_database.h>
+
+using ltm::util::JsonValue;
+using ltm::db::MemoryQuery;
+
+static JsonValue doc(const std::string &text) {
+    JsonValue value;
+    std::string error;
+    EXPECT_TRUE(JsonValue::parse(text, value, error)) << text << ": " << error;
+    return value;
+}
+
+static bool matches(const std::string &document, const std::string &query) {
+    MemoryQuery q;
+    q.append(query);
+    return q.matches(doc(document));
+}
+
+TEST(MemoryQuery, MatchesEquality) {
+    EXPECT_TRUE(matches("{uid: 3, type: 'leaf'}", "{uid: 3}"));
+    EXPECT_FALSE(matches("{uid: 3, type: 'leaf'}", "{uid: 4}"));
+    EXPECT_TRUE(matches("{uid: 3, type: 'leaf'}", "{uid: 3, type: 'leaf'}"));
+    EXPECT_FALSE(matches("{uid: 3}", "{type: 'leaf'}"));
+    // array fields match any of their elements
+    EXPECT_TRUE(matches("{tags: ['a', 'b']}", "{tags: 'b'}"));
+    EXPECT_TRUE(matches("{}", "{}"));
+}
+
+TEST(MemoryQuery, MatchesIn) {
+    EXPECT_TRUE(matches("{uid: 3}", "{uid: {$in: [1, 3, 5]}}"));
+    EXPECT_FALSE(matches("{uid: 4}", "{uid: {$in: [1, 3, 5]}}"));
+    EXPECT_FALSE(matches("{uid: 4}", "{uid: {$in: []}}"));
+    EXPECT_TRUE(matches("{tags: ['a', 'b']}", "{tags: {$in: ['c', 'b']}}"));
+    EXPECT_TRUE(matches("{uid: 4}", "{uid: {$nin: [1, 3, 5]}}"));
+    EXPECT_FALSE(matches("{uid: 3}", "{uid: {$nin: [1, 3, 5]}}"));
+}
+
+TEST(MemoryQuery, MatchesRanges) {
+    EXPECT_TRUE(matches("{start: 10}", "{start: {$gte: 10, $lte: 20}}"));
+    EXPECT_TRUE(matches("{start: 20}", "{start: {$gte: 10, $lte: 20}}"));
+    EXPECT_FALSE(matches("{start: 21}", "{start: {$gte: 10, $lte: 20}}"));
+    EXPECT_FALSE(matches("{start: 10}", "{start: {$gt: 10}}"));
+    EXPECT_FALSE(matches("{start: 20}", "{start: {$lt: 20}}"));
+    // values of other types never match a numeric range
+    EXPECT_FALSE(matches("{start: '15'}", "{start: {$gte: 10, $lte: 20}}"));
+    EXPECT_FALSE(matches("{}", "{start: {$gte: 10}}"));
+
+    MemoryQuery q;
+    q.appendRangeInclusive("start", 10.0, 20.0);
+    EXPECT_TRUE(q.matches(doc("{start: 10}")));
+    EXPECT_FALSE(q.matches(doc("{start: 9.5}")));
+}
+
+TEST(MemoryQuery, MatchesLogicalOperators) {
+    const std::string query = "{$or: [{uid: 1}, {$and: [{type: 'leaf'}, {value: {$gt: 5}}]}]}";
+    EXPECT_TRUE(matches("{uid: 1, type: 'episode', value: 0}", query));
+    EXPECT_TRUE(matches("{uid: 2, type: 'leaf', value: 6}", query));
+    EXPECT_FALSE(matches("{uid: 2, type: 'leaf', value: 5}", query));
+    EXPECT_FALSE(matches("{uid: 2, type: 'episode', value: 6}", query));
+    EXPECT_TRUE(matches("{uid: 2}", "{$nor: [{uid: 1}, {uid: 3}]}"));
+    EXPECT_FALSE(matches("{uid: 3}", "{$nor: [{uid: 1}, {uid: 3}]}"));
+}
+
+TEST(MemoryQuery, MatchesNestedPaths) {
+    const std::string episode = "{when: {start: 10, end: 20}, where: {map_name: 'lab'}, children: [{uid: 1}, {uid: 2}]}";
+    EXPECT_TRUE(matches(episode, "{'when.start': {$gte: 5}, 'when.end': {$lte: 20}}"));
+    EXPECT_FALSE(matches(episode, "{'when.start': {$gt: 10}}"));
+    EXPECT_TRUE(matches(episode, "{'where.map_name': 'lab'}"));
+    EXPECT_FALSE(matches(episode, "{'where.frame_id': 'map'}"));
+    EXPECT_TRUE(matches(episode, "{'children.uid': 2}"));
+    EXPECT_TRUE(matches(episode, "{'where.frame_id': {$exists: false}}"));
+}
+
+TEST(MemoryQuery, AppendedConditionsAreAnded) {
+    MemoryQuery q;
+    q.append("type", std::string("leaf"));
+    q.appendGTE("value", 5);
+    EXPECT_TRUE(q.matches(doc("{type: 'leaf', value: 5}")));
+    EXPECT_FALSE(q.matches(doc("{type: 'leaf', value: 4}")));
+    EXPECT_FALSE(q.matches(doc("{type: 'episode', value: 5}")));
+}
+
+TEST(MemoryQuery, MalformedJsonMatchesNothing) {
+    MemoryQuery q;
+    q.append("{uid: ");
+    EXPECT_FALSE(q.matches(doc("{uid: 1}")));
+    EXPECT_FALSE(q.matches(doc("{}")));
+}
+
+class MemoryCollectionTest : public testing::Test {
+protected:
+    ltm::db::MemoryCollectionDataPtr _data;
+    boost::shared_ptr<ltm::db::MemoryMessageCollection> _coll;
+
+    void SetUp() {
+        _data.reset(new ltm::db::MemoryCollectionData());
+        _coll.reset(new ltm::db::MemoryMessageCollection("episodes", _data));
+        ASSERT_TRUE(_coll->initialize("ltm/Episode", "md5"));
+    }
+
+    void insert(const std::string &metadata, const std::string &message) {
+        std::string buffer(message);
+        ltm_db::Metadata::ConstPtr meta(new ltm::db::MemoryMetadata(doc(metadata)));
+        _coll->insert(&buffer[0], buffer.size(), meta);
+    }
+
+    ltm_db::Query::Ptr query(const std::string &json) {
+        ltm_db::Query::Ptr q = _coll->createQuery();
+        q->append(json);
+        return q;
+    }
+
+    std::vector<std::string> messages(ltm_db::Query::ConstPtr q, const std::string &sort_by = "", bool ascending = true) {
+        std::vector<std::string> found;
+        ltm_db::ResultIteratorHelper::Ptr it = _coll->query(q, sort_by, ascending);
+        while (it->hasData()) {
+            found.push_back(it->message());
+            it->next();
+        }
+        return found;
+    }
+};
+
+TEST_F(MemoryCollectionTest, QueriesInInsertionOrder) {
+    insert("{uid: 2, start: 30}", "b");
+    insert("{uid: 1, start: 10}", "a");
+    insert("{uid: 3, start: 20}", "c");
+    std::vector<std::string> found = messages(query("{start: {$gte: 20}}"));
+    ASSERT_EQ(2u, found.size());
+    EXPECT_EQ("b", found[0]);
+    EXPECT_EQ("c", found[1]);
+    EXPECT_EQ(3u, _coll->count());
+}
+
+TEST_F(MemoryCollectionTest, SortsByPath) {
+    insert("{uid: 2, when: {start: 30}}", "b");
+    insert("{uid: 1, when: {start: 10}}", "a");
+    insert("{uid: 3, when: {start: 20}}", "c");
+    // documents without the field go first, as null sorts before numbers
+    insert("{uid: 4}", "d");
+
+    std::vector<std::string> found = messages(query("{}"), "when.start", true);
+    ASSERT_EQ(4u, found.size());
+    EXPECT_EQ("d", found[0]);
+    EXPECT_EQ("a", found[1]);
+    EXPECT_EQ("c", found[2]);
+    EXPECT_EQ("b", found[3]);
+
+    found = messages(query("{uid: {$in: [1, 2, 3]}}"), "when.start", false);
+    ASSERT_EQ(3u, found.size());
+    EXPECT_EQ("b", found[0]);
+    EXPECT_EQ("c", found[1]);
+    EXPECT_EQ("a", found[2]);
+}
+
+TEST_F(MemoryCollectionTest, SortIsStable) {
+    insert("{uid: 1, revision: 0}", "a");
+    insert("{uid: 2, revision: 0}", "b");
+    insert("{uid: 3, revision: 0}", "c");
+    std::vector<std::string> found = messages(query("{}"), "revision", true);
+    ASSERT_EQ(3u, found.size());
+    EXPECT_EQ("a", found[0]);
+    EXPECT_EQ("b", found[1]);
+    EXPECT_EQ("c", found[2]);
+}
+
+TEST_F(MemoryCollectionTest, RemovesMatches) {
+    insert("{uid: 1}", "a");
+    insert("{uid: 2}", "b");
+    insert("{uid: 3}", "c");
+    EXPECT_EQ(2u, _coll->removeMessages(query("{$or: [{uid: 1}, {uid: 3}]}")));
+    std::vector<std::string> found = messages(query("{}"));
+    ASSERT_EQ(1u, found.size());
+    EXPECT_EQ("b", found[0]);
+
+    // malformed queries remove nothing
+    EXPECT_EQ(0u, _coll->removeMessages(query("{uid: ")));
+    EXPECT_EQ(1u, _coll->count());
+}
+
+TEST_F(MemoryCollectionTest, QueryResultsAreSnapshots) {
+    insert("{uid: 1}", "a");
+    ltm_db::ResultIteratorHelper::Ptr it = _coll->query(query("{}"));
+    insert("{uid: 2}", "b");
+    _coll->removeMessages(query("{uid: 1}"));
+    ASSERT_TRUE(it->hasData());
+    EXPECT_EQ("a", it->message());
+    it->next();
+    EXPECT_FALSE(it->hasData());
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,231 @@
+#include <gtest/gtest.h>
+#include <ltm/util/tag_index.h>
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+
+using ltm::util::CompressedPostingList;
+using ltm::util::TagIndex;
+
+static std::vector<std::string> tags(const std::string &a = "", const std::string &b = "", const std::string &c = "") {
+    std::vector<std::string> result;
+    if (!a.empty()) result.push_back(a);
+    if (!b.empty()) result.push_back(b);
+    if (!c.empty()) result.push_back(c);
+    return result;
+}
+
+static std::vector<uint32_t> uids(uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0) {
+    std::vector<uint32_t> result;
+    if (a) result.push_back(a);
+    if (b) result.push_back(b);
+    if (c) result.push_back(c);
+    if (d) result.push_back(d);
+    return result;
+}
+
+TEST(CompressedPostingList, MatchesASetAfterRandomUpdates) {
+    CompressedPostingList list;
+    std::set<uint32_t> expected;
+    srand(42);
+    for (int i = 0; i < 20000; ++i) {
+        // dense and sparse uids, with some runs of appends
+        uint32_t uid = (i % 3 == 0) ? (uint32_t) rand() : (uint32_t) (rand() % 5000);
+        if (i % 5 == 0) {
+            EXPECT_EQ(expected.erase(uid) > 0, list.erase(uid));
+        } else {
+            EXPECT_EQ(expected.insert(uid).second, list.insert(uid));
+        }
+    }
+    ASSERT_EQ(expected.size(), list.size());
+    std::vector<uint32_t> decoded;
+    list.decode(decoded);
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), decoded.begin()));
+
+    for (uint32_t uid = 0; uid < 5000; ++uid) {
+        EXPECT_EQ(expected.count(uid) > 0, list.contains(uid)) << uid;
+    }
+    EXPECT_TRUE(list.contains(0xFFFFFFFFu) == (expected.count(0xFFFFFFFFu) > 0));
+}
+
+TEST(CompressedPostingList, SplitsAndMergesBlocks) {
+    CompressedPostingList list;
+    for (uint32_t uid = 1; uid <= 1000; ++uid) list.insert(uid);
+    EXPECT_EQ(1000u, list.size());
+    EXPECT_GE(list.blocks(), 1000u / CompressedPostingList::MAX_BLOCK);
+
+    // removing most uids does not leave one block per remaining uid
+    for (uint32_t uid = 1; uid <= 1000; ++uid) {
+        if (uid % 100 != 0) list.erase(uid);
+    }
+    EXPECT_EQ(10u, list.size());
+    EXPECT_LE(list.blocks(), 3u);
+
+    for (uint32_t uid = 1; uid <= 1000; ++uid) list.erase(uid);
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(0u, list.blocks());
+    EXPECT_FALSE(list.erase(1));
+}
+
+class TagIndexTest : public testing::Test {
+protected:
+    TagIndex _index;
+
+    void SetUp() {
+        _index.insert(1, tags("kitchen", "robot"), tags());
+        _index.insert(2, tags("kitchen"), tags("robot"));
+        _index.insert(3, tags("living room", "person"), tags());
+        _index.insert(4, tags("person"), tags("kitchen"));
+    }
+
+    std::vector<uint32_t> query(const std::string &expression, bool include_children = false) {
+        std::vector<uint32_t> found;
+        std::string error;
+        EXPECT_TRUE(_index.query(expression, include_children, found, error)) << expression << ": " << error;
+        return found;
+    }
+
+    std::string error(const std::string &expression) {
+        std::vector<uint32_t> found(1, 99);
+        std::string message;
+        EXPECT_FALSE(_index.query(expression, false, found, message)) << expression;
+        EXPECT_TRUE(found.empty());
+        return message;
+    }
+};
+
+TEST_F(TagIndexTest, MatchesSingleTags) {
+    EXPECT_EQ(uids(1, 2), query("kitchen"));
+    EXPECT_EQ(uids(1, 2, 4), query("kitchen", true));
+    EXPECT_EQ(uids(), query("garden"));
+    EXPECT_EQ(4u, _index.size());
+}
+
+TEST_F(TagIndexTest, AndBindsTighterThanOr) {
+    // kitchen | (person & robot)
+    EXPECT_EQ(uids(1, 2), query("kitchen | person & robot"));
+    EXPECT_EQ(uids(1), query("(kitchen | person) & robot"));
+    // (robot & kitchen) | person
+    EXPECT_EQ(uids(1, 3, 4), query("robot & kitchen | person"));
+}
+
+TEST_F(TagIndexTest, NotBindsTighterThanAnd) {
+    EXPECT_EQ(uids(2), query("!robot & kitchen"));
+    EXPECT_EQ(uids(3, 4), query("!kitchen"));
+    EXPECT_EQ(uids(2, 3, 4), query("!(kitchen & robot)"));
+    EXPECT_EQ(uids(1, 2), query("!!kitchen"));
+    // '!' ranges over every indexed uid, also those without tags
+    _index.insert(5, tags(), tags());
+    EXPECT_EQ(uids(3, 4, 5), query("!kitchen"));
+}
+
+TEST_F(TagIndexTest, QuotesTagsWithSpacesAndOperators) {
+    EXPECT_EQ(uids(3), query("\"living room\""));
+    EXPECT_EQ(uids(3), query("person & \"living room\""));
+    _index.insert(6, tags("a&b", "x|!y"), tags());
+    EXPECT_EQ(uids(6), query("\"a&b\""));
+    EXPECT_EQ(uids(6), query("\"x|!y\" & \"a&b\""));
+    EXPECT_EQ(uids(), query("a"));
+}
+
+TEST_F(TagIndexTest, ReportsMalformedExpressions) {
+    EXPECT_NE(std::string::npos, error("").find("expected a tag"));
+    EXPECT_NE(std::string::npos, error("kitchen &").find("expected a tag"));
+    EXPECT_NE(std::string::npos, error("| kitchen").find("expected a tag"));
+    EXPECT_NE(std::string::npos, error("!").find("expected a tag"));
+    EXPECT_NE(std::string::npos, error("\"living room").find("unterminated quote"));
+    EXPECT_NE(std::string::npos, error("(kitchen | robot").find("expected ')'"));
+    EXPECT_NE(std::string::npos, error("kitchen robot").find("unexpected token"));
+    EXPECT_NE(std::string::npos, error("kitchen)").find("unexpected token"));
+    EXPECT_NE(std::string::npos, error("kitchen & & robot").find("position"));
+}
+
+TEST_F(TagIndexTest, RemovesAndReplacesTags) {
+    EXPECT_TRUE(_index.remove(1));
+    EXPECT_FALSE(_index.remove(1));
+    EXPECT_EQ(uids(2), query("kitchen"));
+    EXPECT_EQ(uids(2, 3, 4), query("!robot"));
+
+    _index.insert(2, tags("garden"), tags());
+    EXPECT_EQ(uids(), query("kitchen"));
+    EXPECT_EQ(uids(2), query("garden"));
+    EXPECT_EQ(uids(4), query("kitchen", true));
+    EXPECT_EQ(3u, _index.size());
+
+    _index.clear();
+    EXPECT_EQ(0u, _index.size());
+    EXPECT_EQ(uids(), query("!garden"));
+}
+
+// random expression, rendered and evaluated over brute-force sets
+struct Expression {
+    std::string text;
+    std::set<uint32_t> uids;
+};
+
+static const char *TAGS[] = {"a", "b", "c", "d"};
+
+static Expression random_expression(const std::vector<std::set<std::string> > &episodes, int depth) {
+    Expression result;
+    int kind = depth > 3 ? 0 : rand() % 4;
+    if (kind == 0) {
+        std::string tag = TAGS[rand() % 4];
+        result.text = tag;
+        for (uint32_t uid = 0; uid < episodes.size(); ++uid) {
+            if (episodes[uid].count(tag)) result.uids.insert(uid);
+        }
+    } else if (kind == 1) {
+        Expression operand = random_expression(episodes, depth + 1);
+        result.text = "!(" + operand.text + ")";
+        for (uint32_t uid = 0; uid < episodes.size(); ++uid) {
+            if (!operand.uids.count(uid)) result.uids.insert(uid);
+        }
+    } else {
+        Expression lhs = random_expression(episodes, depth + 1);
+        Expression rhs = random_expression(episodes, depth + 1);
+        if (kind == 2) {
+            result.text = "(" + lhs.text + " & " + rhs.text + ")";
+            std::set_intersection(lhs.uids.begin(), lhs.uids.end(), rhs.uids.begin(), rhs.uids.end(),
+                                  std::inserter(result.uids, result.uids.begin()));
+        } else {
+            result.text = "(" + lhs.text + " | " + rhs.text + ")";
+            std::set_union(lhs.uids.begin(), lhs.uids.end(), rhs.uids.begin(), rhs.uids.end(),
+                           std::inserter(result.uids, result.uids.begin()));
+        }
+    }
+    return result;
+}
+
+TEST(TagIndex, MatchesBruteForce) {
+    srand(7);
+    TagIndex index;
+    std::vector<std::set<std::string> > episodes(500);
+    for (int round = 0; round < 3; ++round) {
+        // re-tag a random subset each round
+        for (uint32_t uid = 0; uid < episodes.size(); ++uid) {
+            if (round > 0 && rand() % 3) continue;
+            episodes[uid].clear();
+            std::vector<std::string> own;
+            for (int t = 0; t < 4; ++t) {
+                if (rand() % 2) {
+                    own.push_back(TAGS[t]);
+                    episodes[uid].insert(TAGS[t]);
+                }
+            }
+            index.insert(uid, own, tags());
+        }
+        for (int i = 0; i < 200; ++i) {
+            Expression expression = random_expression(episodes, 0);
+            std::vector<uint32_t> found;
+            std::string error;
+            ASSERT_TRUE(index.query(expression.text, false, found, error)) << expression.text << ": " << error;
+            std::vector<uint32_t> expected(expression.uids.begin(), expression.uids.end());
+            EXPECT_EQ(expected, found) << expression.text;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}